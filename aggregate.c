@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "aggregate.h"
+
+#include <stddef.h>
+#include <string.h>
+
+static uint8_t* aggregate_put_uint32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+    return p + 4;
+}
+
+// Member of each field from AGGREGATE_FIRST, as in the OBIS table
+static const uint16_t aggregate_offset[AGGREGATE_LAST - AGGREGATE_FIRST + 1] = {
+    offsetof(struct dsmr_data_t, P_in_total),
+    offsetof(struct dsmr_data_t, P_out_total),
+    offsetof(struct dsmr_data_t, P_threshold),
+    offsetof(struct dsmr_data_t, I[0]),
+    offsetof(struct dsmr_data_t, I[1]),
+    offsetof(struct dsmr_data_t, I[2]),
+    offsetof(struct dsmr_data_t, V[0]),
+    offsetof(struct dsmr_data_t, V[1]),
+    offsetof(struct dsmr_data_t, V[2]),
+    offsetof(struct dsmr_data_t, P_in[0]),
+    offsetof(struct dsmr_data_t, P_in[1]),
+    offsetof(struct dsmr_data_t, P_in[2]),
+    offsetof(struct dsmr_data_t, P_out[0]),
+    offsetof(struct dsmr_data_t, P_out[1]),
+    offsetof(struct dsmr_data_t, P_out[2])
+};
+
+static uint32_t aggregate_get(const struct dsmr_data_t* data, int field)
+{
+    uint32_t value;
+    memcpy(&value, (const uint8_t*)data + aggregate_offset[field - AGGREGATE_FIRST], sizeof(value));
+    return value;
+}
+
+void Aggregate_Reset(struct aggregate_t* aggregate)
+{
+    memset(aggregate, 0, sizeof(*aggregate));
+}
+
+void Aggregate_Add(struct aggregate_t* aggregate, const struct dsmr_data_t* data)
+{
+    uint32_t step = 1;
+    uint32_t second = aggregate->second;
+    if (data->present & DSMR_FIELD_MASK(DSMR_FIELD_TIMESTAMP))
+    {
+        second = ((uint32_t)data->timestamp.hour * 60 + data->timestamp.minute) * 60 + data->timestamp.second;
+        if (aggregate->count != 0)
+            step = (second + 86400 - aggregate->second) % 86400;
+        if (step == 0)
+            step = 1;
+        else if (step > AGGREGATE_MAX_STEP)
+            step = AGGREGATE_MAX_STEP;
+    }
+
+    if (aggregate->count == 0)
+        aggregate->present = data->present & AGGREGATE_FIELDS;
+    else
+        aggregate->present &= data->present;
+    for (int field = AGGREGATE_FIRST; field <= AGGREGATE_LAST; ++field)
+    {
+        if (!(aggregate->present & DSMR_FIELD_MASK(field)))
+            continue;
+        struct aggregate_value_t* value = &aggregate->value[field - AGGREGATE_FIRST];
+        uint32_t v = aggregate_get(data, field);
+        if (aggregate->count == 0 || v < value->min)
+            value->min = v;
+        if (aggregate->count == 0 || v > value->max)
+            value->max = v;
+        value->integral += v * step;
+    }
+    if (aggregate->count != UINT16_MAX)
+        aggregate->count++;
+    aggregate->duration += (uint16_t)step;
+    aggregate->second = second;
+    aggregate->timestamp = data->timestamp;
+}
+
+uint32_t Aggregate_Mean(const struct aggregate_t* aggregate, enum dsmr_field_t field)
+{
+    if (!(aggregate->present & DSMR_FIELD_MASK(field)) || aggregate->duration == 0)
+        return UINT32_MAX;
+    return (aggregate->value[field - AGGREGATE_FIRST].integral + aggregate->duration / 2) / aggregate->duration;
+}
+
+uint16_t Aggregate_Pack(const struct aggregate_t* aggregate, uint8_t* buffer)
+{
+    uint8_t* p = buffer;
+    *p++ = AGGREGATE_VERSION;
+    p = aggregate_put_uint32(p, aggregate->present);
+    *p++ = (uint8_t)aggregate->timestamp.year;
+    *p++ = (uint8_t)(aggregate->timestamp.year >> 8);
+    *p++ = aggregate->timestamp.month;
+    *p++ = aggregate->timestamp.day;
+    *p++ = aggregate->timestamp.hour;
+    *p++ = aggregate->timestamp.minute;
+    *p++ = aggregate->timestamp.second;
+    *p++ = aggregate->timestamp.dst;
+    *p++ = (uint8_t)aggregate->count;
+    *p++ = (uint8_t)(aggregate->count >> 8);
+    *p++ = (uint8_t)aggregate->duration;
+    *p++ = (uint8_t)(aggregate->duration >> 8);
+    for (int field = AGGREGATE_FIRST; field <= AGGREGATE_LAST; ++field)
+    {
+        if (!(aggregate->present & DSMR_FIELD_MASK(field)))
+            continue;
+        const struct aggregate_value_t* value = &aggregate->value[field - AGGREGATE_FIRST];
+        p = aggregate_put_uint32(p, value->min);
+        p = aggregate_put_uint32(p, value->max);
+        p = aggregate_put_uint32(p, Aggregate_Mean(aggregate, (enum dsmr_field_t)field));
+        p = aggregate_put_uint32(p, value->integral);
+    }
+    return (uint16_t)(p - buffer);
+}
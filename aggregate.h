@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdint.h>
+#include "dsmr.h"
+
+/*
+Aggregate of the instantaneous fields (power, current, voltage) over the
+telegrams of a reading: minimum, maximum, mean and integral, in integer
+arithmetic. Each value holds for the time since the previous telegram,
+from the timestamps (1 s for DSMR 5), the first value for 1 s. Gaps of
+missed telegrams count AGGREGATE_MAX_STEP at most. The integral is in
+unit seconds, e.g. Ws for power (3600 Ws = 1 Wh), and the mean is the
+integral over the duration, rounded.
+
+Aggregate characteristic payload, little endian, packed:
+
+offset size
+     0    1  version (AGGREGATE_VERSION)
+     1    4  present, DSMR_FIELD_MASK of fields in all telegrams
+     5    8  timestamp of the last telegram
+    13    2  telegrams
+    15    2  duration (s)
+    17   16  per present field, in dsmr_field_t order: min, max, mean, integral
+
+Newer versions only append fields.
+*/
+#define AGGREGATE_VERSION   1
+#define AGGREGATE_FIELDS \
+    (DSMR_FIELD_MASK(DSMR_FIELD_P_IN_TOTAL) | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT_TOTAL) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_I1) | DSMR_FIELD_MASK(DSMR_FIELD_I2) | DSMR_FIELD_MASK(DSMR_FIELD_I3) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_V1) | DSMR_FIELD_MASK(DSMR_FIELD_V2) | DSMR_FIELD_MASK(DSMR_FIELD_V3) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_P_IN1) | DSMR_FIELD_MASK(DSMR_FIELD_P_IN2) | DSMR_FIELD_MASK(DSMR_FIELD_P_IN3) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT1) | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT2) | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT3))
+#define AGGREGATE_FIRST     DSMR_FIELD_P_IN_TOTAL
+#define AGGREGATE_LAST      DSMR_FIELD_P_OUT3
+#define AGGREGATE_SIZE_MAX  (17 + 16 * 14)
+#define AGGREGATE_MAX_STEP  10u     // seconds, DSMR 4 period
+
+struct aggregate_value_t {
+    uint32_t min;
+    uint32_t max;
+    uint32_t integral;              // unit seconds
+};
+
+struct aggregate_t {
+    uint32_t present;               // AGGREGATE_FIELDS in all telegrams
+    uint16_t count;                 // telegrams
+    uint16_t duration;              // seconds
+    uint32_t second;                // of the day, last telegram
+    struct dsmr_timestamp_t timestamp;
+    struct aggregate_value_t value[AGGREGATE_LAST - AGGREGATE_FIRST + 1];  // by field
+};
+
+void Aggregate_Reset(struct aggregate_t* aggregate);
+void Aggregate_Add(struct aggregate_t* aggregate, const struct dsmr_data_t* data);
+uint32_t Aggregate_Mean(const struct aggregate_t* aggregate, enum dsmr_field_t field);
+// Needs AGGREGATE_SIZE_MAX bytes, returns number of bytes written
+uint16_t Aggregate_Pack(const struct aggregate_t* aggregate, uint8_t* buffer);
+
+#endif // AGGREGATE_H
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "beacon.h"
+
+#include <string.h>
+
+static uint8_t* beacon_put_uint32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+    return p + 4;
+}
+
+static uint64_t beacon_get_uint64(const uint8_t* p)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+#define BEACON_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+static void beacon_sipround(uint64_t* v)
+{
+    v[0] += v[1]; v[1] = BEACON_ROTL(v[1], 13); v[1] ^= v[0]; v[0] = BEACON_ROTL(v[0], 32);
+    v[2] += v[3]; v[3] = BEACON_ROTL(v[3], 16); v[3] ^= v[2];
+    v[0] += v[3]; v[3] = BEACON_ROTL(v[3], 21); v[3] ^= v[0];
+    v[2] += v[1]; v[1] = BEACON_ROTL(v[1], 17); v[1] ^= v[2]; v[2] = BEACON_ROTL(v[2], 32);
+}
+
+void Beacon_Key(uint8_t* key, uint32_t passcode, const uint8_t* address)
+{
+    memset(key, 0, BEACON_KEY_SIZE);
+    beacon_put_uint32(key, passcode);
+    memcpy(key + 4, address, 6);
+}
+
+uint64_t Beacon_SipHash(const uint8_t* key, const uint8_t* data, uint16_t length)
+{
+    uint64_t k0 = beacon_get_uint64(key);
+    uint64_t k1 = beacon_get_uint64(key + 8);
+    uint64_t v[4] = {
+        k0 ^ 0x736f6d6570736575ull, k1 ^ 0x646f72616e646f6dull,
+        k0 ^ 0x6c7967656e657261ull, k1 ^ 0x7465646279746573ull
+    };
+    // Last block holds the remaining bytes and the length
+    uint64_t last = (uint64_t)length << 56;
+    uint16_t full = (uint16_t)(length & ~7u);
+    for (uint16_t i = 0; i < full; i += 8)
+    {
+        uint64_t m = beacon_get_uint64(data + i);
+        v[3] ^= m;
+        beacon_sipround(v);
+        beacon_sipround(v);
+        v[0] ^= m;
+    }
+    for (uint16_t i = full; i < length; ++i)
+        last |= (uint64_t)data[i] << (8 * (i - full));
+    v[3] ^= last;
+    beacon_sipround(v);
+    beacon_sipround(v);
+    v[0] ^= last;
+    v[2] ^= 0xFF;
+    for (int i = 0; i < 4; ++i)
+        beacon_sipround(v);
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+uint16_t Beacon_Pack(const uint8_t* key, uint32_t sequence, int32_t power, uint8_t tariff, uint8_t* buffer)
+{
+    uint8_t* p = buffer;
+    *p++ = BEACON_AD_SIZE - 1;
+    *p++ = 0xFF;                            // manufacturer specific data
+    *p++ = (uint8_t)BEACON_COMPANY;
+    *p++ = (uint8_t)(BEACON_COMPANY >> 8);
+    uint8_t* payload = p;
+    *p++ = BEACON_VERSION;
+    p = beacon_put_uint32(p, sequence);
+    p = beacon_put_uint32(p, (uint32_t)power);
+    *p++ = tariff;
+    p = beacon_put_uint32(p, (uint32_t)Beacon_SipHash(key, payload, (uint16_t)(p - payload)));
+    return (uint16_t)(p - buffer);
+}
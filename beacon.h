@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef BEACON_H
+#define BEACON_H
+
+#include <stdint.h>
+
+/*
+Beacon: live values in the scan response, for any number of listeners
+that scan without connecting. Manufacturer specific data (AD type 0xFF,
+company identifier 0xFFFF for testing), payload little endian, packed:
+
+offset size
+     0    1  version (BEACON_VERSION)
+     1    4  sequence      (telegram time, s since 2000 UTC)
+     5    4  net power     (int32 W, delivery negative, INT32_MIN unknown)
+     9    1  tariff        (0 unknown)
+    10    4  MAC           (SipHash-2-4 of bytes 0 to 9, first 4 bytes)
+
+The MAC key is the pairing passcode (uint32) and the device address, so
+only listeners that know the passcode can check values, no one else can
+make them. The sequence increases with every telegram, also over resets:
+listeners drop a payload with a sequence not above the last accepted one,
+so a recorded payload cannot be replayed. The key has no more than the
+20 bits of the 6 digit passcode, enough against spoofing a live value,
+not against an offline search of recorded payloads.
+*/
+#define BEACON_VERSION      1
+#define BEACON_SIZE         14
+#define BEACON_AD_SIZE      (BEACON_SIZE + 4)   // with length, type and company
+#define BEACON_COMPANY      0xFFFFu
+#define BEACON_KEY_SIZE     16
+
+void Beacon_Key(uint8_t* key, uint32_t passcode, const uint8_t* address);
+uint64_t Beacon_SipHash(const uint8_t* key, const uint8_t* data, uint16_t length);
+// AD structure with the payload, needs BEACON_AD_SIZE bytes, returns number
+// of bytes written
+uint16_t Beacon_Pack(const uint8_t* key, uint32_t sequence, int32_t power, uint8_t tariff, uint8_t* buffer);
+
+#endif // BEACON_H
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "bulk.h"
+#include "eventlog.h"
+#include "history.h"
+
+#include <string.h>
+
+enum BULK_STATE_T {
+    BULK_STATE_IDLE,
+    BULK_STATE_SEEKING,
+    BULK_STATE_COUNTING,
+    BULK_STATE_SENDING,
+    BULK_STATE_RESPONDING
+};
+
+static enum BULK_STATE_T bulk_state = BULK_STATE_IDLE;
+static uint8 bulk_response[4];
+static uint8 bulk_response_length;
+static uint32 bulk_records;
+
+// Records being sent
+static struct history_cursor_t bulk_cursor;
+static uint32 bulk_first_time;              // of the range, until seeked or counted
+static uint32 bulk_last_time;               // of the range
+static struct history_sample_t bulk_previous;
+static uint8 bulk_started;                  // first sample encoded
+static uint8 bulk_encoded[HISTORY_SAMPLE_MAX];
+static uint8 bulk_encoded_length;
+static uint8 bulk_encoded_pos;
+static uint8 bulk_packet[CYBLE_GATT_MTU - 3];
+static uint16 bulk_packet_length;           // waiting for a stack buffer
+
+static uint32 Bulk_Get32(const uint8* p)
+{
+    return p[0] | ((uint32)p[1] << 8) | ((uint32)p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+static void Bulk_Respond(uint8 opcode, uint8 code)
+{
+    bulk_response[0] = BULK_OP_RESPONSE;
+    bulk_response[1] = BULK_OPERATOR_NULL;
+    bulk_response[2] = opcode;
+    bulk_response[3] = code;
+    bulk_response_length = 4;
+    bulk_state = BULK_STATE_RESPONDING;
+}
+
+// Time range of the operator, returns BULK_RESPONSE_SUCCESS when valid
+static uint8 Bulk_Range(const CYBLE_GATT_VALUE_T* value, uint32* first, uint32* last)
+{
+    *first = 0;
+    *last = UINT32_MAX;
+    switch (value->val[1])
+    {
+    case BULK_OPERATOR_NULL:
+        return BULK_RESPONSE_INVALID_OPERATOR;
+    case BULK_OPERATOR_ALL:
+        return value->len == 2 ? BULK_RESPONSE_SUCCESS : BULK_RESPONSE_INVALID_OPERAND;
+    case BULK_OPERATOR_FROM:
+        if (value->len != 6)
+            return BULK_RESPONSE_INVALID_OPERAND;
+        *first = Bulk_Get32(value->val + 2);
+        return BULK_RESPONSE_SUCCESS;
+    case BULK_OPERATOR_RANGE:
+        if (value->len != 10)
+            return BULK_RESPONSE_INVALID_OPERAND;
+        *first = Bulk_Get32(value->val + 2);
+        *last = Bulk_Get32(value->val + 6);
+        return *first <= *last ? BULK_RESPONSE_SUCCESS : BULK_RESPONSE_INVALID_OPERAND;
+    default:
+        return BULK_RESPONSE_OPERATOR_NOT_SUPPORTED;
+    }
+}
+
+// Encode the next record in range, 0 when done
+static uint8 Bulk_EncodeNext()
+{
+    struct history_sample_t sample;
+    if (!History_Next(&bulk_cursor, &sample) || sample.value[HISTORY_FIELD_TIME] > bulk_last_time)
+        return 0;
+    bulk_encoded_length = (uint8)History_Encode(bulk_started ? &bulk_previous : NULL, &sample, bulk_encoded);
+    bulk_encoded_pos = 0;
+    bulk_previous = sample;
+    bulk_started = 1;
+    bulk_records++;
+    return 1;
+}
+
+CYBLE_GATT_ERR_CODE_T Bulk_Control(const CYBLE_GATT_VALUE_T* value, uint8 subscribed)
+{
+    if (value->len < 2)
+        return CYBLE_GATT_ERR_INVALID_ATTRIBUTE_LEN;
+    if (!subscribed)
+        return CYBLE_GATT_ERR_CCCD_IMPROPERLY_CONFIGURED;
+    uint8 opcode = value->val[0];
+    if (bulk_state != BULK_STATE_IDLE && opcode != BULK_OP_ABORT)
+        return CYBLE_GATT_ERR_PROCEDURE_ALREADY_IN_PROGRESS;
+
+    uint32 first, last;
+    uint8 code;
+    switch (opcode)
+    {
+    case BULK_OP_REPORT:
+        code = Bulk_Range(value, &first, &last);
+        if (code != BULK_RESPONSE_SUCCESS)
+            break;
+        // Seeked from the main loop, like counting
+        bulk_first_time = first;
+        bulk_last_time = last;
+        bulk_state = BULK_STATE_SEEKING;
+        return CYBLE_GATT_ERR_NONE;
+    case BULK_OP_NUMBER:
+        code = Bulk_Range(value, &first, &last);
+        if (code != BULK_RESPONSE_SUCCESS)
+            break;
+        // Counted from the main loop, walking the flash log takes long
+        bulk_first_time = first;
+        bulk_last_time = last;
+        bulk_state = BULK_STATE_COUNTING;
+        return CYBLE_GATT_ERR_NONE;
+    case BULK_OP_ABORT:
+        code = value->val[1] == BULK_OPERATOR_NULL ? BULK_RESPONSE_SUCCESS : BULK_RESPONSE_INVALID_OPERATOR;
+        break;
+    default:
+        code = BULK_RESPONSE_OP_NOT_SUPPORTED;
+        break;
+    }
+    Bulk_Respond(opcode, code);
+    return CYBLE_GATT_ERR_NONE;
+}
+
+static void Bulk_Seek()
+{
+    History_Seek(&bulk_cursor, bulk_first_time);
+    bulk_started = 0;
+    bulk_records = 0;
+    bulk_packet_length = 0;
+    if (Bulk_EncodeNext())
+        bulk_state = BULK_STATE_SENDING;
+    else
+        Bulk_Respond(BULK_OP_REPORT, BULK_RESPONSE_NO_RECORDS);
+}
+
+static void Bulk_Count()
+{
+    struct history_cursor_t cursor;
+    struct history_sample_t sample;
+    uint16 count = 0;
+    History_Seek(&cursor, bulk_first_time);
+    while (History_Next(&cursor, &sample) && sample.value[HISTORY_FIELD_TIME] <= bulk_last_time)
+        count++;
+    bulk_response[0] = BULK_OP_NUMBER_RESPONSE;
+    bulk_response[1] = BULK_OPERATOR_NULL;
+    bulk_response[2] = LO8(count);
+    bulk_response[3] = HI8(count);
+    bulk_response_length = 4;
+    bulk_state = BULK_STATE_RESPONDING;
+}
+
+void Bulk_Cancel()
+{
+    bulk_state = BULK_STATE_IDLE;
+}
+
+uint8 Bulk_Active()
+{
+    return bulk_state != BULK_STATE_IDLE;
+}
+
+void Bulk_ProcessEvents(uint16 mtu)
+{
+    while (bulk_state != BULK_STATE_IDLE)
+    {
+        if (CyBle_GetState() != CYBLE_STATE_CONNECTED)
+        {
+            Bulk_Cancel();
+            return;
+        }
+        if (bulk_state == BULK_STATE_SEEKING)
+            Bulk_Seek();
+        else if (bulk_state == BULK_STATE_COUNTING)
+            Bulk_Count();
+        if (CyBle_GattGetBusyStatus() == CYBLE_STACK_STATE_BUSY)
+            return;     // continue after CYBLE_EVT_STACK_BUSY_STATUS reports free
+
+        CYBLE_GATTS_HANDLE_VALUE_NTF_T handle;
+        if (bulk_state == BULK_STATE_SENDING)
+        {
+            // Fill the notification with the byte stream of records
+            uint16 size = (uint16)(mtu - 3u < sizeof(bulk_packet) ? mtu - 3u : sizeof(bulk_packet));
+            while (bulk_packet_length < size)
+            {
+                if (bulk_encoded_pos == bulk_encoded_length && !Bulk_EncodeNext())
+                    break;
+                uint16 length = bulk_encoded_length - bulk_encoded_pos;
+                if (length > size - bulk_packet_length)
+                    length = size - bulk_packet_length;
+                memcpy(bulk_packet + bulk_packet_length, bulk_encoded + bulk_encoded_pos, length);
+                bulk_packet_length += length;
+                bulk_encoded_pos += length;
+            }
+            if (bulk_packet_length == 0)
+            {
+                EventLog_Add(EVENTLOG_HISTORY_TRANSFER, bulk_records);
+                Bulk_Respond(BULK_OP_REPORT, BULK_RESPONSE_SUCCESS);
+                continue;
+            }
+            handle.attrHandle = CYBLE_POWER_METER_HISTORY_DATA_CHAR_HANDLE;
+            handle.value.val = bulk_packet;
+            handle.value.len = bulk_packet_length;
+        }
+        else
+        {
+            handle.attrHandle = CYBLE_POWER_METER_HISTORY_CONTROL_CHAR_HANDLE;
+            handle.value.val = bulk_response;
+            handle.value.len = bulk_response_length;
+        }
+
+        CYBLE_API_RESULT_T result = CyBle_GattsNotification(cyBle_connHandle, &handle);
+        if (result == CYBLE_ERROR_INSUFFICIENT_RESOURCES)
+            return;     // stack buffer full, retry later
+        if (result != CYBLE_ERROR_OK)
+        {
+            Bulk_Cancel();
+            return;
+        }
+        if (bulk_state == BULK_STATE_SENDING)
+            bulk_packet_length = 0;
+        else
+            bulk_state = BULK_STATE_IDLE;
+    }
+}
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef BULK_H
+#define BULK_H
+
+#include <project.h>
+
+/*
+Bulk download of the history (history.h), following the Record Access
+Control Point (RACP) of the Bluetooth SIG profiles. A central enables
+notifications of the history control point and history data, then writes
+the control point:
+
+    opcode, operator[, operand]
+
+Opcodes are BULK_OP_REPORT (records as notifications of history data),
+BULK_OP_NUMBER (count of records) and BULK_OP_ABORT. Operators select
+records by time (minutes since 2000 UTC, uint32): BULK_OPERATOR_ALL,
+BULK_OPERATOR_FROM (time) and BULK_OPERATOR_RANGE (first, last time).
+
+History data is a byte stream of samples, the first encoded against zero,
+split over as many notifications as needed. The transfer ends with a
+notification of the control point: BULK_OP_RESPONSE, 0, request opcode,
+BULK_RESPONSE_T. The number of records is notified as BULK_OP_NUMBER_RESPONSE,
+0, count (uint16).
+*/
+
+enum BULK_OP_T {
+    BULK_OP_REPORT = 1,
+    BULK_OP_ABORT = 3,
+    BULK_OP_NUMBER = 4,
+    BULK_OP_NUMBER_RESPONSE = 5,
+    BULK_OP_RESPONSE = 6
+};
+
+enum BULK_OPERATOR_T {
+    BULK_OPERATOR_NULL = 0,
+    BULK_OPERATOR_ALL = 1,
+    BULK_OPERATOR_FROM = 3,
+    BULK_OPERATOR_RANGE = 4
+};
+
+enum BULK_RESPONSE_T {
+    BULK_RESPONSE_SUCCESS = 1,
+    BULK_RESPONSE_OP_NOT_SUPPORTED = 2,
+    BULK_RESPONSE_INVALID_OPERATOR = 3,
+    BULK_RESPONSE_OPERATOR_NOT_SUPPORTED = 4,
+    BULK_RESPONSE_INVALID_OPERAND = 5,
+    BULK_RESPONSE_NO_RECORDS = 6
+};
+
+// Control point write, subscribed when notifications of both
+// characteristics are enabled
+CYBLE_GATT_ERR_CODE_T Bulk_Control(const CYBLE_GATT_VALUE_T* value, uint8 subscribed);
+void Bulk_Cancel();                 // disconnect or notifications disabled
+uint8 Bulk_Active();                // transfer or response pending
+void Bulk_ProcessEvents(uint16 mtu); // call from main loop
+
+#endif // BULK_H
@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "config.h"
+#include "eventlog.h"
+#include "flashlog.h"
+
+#include <string.h>
+
+#define CONFIG_MAGIC 0xC504
+
+static const struct config_t config_default = {
+    .magic = CONFIG_MAGIC,
+    .interval = 30,
+    .interval_idle = 300,
+    .burst = 0,
+    .deadband = { 0 },
+    .silence = { 0 },
+    .beacon = 0
+};
+
+static struct config_t config;
+static uint8 config_pending = 0;
+
+void Config_Start()
+{
+    uint16 length = 0;
+    const uint8* record = FlashLog_Find(FLASHLOG_TYPE_CONFIG, &length);
+    if (record != NULL && length == sizeof(config))
+        memcpy(&config, record, sizeof(config));
+    if (record == NULL || length != sizeof(config)
+        || config.magic != CONFIG_MAGIC
+        || config.interval < CONFIG_INTERVAL_MIN || config.interval > CONFIG_INTERVAL_MAX
+        || config.interval_idle < CONFIG_INTERVAL_MIN || config.interval_idle > CONFIG_INTERVAL_MAX
+        || config.burst > CONFIG_BURST_MAX || config.beacon > 1)
+    {
+        config = config_default;
+    }
+}
+
+void Config_Reset()
+{
+    config = config_default;
+    config_pending = 1;
+}
+
+const struct config_t* Config_Get()
+{
+    return &config;
+}
+
+int Config_SetInterval(uint16 interval, uint16 interval_idle)
+{
+    if (interval < CONFIG_INTERVAL_MIN || interval > CONFIG_INTERVAL_MAX
+        || interval_idle < CONFIG_INTERVAL_MIN || interval_idle > CONFIG_INTERVAL_MAX)
+        return 0;
+    if (interval != config.interval || interval_idle != config.interval_idle)
+    {
+        config.interval = interval;
+        config.interval_idle = interval_idle;
+        config_pending = 1;
+    }
+    return 1;
+}
+
+int Config_SetBurst(uint16 burst)
+{
+    if (burst > CONFIG_BURST_MAX)
+        return 0;
+    if (burst != config.burst)
+    {
+        config.burst = burst;
+        config_pending = 1;
+    }
+    return 1;
+}
+
+int Config_SetDeadband(uint8 index, uint32 deadband, uint16 silence)
+{
+    if (index >= CONFIG_DEADBANDS)
+        return 0;
+    if (deadband != config.deadband[index] || silence != config.silence[index])
+    {
+        config.deadband[index] = deadband;
+        config.silence[index] = silence;
+        config_pending = 1;
+    }
+    return 1;
+}
+
+int Config_SetBeacon(uint8 beacon)
+{
+    if (beacon > 1)
+        return 0;
+    if (beacon != config.beacon)
+    {
+        config.beacon = beacon;
+        config_pending = 1;
+    }
+    return 1;
+}
+
+void Config_Store()
+{
+    // The flash log writes the row when disconnected, flash writes take
+    // about 20 ms with the CPU blocked. Retried while the row is full.
+    if (config_pending && FlashLog_Append(FLASHLOG_TYPE_CONFIG, &config, sizeof(config)))
+    {
+        FlashLog_Commit();
+        EventLog_Add(EVENTLOG_CONFIG_SAVE, CYBLE_ERROR_OK);
+        config_pending = 0;
+    }
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <project.h>
+
+// User configuration, persisted in the flash log (flashlog.h). Changes are
+// written when no central is connected, as flash writes block the CPU.
+
+#define CONFIG_INTERVAL_MIN 1       // seconds, DSMR 5 native rate
+#define CONFIG_INTERVAL_MAX 900     // seconds, 15 minutes
+#define CONFIG_BURST_MAX    60      // seconds
+#define CONFIG_DEADBANDS    5       // characteristics with a deadband, see main.c
+
+struct config_t {
+    uint16 magic;           // CONFIG_MAGIC when valid
+    uint16 interval;        // seconds between readings while notifications are enabled
+    uint16 interval_idle;   // seconds between readings without subscribers
+    uint16 burst;           // seconds of telegrams aggregated per reading, 0 off
+    uint32 deadband[CONFIG_DEADBANDS];  // notify on changes above, units of the characteristic
+    uint16 silence[CONFIG_DEADBANDS];   // seconds, notify at least this often, 0 off
+    uint8 beacon;           // live values in the scan response (beacon.h), 0 off
+};
+
+void Config_Start();        // load from flash after FlashLog_Start, defaults if not valid
+void Config_Reset();        // factory defaults
+const struct config_t* Config_Get();
+int Config_SetInterval(uint16 interval, uint16 interval_idle);  // 0 if out of range
+int Config_SetBurst(uint16 burst);  // 0 if out of range
+int Config_SetDeadband(uint8 index, uint32 deadband, uint16 silence);  // 0 if out of range
+int Config_SetBeacon(uint8 beacon); // 0 if out of range
+void Config_Store();        // call from main loop, writes pending changes
+
+#endif // CONFIG_H
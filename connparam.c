@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "connparam.h"
+#include "eventlog.h"
+
+
+#define CONNPARAM_TIMEOUT_TICKS (30u * 32768u)   // LFCLK
+
+enum CONNPARAM_MODE_T {
+    CONNPARAM_MODE_NONE,    // parameters chosen by central
+    CONNPARAM_MODE_IDLE,
+    CONNPARAM_MODE_FAST
+};
+
+// Core spec (Vol 6, Part B, 4.5.2): timeout > (1 + latency) * interval
+// max * 2, checked by centrals (e.g. BlueZ hci_check_conn_params). Also
+// within the limits of iOS: interval max * (latency + 1) <= 6 s, interval
+// min * (latency + 1) * 3 < timeout <= 6 s. Here 5.4 s < 6 s, 2.7 s <= 6 s
+// and 4.5 s < 6 s. Intervals in 1.25 ms, timeout in 10 ms units.
+static const CYBLE_GAP_CONN_UPDATE_PARAM_T connparam_idle = {
+    .connIntvMin = 400,     // 500 ms
+    .connIntvMax = 720,     // 900 ms
+    .connLatency = 2,
+    .supervisionTO = 600    // 6 s
+};
+static const CYBLE_GAP_CONN_UPDATE_PARAM_T connparam_fast = {
+    .connIntvMin = 12,      // 15 ms
+    .connIntvMax = 24,      // 30 ms
+    .connLatency = 0,
+    .supervisionTO = 600    // 6 s
+};
+
+static uint8 connparam_connected = 0;
+static uint8 connparam_secured = 0;
+static uint8 connparam_pending = 0;     // request outstanding
+static uint32 connparam_requested = 0;  // LFCLK tick of the request
+static uint8 connparam_rejected = 0;    // central rejected idle parameters
+static uint8 connparam_fast_reasons = 0; // CONNPARAM_FAST_T
+static enum CONNPARAM_MODE_T connparam_mode = CONNPARAM_MODE_NONE;
+static uint16 connparam_interval = 0;
+static uint16 connparam_latency = 0;
+
+void ConnParam_Connected(uint16 interval, uint16 latency)
+{
+    connparam_connected = 1;
+    connparam_secured = connparam_pending = connparam_rejected = connparam_fast_reasons = 0;
+    connparam_mode = CONNPARAM_MODE_NONE;
+    // Kept when the central rejects the update
+    connparam_interval = interval;
+    connparam_latency = latency;
+    EventLog_Add(EVENTLOG_CONNECTION_PARAMETERS, connparam_interval | ((uint32)connparam_latency << 16));
+}
+
+void ConnParam_Disconnected()
+{
+    connparam_connected = 0;
+    connparam_interval = connparam_latency = 0;
+}
+
+void ConnParam_Secured()
+{
+    connparam_secured = 1;
+}
+
+void ConnParam_Updated(const CYBLE_GAP_CONN_PARAM_UPDATED_IN_CONTROLLER_T* param)
+{
+    connparam_pending = 0;
+    connparam_interval = param->connIntv;
+    connparam_latency = param->connLatency;
+    EventLog_Add(EVENTLOG_CONNECTION_PARAMETERS, connparam_interval | ((uint32)connparam_latency << 16));
+}
+
+void ConnParam_Response(uint16 result)
+{
+    if (result != 0)
+    {
+        // Rejected, keep parameters of central. Do not retry during this
+        // connection as the result will be the same.
+        connparam_pending = 0;
+        connparam_rejected = 1;
+    }
+    // When accepted, wait for the update to complete in the controller
+}
+
+void ConnParam_SetFast(uint8 reason, uint8 enable)
+{
+    if (enable)
+        connparam_fast_reasons |= reason;
+    else
+        connparam_fast_reasons &= ~reason;
+}
+
+void ConnParam_ProcessEvents()
+{
+    // L2CAP response timeout (30 s) without response or update complete,
+    // the request is lost: request again
+    if (connparam_pending
+        && CySysWdtGetCount(CY_SYS_WDT_COUNTER2) - connparam_requested >= CONNPARAM_TIMEOUT_TICKS)
+    {
+        EventLog_Add(EVENTLOG_CONNECTION_PARAMETERS_TIMEOUT, connparam_mode);
+        connparam_pending = 0;
+        connparam_mode = CONNPARAM_MODE_NONE;
+    }
+    if (!connparam_connected || !connparam_secured || connparam_pending || connparam_rejected)
+        return;
+
+    enum CONNPARAM_MODE_T mode = connparam_fast_reasons ? CONNPARAM_MODE_FAST : CONNPARAM_MODE_IDLE;
+    if (mode == connparam_mode)
+        return;
+
+    CYBLE_GAP_CONN_UPDATE_PARAM_T param = (mode == CONNPARAM_MODE_FAST) ? connparam_fast : connparam_idle;
+    if (CyBle_L2capLeConnectionParamUpdateRequest(cyBle_connHandle.bdHandle, &param) == CYBLE_ERROR_OK)
+    {
+        connparam_pending = 1;
+        connparam_requested = CySysWdtGetCount(CY_SYS_WDT_COUNTER2);
+        connparam_mode = mode;
+    }
+}
+
+uint16 ConnParam_GetInterval()
+{
+    return connparam_interval;
+}
+
+uint16 ConnParam_GetLatency()
+{
+    return connparam_latency;
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef CONNPARAM_H
+#define CONNPARAM_H
+
+#include <project.h>
+
+// Connection parameter policy. Data is only produced every 30 seconds, so
+// once the link is secured long intervals with slave latency are requested.
+// While a burst of data is pending (bulk transfer, notification backlog)
+// a short interval is requested, returning to idle afterwards.
+
+enum CONNPARAM_FAST_T {
+    CONNPARAM_FAST_NOTIFY = 0x01,   // notifications waiting for the stack
+    CONNPARAM_FAST_BULK = 0x02      // bulk transfer in progress
+};
+
+void ConnParam_Connected(uint16 interval, uint16 latency);   // initial parameters
+void ConnParam_Disconnected();
+void ConnParam_Secured();           // authentication or encryption complete
+void ConnParam_Updated(const CYBLE_GAP_CONN_PARAM_UPDATED_IN_CONTROLLER_T* param);
+void ConnParam_Response(uint16 result);
+void ConnParam_SetFast(uint8 reason, uint8 enable);
+void ConnParam_ProcessEvents();     // call from main loop
+
+uint16 ConnParam_GetInterval();     // current interval (1.25 ms units)
+uint16 ConnParam_GetLatency();      // current slave latency
+
+#endif // CONNPARAM_H
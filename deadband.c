@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "deadband.h"
+
+static uint32_t deadband_get_uint32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t deadband_count(uint16_t length)
+{
+    return (uint8_t)(length / 4 < DEADBAND_VALUES ? length / 4 : DEADBAND_VALUES);
+}
+
+void Deadband_Reset(struct deadband_t* last)
+{
+    last->count = 0;
+}
+
+int Deadband_Exceeded(const struct deadband_t* last, const uint8_t* value, uint16_t length,
+    uint32_t now, uint32_t deadband, uint16_t silence)
+{
+    uint8_t count = deadband_count(length);
+    if (last->count == 0 || last->count != count)
+        return 1;
+    // Also when the clock went back or the time is unknown
+    if (silence != 0 && (now == 0 || now < last->time || now - last->time >= silence))
+        return 1;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        uint32_t v = deadband_get_uint32(value + 4 * i);
+        uint32_t difference = v > last->value[i] ? v - last->value[i] : last->value[i] - v;
+        if (difference > deadband)
+            return 1;
+    }
+    return 0;
+}
+
+void Deadband_Sent(struct deadband_t* last, const uint8_t* value, uint16_t length, uint32_t now)
+{
+    last->count = deadband_count(length);
+    for (uint8_t i = 0; i < last->count; ++i)
+        last->value[i] = deadband_get_uint32(value + 4 * i);
+    last->time = now;
+}
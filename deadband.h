@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <stdint.h>
+
+/*
+Deadband of a notified characteristic: the values of the payload, little
+endian uint32 in the units of the characteristic (W, Wh, mA, mV, dm3), are
+compared with the payload last sent to the central. The characteristic is
+notified when any value differs more than the deadband, or when nothing
+was sent for the silence period, so a steady value is still confirmed now
+and then. A trailing part shorter than 4 bytes is not compared.
+*/
+#define DEADBAND_VALUES     12      // compared per characteristic, phase info
+
+struct deadband_t {
+    uint32_t value[DEADBAND_VALUES];    // last sent
+    uint32_t time;                      // s, of the last sent
+    uint8_t count;                      // values, 0 when nothing sent
+};
+
+void Deadband_Reset(struct deadband_t* last);   // next value is sent
+// 1 when value must be sent: differs more than deadband from the last sent
+// value or silence (s, 0 without) elapsed since. now in seconds, 0 when
+// unknown counts as elapsed.
+int Deadband_Exceeded(const struct deadband_t* last, const uint8_t* value, uint16_t length,
+    uint32_t now, uint32_t deadband, uint16_t silence);
+void Deadband_Sent(struct deadband_t* last, const uint8_t* value, uint16_t length, uint32_t now);
+
+#endif // DEADBAND_H
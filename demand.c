@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "demand.h"
+#include "dsmr.h"
+#include "flashlog.h"
+#include "history.h"
+
+#include <string.h>
+
+#define DEMAND_COUNTERS \
+    (DSMR_FIELD_MASK(DSMR_FIELD_E_IN1) | DSMR_FIELD_MASK(DSMR_FIELD_E_IN2))
+
+// Computed monthly maximum, as stored in the flash log
+struct demand_peak_t {
+    uint32_t peak;                          // W
+    uint16_t month;                         // local year * 12 + month - 1
+};
+
+static struct demand_t demand;
+static struct demand_peak_t demand_peak;
+static uint8_t demand_peak_pending = 0;
+
+// Quarter hour being computed, times in seconds since 2000 UTC
+static uint32_t demand_quarter = 0;         // start, 0 when none
+static uint16_t demand_month;               // of the quarter
+static uint32_t demand_start_time;          // of the start energy, the quarter start when interpolated
+static uint32_t demand_start_energy;        // Wh
+static uint32_t demand_last_time;           // previous telegram
+static uint32_t demand_last_energy;
+
+static uint8_t* demand_put_uint32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+    return p + 4;
+}
+
+void Demand_Start()
+{
+    uint16_t length = 0;
+    const uint8_t* record = FlashLog_Find(FLASHLOG_TYPE_DEMAND, &length);
+    Demand_Reset();
+    if (record != NULL && length == sizeof(demand_peak))
+        memcpy(&demand_peak, record, sizeof(demand_peak));
+}
+
+void Demand_Reset()
+{
+    demand.average = demand.predicted = demand.peak = UINT32_MAX;
+    demand.elapsed = 0;
+    demand.flags = 0;
+    demand_peak.peak = UINT32_MAX;
+    demand_peak.month = 0;
+    demand_peak_pending = 0;
+    demand_quarter = 0;
+}
+
+// Quarter observed from its start ended with the average
+static void Demand_Completed(uint32_t average)
+{
+    if (demand_peak.peak == UINT32_MAX || demand_peak.month != demand_month || average > demand_peak.peak)
+    {
+        demand_peak.peak = average;
+        demand_peak.month = demand_month;
+        demand_peak_pending = 1;
+    }
+}
+
+void Demand_Add(const struct dsmr_data_t* data)
+{
+    if (!History_ValidTime(data))
+        return;
+    uint32_t time = History_Minutes(&data->timestamp) * 60u + data->timestamp.second;
+    uint32_t quarter = time - time % DEMAND_QUARTER;
+    uint16_t month = (uint16_t)(data->timestamp.year * 12u + data->timestamp.month - 1u);
+    uint8_t meter_peak = (data->present & DSMR_FIELD_MASK(DSMR_FIELD_P_DEMAND_MAX)) != 0;
+
+    demand.average = UINT32_MAX;
+    if ((data->present & DEMAND_COUNTERS) != DEMAND_COUNTERS)
+    {
+        demand_quarter = 0;
+    }
+    else
+    {
+        uint32_t energy = data->E_in[0] + data->E_in[1];
+        if (demand_quarter == 0 || time < demand_last_time || energy < demand_last_energy
+            || time - demand_last_time >= DEMAND_QUARTER)
+        {
+            // Without a recent telegram before, from this one on
+            demand_quarter = quarter;
+            demand_month = month;
+            demand_start_time = time;
+            demand_start_energy = energy;
+        }
+        else if (quarter != demand_quarter)
+        {
+            // Counter at the quarter start, between the previous telegram
+            // and this one
+            uint32_t start = demand_last_energy + (uint32_t)((uint64_t)(energy - demand_last_energy)
+                * (quarter - demand_last_time) / (time - demand_last_time));
+            if (!meter_peak && demand_start_time == demand_quarter)
+                Demand_Completed((start - demand_start_energy) * (3600u / DEMAND_QUARTER));
+            demand_quarter = quarter;
+            demand_month = month;
+            demand_start_time = quarter;
+            demand_start_energy = start;
+        }
+        demand_last_time = time;
+        demand_last_energy = energy;
+        if (time != demand_start_time)
+            demand.average = (uint32_t)((uint64_t)(energy - demand_start_energy) * 3600u / (time - demand_start_time));
+        else if (data->present & DSMR_FIELD_MASK(DSMR_FIELD_P_IN_TOTAL))
+            demand.average = data->P_in_total;
+    }
+
+    demand.flags = 0;
+    demand.elapsed = (uint16_t)(time - quarter);
+    if (data->present & DSMR_FIELD_MASK(DSMR_FIELD_P_DEMAND))
+    {
+        demand.average = data->P_demand;
+        demand.flags |= DEMAND_FLAG_METER_AVERAGE;
+    }
+    // The average so far, the instantaneous power for the rest
+    demand.predicted = UINT32_MAX;
+    if (demand.average != UINT32_MAX && (data->present & DSMR_FIELD_MASK(DSMR_FIELD_P_IN_TOTAL)))
+        demand.predicted = (uint32_t)(((uint64_t)demand.average * demand.elapsed
+            + (uint64_t)data->P_in_total * (DEMAND_QUARTER - demand.elapsed)) / DEMAND_QUARTER);
+    if (meter_peak)
+    {
+        demand.peak = data->P_demand_max;
+        demand.flags |= DEMAND_FLAG_METER_PEAK;
+    }
+    else
+        demand.peak = demand_peak.month == month ? demand_peak.peak : UINT32_MAX;
+}
+
+void Demand_ProcessEvents()
+{
+    // Written with the next row of the flash log, lost on reset before
+    if (demand_peak_pending && FlashLog_Append(FLASHLOG_TYPE_DEMAND, &demand_peak, sizeof(demand_peak)))
+        demand_peak_pending = 0;
+}
+
+const struct demand_t* Demand_Get()
+{
+    return &demand;
+}
+
+uint16_t Demand_Pack(const struct demand_t* value, uint8_t* buffer)
+{
+    uint8_t* p = buffer;
+    p = demand_put_uint32(p, value->average);
+    p = demand_put_uint32(p, value->predicted);
+    p = demand_put_uint32(p, value->peak);
+    *p++ = (uint8_t)value->elapsed;
+    *p++ = (uint8_t)(value->elapsed >> 8);
+    *p++ = value->flags;
+    return (uint16_t)(p - buffer);
+}
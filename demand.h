@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef DEMAND_H
+#define DEMAND_H
+
+#include <stdint.h>
+
+struct dsmr_data_t;
+
+/*
+Quarter hour demand for capacity tariffs: the average consumption (W) of
+the current quarter hour, the expected average at its end and the highest
+quarter hour of the month.
+
+Meters with 1-0:1.4.0 and 1-0:1.6.0 (Belgium) provide the average and the
+monthly maximum. Otherwise they are computed from the consumption counters
+(E_in, Wh): the counter at the start of the quarter is interpolated between
+the telegrams around it, the average is the energy since then over the
+time. The expected average continues the average with the instantaneous
+power (P_in_total) for the rest of the quarter, so a load switched on now
+shows its effect on the peak at once. The computed monthly maximum is kept
+in the flash log (flashlog.h).
+
+Demand characteristic payload, little endian, packed:
+
+offset size
+     0    4  average       (W, quarter hour so far)
+     4    4  predicted     (W, average at the end of the quarter hour)
+     8    4  peak          (W, monthly maximum quarter hour)
+    12    2  elapsed       (s, of the quarter hour)
+    14    1  flags         (DEMAND_FLAG_*)
+
+Values are 0xFFFFFFFF when not known yet.
+*/
+#define DEMAND_QUARTER      900u    // seconds
+#define DEMAND_SIZE         15
+#define DEMAND_FLAG_METER_AVERAGE   0x01u   // average from 1-0:1.4.0
+#define DEMAND_FLAG_METER_PEAK      0x02u   // peak from 1-0:1.6.0
+
+struct demand_t {
+    uint32_t average;
+    uint32_t predicted;
+    uint32_t peak;
+    uint16_t elapsed;
+    uint8_t flags;
+};
+
+void Demand_Start();                // load the monthly maximum, after FlashLog_Start
+void Demand_Reset();                // forget the quarter and the computed maximum
+void Demand_Add(const struct dsmr_data_t* data);
+void Demand_ProcessEvents();        // call from main loop, writes to the flash log
+const struct demand_t* Demand_Get();
+// Needs DEMAND_SIZE bytes, returns number of bytes written
+uint16_t Demand_Pack(const struct demand_t* demand, uint8_t* buffer);
+
+#endif // DEMAND_H
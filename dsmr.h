@@ -26,7 +26,7 @@ struct dsmr_timestamp_t {
 	uint8_t hour;
 	uint8_t minute;
 	uint8_t second;
-	uint8_t dst;
+	uint8_t dst;		// 0 not given, 1 winter (W), 2 summer (S)
 };
 
 #pragma GCC diagnostic ignored "-Wunused-function"
@@ -36,6 +36,38 @@ static void dsmr_timestamp_clear(struct dsmr_timestamp_t* ts)
 	ts->month = ts->day = ts->hour = ts->minute = ts->second = ts->dst = 0;
 }
 
+// Fields of dsmr_data_t, used as bit number in present and changed
+enum dsmr_field_t {
+	DSMR_FIELD_TIMESTAMP,
+	DSMR_FIELD_TARIFF,
+	DSMR_FIELD_E_IN1,
+	DSMR_FIELD_E_IN2,
+	DSMR_FIELD_E_OUT1,
+	DSMR_FIELD_E_OUT2,
+	DSMR_FIELD_P_IN_TOTAL,
+	DSMR_FIELD_P_OUT_TOTAL,
+	DSMR_FIELD_P_THRESHOLD,
+	DSMR_FIELD_I1,
+	DSMR_FIELD_I2,
+	DSMR_FIELD_I3,
+	DSMR_FIELD_V1,
+	DSMR_FIELD_V2,
+	DSMR_FIELD_V3,
+	DSMR_FIELD_P_IN1,
+	DSMR_FIELD_P_IN2,
+	DSMR_FIELD_P_IN3,
+	DSMR_FIELD_P_OUT1,
+	DSMR_FIELD_P_OUT2,
+	DSMR_FIELD_P_OUT3,
+	DSMR_FIELD_GAS_TIMESTAMP,
+	DSMR_FIELD_GAS_IN,
+	DSMR_FIELD_P_DEMAND,
+	DSMR_FIELD_P_DEMAND_MAX_TIMESTAMP,
+	DSMR_FIELD_P_DEMAND_MAX,
+	DSMR_FIELD_COUNT	// max 32
+};
+#define DSMR_FIELD_MASK(field)	(UINT32_C(1) << (field))
+
 struct dsmr_data_t {
 	
 /*	char header[LEN_HEADER];
@@ -90,6 +122,15 @@ struct dsmr_data_t {
 
 	struct dsmr_timestamp_t gas_timestamp;
 	uint32_t gas_in;
+
+	// Capacity tariff (Belgium): average consumption of the current quarter
+	// hour and the highest quarter hour of the month
+	uint32_t P_demand;
+	struct dsmr_timestamp_t P_demand_max_timestamp;
+	uint32_t P_demand_max;
+
+	uint32_t present;	// DSMR_FIELD_MASK of fields in the telegram
+	uint32_t changed;	// DSMR_FIELD_MASK of fields different from previous telegram
 };
 
 #endif
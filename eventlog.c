@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "eventlog.h"
+
+struct eventlog_entry_t {
+    uint32 tick;
+    uint32 arg;
+    uint8 id;
+};
+
+static struct eventlog_entry_t eventlog[EVENTLOG_SIZE];
+static volatile uint16 eventlog_head = 0;       // free running, written by producers
+static volatile uint16 eventlog_tail = 0;       // free running, written by consumer
+static volatile uint32 eventlog_lost = 0;       // dropped since the last stored entry
+
+// Debug UART frame being sent
+static uint8 eventlog_frame[1 + EVENTLOG_ENTRY_SIZE];
+static uint8 eventlog_frame_pos = sizeof(eventlog_frame);
+
+static void EventLog_Store(uint8 id, uint32 tick, uint32 arg)
+{
+    struct eventlog_entry_t* entry = &eventlog[eventlog_head & (EVENTLOG_SIZE - 1)];
+    entry->tick = tick;
+    entry->arg = arg;
+    entry->id = id;
+    eventlog_head++;
+}
+
+void EventLog_Add(enum EVENTLOG_ID_T id, uint32 arg)
+{
+    uint32 tick = CySysWdtGetCount(CY_SYS_WDT_COUNTER2);
+    uint8 intStatus = CyEnterCriticalSection();
+    uint16 used = eventlog_head - eventlog_tail;
+    // Drop when full, a dropped count first needs room for itself
+    if (used + (eventlog_lost != 0 ? 2u : 1u) > EVENTLOG_SIZE)
+        eventlog_lost++;
+    else
+    {
+        if (eventlog_lost != 0)
+        {
+            EventLog_Store(EVENTLOG_LOST, tick, eventlog_lost);
+            eventlog_lost = 0;
+        }
+        EventLog_Store(id, tick, arg);
+    }
+    CyExitCriticalSection(intStatus);
+}
+
+uint32 EventLog_Count()
+{
+    return (uint16)(eventlog_head - eventlog_tail);
+}
+
+// Little endian entry
+static void EventLog_Encode(uint16 sequence, uint8* p)
+{
+    const struct eventlog_entry_t* entry = &eventlog[sequence & (EVENTLOG_SIZE - 1)];
+    p[0] = entry->id;
+    for (uint32 b = 0; b < 4; ++b)
+    {
+        p[1 + b] = (uint8)(entry->tick >> (8 * b));
+        p[5 + b] = (uint8)(entry->arg >> (8 * b));
+    }
+}
+
+void EventLog_Drain(uint8 awake)
+{
+    // Keep deep sleep free of debug output, unless entries would be lost
+    if (!awake && EventLog_Count() < EVENTLOG_SIZE / 2 && eventlog_frame_pos == sizeof(eventlog_frame))
+        return;
+    while (UART_Debug_SpiUartGetTxBufferSize() < UART_Debug_TX_BUFFER_SIZE)
+    {
+        if (eventlog_frame_pos == sizeof(eventlog_frame))
+        {
+            if (EventLog_Count() == 0)
+                return;
+            eventlog_frame[0] = EVENTLOG_SYNC;
+            EventLog_Encode(eventlog_tail++, eventlog_frame + 1);
+            eventlog_frame_pos = 0;
+        }
+        UART_Debug_SpiUartWriteTxData(eventlog_frame[eventlog_frame_pos++]);
+    }
+}
+
+uint16 EventLog_Read(uint8* buffer, uint16 size)
+{
+    if (size < 2)
+        return 0;
+    uint16 sequence = eventlog_tail;
+    uint16 count = (uint16)EventLog_Count();
+    buffer[0] = (uint8)sequence;
+    buffer[1] = (uint8)(sequence >> 8);
+    uint16 length = 2;
+    for (uint16 i = 0; i < count && length + EVENTLOG_ENTRY_SIZE <= size; ++i)
+    {
+        EventLog_Encode(sequence + i, buffer + length);
+        length += EVENTLOG_ENTRY_SIZE;
+    }
+    return length;
+}
+
+void EventLog_Acknowledge(uint16 sequence)
+{
+    // Older acknowledgements (retried, or entries sent on the debug UART
+    // meanwhile) have nothing left to remove
+    uint16 count = (uint16)(sequence - eventlog_tail);
+    if (count <= EventLog_Count())
+        eventlog_tail = sequence;
+}
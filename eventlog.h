@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <project.h>
+
+// Binary event log replacing printf on the debug UART. Adding an entry
+// takes constant time from any context, including interrupt handlers.
+// Entries are sent on the debug UART only while the device is awake
+// anyway, or read (and acknowledged) over BLE. test/eventlog_main.cpp
+// decodes them.
+//
+// Entry (9 bytes, little endian): id, WDT2 tick (32768 Hz), argument.
+// On the debug UART each entry follows EVENTLOG_SYNC. Text output has no
+// bytes with the high bit set, so both can be mixed.
+
+#define EVENTLOG_SIZE 64u               // entries, power of 2
+#define EVENTLOG_ENTRY_SIZE 9u
+#define EVENTLOG_SYNC 0xA5u
+
+// Append only, the decoder relies on the values
+enum EVENTLOG_ID_T {
+    EVENTLOG_LOST,                      // entries dropped while full
+    EVENTLOG_START,
+    EVENTLOG_POWER_RESIDENCY,           // state | per mille << 8, hourly
+    EVENTLOG_CONFIG_SAVE,               // result
+    EVENTLOG_BOND_SAVE,                 // result
+    EVENTLOG_CONNECTION_PARAMETERS,     // interval | latency << 16
+    EVENTLOG_METER_OVERRUN,             // overruns | high water << 16
+    EVENTLOG_METER_PARSE_FAILED,
+    EVENTLOG_BLE_UNKNOWN,               // event code
+    EVENTLOG_BLE_STACK_ON,
+    EVENTLOG_BLE_TIMEOUT,
+    EVENTLOG_BLE_HARDWARE_ERROR,
+    EVENTLOG_BLE_HCI_STATUS,
+    EVENTLOG_BLE_STACK_BUSY,            // busy status
+    EVENTLOG_BLE_PENDING_FLASH_WRITE,
+    EVENTLOG_BLE_AUTH_REQ,
+    EVENTLOG_BLE_PASSKEY_ENTRY_REQUEST,
+    EVENTLOG_BLE_PASSKEY_DISPLAY_REQUEST,
+    EVENTLOG_BLE_AUTH_COMPLETE,
+    EVENTLOG_BLE_AUTH_FAILED,
+    EVENTLOG_BLE_CONNECTED,
+    EVENTLOG_BLE_DISCONNECTED,
+    EVENTLOG_BLE_ENCRYPT_CHANGE,        // encrypted
+    EVENTLOG_BLE_CONNECTION_UPDATE,
+    EVENTLOG_BLE_KEYINFO_EXCHANGE,
+    EVENTLOG_BLE_DATA_LENGTH_CHANGE,
+    EVENTLOG_BLE_ENHANCE_CONN_COMPLETE,
+    EVENTLOG_BLE_NEGOTIATED_AUTH_INFO,
+    EVENTLOG_BLE_ADVERTISEMENT_START_STOP,
+    EVENTLOG_BLE_GATT_CONNECT,
+    EVENTLOG_BLE_GATT_DISCONNECT,
+    EVENTLOG_BLE_MTU,                   // negotiated MTU
+    EVENTLOG_BLE_READ,                  // attribute handle
+    EVENTLOG_BLE_WRITE,                 // attribute handle
+    EVENTLOG_BLE_PREP_WRITE,
+    EVENTLOG_BLE_EXEC_WRITE,
+    EVENTLOG_BLE_HANDLE_VALUE_CNF,
+    EVENTLOG_BLE_SIGNED_WRITE,
+    EVENTLOG_BLE_INDICATION_ENABLED,    // attribute handle
+    EVENTLOG_BLE_INDICATION_DISABLED,   // attribute handle
+    EVENTLOG_HISTORY_TRANSFER,          // records sent
+    EVENTLOG_FLASHLOG_START,            // rows found
+    EVENTLOG_FLASHLOG_COMMIT,           // result
+    EVENTLOG_METER_BURST,               // telegrams | seconds << 16
+    EVENTLOG_CONNECTION_PARAMETERS_TIMEOUT, // mode requested
+    EVENTLOG_ID_COUNT
+};
+
+void EventLog_Add(enum EVENTLOG_ID_T id, uint32 arg);
+uint32 EventLog_Count();
+// Send entries on the debug UART without blocking, while awake for other
+// reasons or when half full
+void EventLog_Drain(uint8 awake);
+// Sequence number of the oldest entry (uint16) and the whole entries that
+// fit in buffer, returns bytes written. Entries stay in the log, a read
+// can be repeated until they are acknowledged.
+uint16 EventLog_Read(uint8* buffer, uint16 size);
+// Remove the entries before sequence (the read sequence plus the entries
+// received), ignored when outside the log
+void EventLog_Acknowledge(uint16 sequence);
+
+#endif // EVENTLOG_H
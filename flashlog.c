@@ -0,0 +1,258 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "flashlog.h"
+#include "eventlog.h"
+
+#include <string.h>
+
+#define FLASHLOG_MAGIC 0x464Cu
+#define FLASHLOG_MASK (FLASHLOG_ROWS - 1)
+
+// Rows of the log, erased (zero) on first programming
+static const uint8 flashlog_flash[FLASHLOG_ROWS][CY_FLASH_SIZEOF_ROW] CY_ALIGN(CY_FLASH_SIZEOF_ROW) = { { 0 } };
+// Read through volatile, the compiler assumes the const rows are zero
+static const uint8* volatile flashlog_rows = &flashlog_flash[0][0];
+
+static uint32 flashlog_first = 0;           // oldest row, free running
+static uint32 flashlog_next = 0;            // row being built
+static uint8 flashlog_row[CY_FLASH_SIZEOF_ROW];
+static uint16 flashlog_used = 0;            // payload bytes of the row being built
+static uint8 flashlog_commit = 0;
+static uint8 flashlog_deferring = 0;        // pending commit counted as deferred
+static uint32 flashlog_deferred = 0;
+static uint32 flashlog_keep[FLASHLOG_KEEP_TYPES];   // row with the latest record
+static uint8 flashlog_kept = 0;             // bit per kept type with a record
+
+// CRC16 as in parser.c, starting at 0xFFFF so an erased row fails
+static const uint16 flashlog_crc_table[16] = {
+    0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+    0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+static uint16 FlashLog_Crc(const uint8* data, uint16 length)
+{
+    uint16 crc = 0xFFFF;
+    for (uint16 i = 0; i < length; ++i)
+    {
+        crc = (crc >> 4) ^ flashlog_crc_table[(crc ^ data[i]) & 0x0F];
+        crc = (crc >> 4) ^ flashlog_crc_table[(crc ^ (data[i] >> 4)) & 0x0F];
+    }
+    return crc;
+}
+
+static uint32 FlashLog_Get32(const uint8* p)
+{
+    return p[0] | ((uint32)p[1] << 8) | ((uint32)p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+static const uint8* FlashLog_Flash(uint32 row)
+{
+    return flashlog_rows + (row & FLASHLOG_MASK) * CY_FLASH_SIZEOF_ROW;
+}
+
+// Row in flash, or in RAM while being built
+static const uint8* FlashLog_Row(uint32 row)
+{
+    return row == flashlog_next ? flashlog_row : FlashLog_Flash(row);
+}
+
+// Row written completely with the given sequence number
+static uint8 FlashLog_Valid(uint32 row)
+{
+    const uint8* data = FlashLog_Flash(row);
+    return (data[0] | (data[1] << 8)) == FLASHLOG_MAGIC
+        && (data[2] | (data[3] << 8)) == FlashLog_Crc(data + 4, CY_FLASH_SIZEOF_ROW - 4)
+        && FlashLog_Get32(data + 4) == row;
+}
+
+// Last record of a type in a row
+static const uint8* FlashLog_Last(const uint8* row, uint8 type, uint16* length)
+{
+    const uint8* found = NULL;
+    uint16 offset = 0;
+    while (offset + 2u <= FLASHLOG_PAYLOAD && row[FLASHLOG_HEADER + offset] != FLASHLOG_TYPE_END)
+    {
+        const uint8* record = row + FLASHLOG_HEADER + offset;
+        if (record[0] == type)
+        {
+            found = record + 2;
+            *length = record[1];
+        }
+        offset += 2u + record[1];
+    }
+    return found;
+}
+
+static void FlashLog_SetKept(uint8 type, uint32 row)
+{
+    uint32 index = type & ~FLASHLOG_TYPE_KEEP;
+    if ((type & FLASHLOG_TYPE_KEEP) && index < FLASHLOG_KEEP_TYPES)
+    {
+        flashlog_keep[index] = row;
+        flashlog_kept |= 1u << index;
+    }
+}
+
+// Empty row after the newest. Kept records in the row it overwrites and
+// in the row overwritten after it are copied first, so they are in flash
+// twice when a write is torn.
+static void FlashLog_Begin()
+{
+    memset(flashlog_row, 0, sizeof(flashlog_row));
+    flashlog_used = 0;
+    flashlog_commit = 0;
+    flashlog_deferring = 0;
+    for (uint32 index = 0; index < FLASHLOG_KEEP_TYPES; ++index)
+    {
+        uint32 row = flashlog_keep[index];
+        if ((flashlog_kept & (1u << index)) && row + FLASHLOG_ROWS - flashlog_next <= 1u)
+        {
+            uint16 length = 0;
+            const uint8* data = FlashLog_Last(FlashLog_Row(row), FLASHLOG_TYPE_KEEP | index, &length);
+            if (data != NULL)
+                FlashLog_Append(FLASHLOG_TYPE_KEEP | index, data, length);
+        }
+    }
+}
+
+void FlashLog_Start()
+{
+    // Newest valid row, then back to the first invalid one or a full log
+    uint8 found = 0;
+    uint32 newest = 0;
+    for (uint32 slot = 0; slot < FLASHLOG_ROWS; ++slot)
+    {
+        uint32 row = FlashLog_Get32(FlashLog_Flash(slot) + 4);
+        if ((row & FLASHLOG_MASK) == slot && (!found || (int32)(row - newest) > 0) && FlashLog_Valid(row))
+        {
+            newest = row;
+            found = 1;
+        }
+    }
+    flashlog_next = flashlog_first = found ? newest + 1 : 0;
+    while (found && flashlog_next - flashlog_first < FLASHLOG_ROWS && FlashLog_Valid(flashlog_first - 1))
+        flashlog_first--;
+
+    // Latest records of kept types
+    struct flashlog_cursor_t cursor;
+    uint8 type;
+    uint16 length;
+    flashlog_kept = 0;
+    FlashLog_Rewind(&cursor);
+    while (FlashLog_Next(&cursor, &type, &length) != NULL)
+        FlashLog_SetKept(type, cursor.row);     // row of the record
+
+    FlashLog_Begin();
+    EventLog_Add(EVENTLOG_FLASHLOG_START, flashlog_next - flashlog_first);
+}
+
+uint16 FlashLog_Free()
+{
+    if (flashlog_commit || flashlog_used + 2u >= FLASHLOG_PAYLOAD)
+        return 0;
+    return FLASHLOG_PAYLOAD - 2u - flashlog_used;
+}
+
+int FlashLog_Append(uint8 type, const void* data, uint16 length)
+{
+    if (type == FLASHLOG_TYPE_END || length > FlashLog_Free())
+        return 0;
+    uint8* record = flashlog_row + FLASHLOG_HEADER + flashlog_used;
+    record[0] = type;
+    record[1] = (uint8)length;
+    memcpy(record + 2, data, length);
+    flashlog_used += 2u + length;
+    FlashLog_SetKept(type, flashlog_next);
+    return 1;
+}
+
+void FlashLog_Commit()
+{
+    if (flashlog_used != 0)
+        flashlog_commit = 1;
+}
+
+void FlashLog_ProcessEvents(uint8 idle, uint8 blockable)
+{
+    // The write blocks the CPU, the meter would overrun the receive buffer
+    // and connection events would be missed
+    if (!flashlog_commit || !idle)
+        return;
+    if (!blockable)
+    {
+        if (!flashlog_deferring)
+            flashlog_deferred++;
+        flashlog_deferring = 1;
+        return;
+    }
+
+    uint16 crc;
+    flashlog_row[0] = LO8(FLASHLOG_MAGIC);
+    flashlog_row[1] = HI8(FLASHLOG_MAGIC);
+    for (uint32 i = 0; i < 4; ++i)
+        flashlog_row[4 + i] = (uint8)(flashlog_next >> (8 * i));
+    crc = FlashLog_Crc(flashlog_row + 4, CY_FLASH_SIZEOF_ROW - 4);
+    flashlog_row[2] = LO8(crc);
+    flashlog_row[3] = HI8(crc);
+    // Forced while connected, the caller checked the link tolerates it
+    CYBLE_API_RESULT_T res = CyBle_StoreAppData(flashlog_row, flashlog_flash[flashlog_next & FLASHLOG_MASK],
+        CY_FLASH_SIZEOF_ROW, CyBle_GetState() == CYBLE_STATE_CONNECTED);
+    EventLog_Add(EVENTLOG_FLASHLOG_COMMIT, res);
+    if (res != CYBLE_ERROR_OK)
+        return;     // retry later
+
+    if (flashlog_next - flashlog_first == FLASHLOG_ROWS)
+        flashlog_first++;
+    flashlog_next++;
+    FlashLog_Begin();
+}
+
+uint32 FlashLog_Deferred()
+{
+    return flashlog_deferred;
+}
+
+uint32 FlashLog_Rows()
+{
+    return flashlog_next - flashlog_first;
+}
+
+const uint8* FlashLog_Find(uint8 type, uint16* length)
+{
+    uint32 index = type & ~FLASHLOG_TYPE_KEEP;
+    if (!(type & FLASHLOG_TYPE_KEEP) || index >= FLASHLOG_KEEP_TYPES || !(flashlog_kept & (1u << index)))
+        return NULL;
+    return FlashLog_Last(FlashLog_Row(flashlog_keep[index]), type, length);
+}
+
+void FlashLog_Rewind(struct flashlog_cursor_t* cursor)
+{
+    cursor->row = flashlog_first;
+    cursor->offset = 0;
+}
+
+uint8 FlashLog_Dropped(const struct flashlog_cursor_t* cursor)
+{
+    return (int32)(cursor->row - flashlog_first) < 0;
+}
+
+const uint8* FlashLog_Next(struct flashlog_cursor_t* cursor, uint8* type, uint16* length)
+{
+    if (FlashLog_Dropped(cursor))
+        FlashLog_Rewind(cursor);
+    while (cursor->row != flashlog_next)
+    {
+        const uint8* record = FlashLog_Row(cursor->row) + FLASHLOG_HEADER + cursor->offset;
+        if (cursor->offset + 2u <= FLASHLOG_PAYLOAD && record[0] != FLASHLOG_TYPE_END)
+        {
+            *type = record[0];
+            *length = record[1];
+            cursor->offset += 2u + record[1];
+            return record + 2;
+        }
+        cursor->row++;
+        cursor->offset = 0;
+    }
+    return NULL;
+}
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef FLASHLOG_H
+#define FLASHLOG_H
+
+#include <project.h>
+
+/*
+Append-only log of records in spare flash rows, for data that must survive
+a reset (history, configuration). Records are collected in a RAM row and
+written as a whole row by FlashLog_ProcessEvents, when the meter is idle
+and no central is connected, or the connection tolerates the CPU blocked
+for a row write (FLASHLOG_WRITE_MS).
+
+Rows are written in turn, the oldest row is overwritten when the log is
+full, so every row wears equally. Each row holds a header (magic, CRC16,
+sequence number) and records (type, length, data), the rest is zero. On
+start the newest valid row is found, a row torn by a power loss fails the
+CRC and the log continues from the row before it.
+
+The latest record of a type with FLASHLOG_TYPE_KEEP set is never lost: it
+is copied into the row being built, before the row holding it is next to
+be overwritten.
+*/
+
+#define FLASHLOG_ROWS       256u    // power of 2, 64 KB with 256 byte rows
+#define FLASHLOG_HEADER     8u
+#define FLASHLOG_PAYLOAD    (CY_FLASH_SIZEOF_ROW - FLASHLOG_HEADER)
+#define FLASHLOG_TYPE_KEEP  0x80u   // latest record of the type is kept
+#define FLASHLOG_KEEP_TYPES 4u
+#define FLASHLOG_WRITE_MS   20u     // CPU blocked for a row write
+
+// Append only, stored in flash
+enum FLASHLOG_TYPE_T {
+    FLASHLOG_TYPE_END = 0,          // rest of the row unused
+    FLASHLOG_TYPE_HISTORY = 1,      // samples, see history.h
+    FLASHLOG_TYPE_CONFIG = FLASHLOG_TYPE_KEEP | 0,  // struct config_t
+    FLASHLOG_TYPE_DEMAND = FLASHLOG_TYPE_KEEP | 1   // monthly maximum, see demand.c
+};
+
+// Position of a record, stays valid while rows are written. Reading
+// continues at the oldest record when its row was overwritten.
+struct flashlog_cursor_t {
+    uint32 row;                     // free running sequence number
+    uint16 offset;                  // in the payload
+};
+
+void FlashLog_Start();              // find the newest row, after reset
+uint16 FlashLog_Free();             // record data that fits, 0 while a commit is pending
+int FlashLog_Append(uint8 type, const void* data, uint16 length);  // 0 if it does not fit
+void FlashLog_Commit();             // write the row when possible, start a new one
+// Call from main loop, idle when the meter is, blockable when the BLE link
+// allows a row write
+void FlashLog_ProcessEvents(uint8 idle, uint8 blockable);
+uint32 FlashLog_Deferred();         // commits that waited for the BLE link
+uint32 FlashLog_Rows();             // rows in use
+
+// Latest record of a kept type, NULL if none
+const uint8* FlashLog_Find(uint8 type, uint16* length);
+void FlashLog_Rewind(struct flashlog_cursor_t* cursor);    // oldest record
+uint8 FlashLog_Dropped(const struct flashlog_cursor_t* cursor);    // row overwritten
+// Record at the cursor, which moves to the next. NULL after the newest
+// written record.
+const uint8* FlashLog_Next(struct flashlog_cursor_t* cursor, uint8* type, uint16* length);
+
+#endif // FLASHLOG_H
@@ -0,0 +1,365 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "history.h"
+#include "dsmr.h"
+
+#include <string.h>
+
+#define HISTORY_BLOCK_MASK (HISTORY_BLOCKS - 1)
+
+static uint8_t history_data[HISTORY_BLOCKS][HISTORY_BLOCK_SIZE];
+static uint16_t history_used[HISTORY_BLOCKS];    // bytes
+static uint16_t history_count[HISTORY_BLOCKS];   // samples
+static uint32_t history_first = 0;               // oldest block, free running
+static uint32_t history_next = 0;                // after the newest block
+static struct history_sample_t history_last;     // newest sample stored
+
+// Next sample to write to the flash log
+static struct history_cursor_t history_persist;
+static uint8_t history_persist_pending = 0;
+static uint8_t history_record[FLASHLOG_PAYLOAD];
+
+// Sample being aggregated
+static struct history_sample_t history_current;
+static int32_t history_power_sum;
+static uint16_t history_power_count;
+static uint8_t history_open = 0;
+
+static void History_StartBlock(struct history_cursor_t* cursor, uint32_t block);
+
+void History_Reset()
+{
+    history_first = history_next = 0;
+    history_open = 0;
+    History_StartBlock(&history_persist, 0);
+    history_persist_pending = 0;
+}
+
+// The parser accepts any two digits per field
+static int History_ValidTimestamp(const struct dsmr_timestamp_t* ts)
+{
+    return ts->year > 2000 && ts->year < 2100 && ts->month >= 1 && ts->month <= 12
+        && ts->day >= 1 && ts->day <= 31 && ts->hour < 24 && ts->minute < 60 && ts->second < 60;
+}
+
+int History_ValidTime(const struct dsmr_data_t* data)
+{
+    return (data->present & DSMR_FIELD_MASK(DSMR_FIELD_TIMESTAMP)) && History_ValidTimestamp(&data->timestamp);
+}
+
+uint32_t History_Minutes(const struct dsmr_timestamp_t* ts)
+{
+    static const uint16_t month_days[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+    if (!History_ValidTimestamp(ts))
+        return 0;
+    uint32_t year = ts->year - 2000u;
+    uint32_t days = year * 365u + (year + 3u) / 4u + month_days[ts->month - 1] + ts->day - 1u;
+    if (ts->month > 2 && year % 4u == 0)
+        days++;
+    return days * 1440u + ts->hour * 60u + ts->minute - (ts->dst == 2 ? 120u : 60u);
+}
+
+uint16_t History_Encode(const struct history_sample_t* previous,
+    const struct history_sample_t* sample, uint8_t* buffer)
+{
+    uint8_t* p = buffer;
+    for (int field = 0; field < HISTORY_FIELD_COUNT; ++field)
+    {
+        int32_t delta = (int32_t)(sample->value[field] - (previous ? previous->value[field] : 0));
+        uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        while (zigzag >= 0x80)
+        {
+            *p++ = (uint8_t)(zigzag | 0x80);
+            zigzag >>= 7;
+        }
+        *p++ = (uint8_t)zigzag;
+    }
+    return (uint16_t)(p - buffer);
+}
+
+uint16_t History_Decode(struct history_sample_t* previous, const uint8_t* buffer, uint16_t length)
+{
+    struct history_sample_t sample;
+    uint16_t used = 0;
+    for (int field = 0; field < HISTORY_FIELD_COUNT; ++field)
+    {
+        uint32_t zigzag = 0;
+        for (uint32_t shift = 0;; shift += 7)
+        {
+            if (used == length || shift > 28)
+                return 0;
+            uint8_t b = buffer[used++];
+            zigzag |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+        sample.value[field] = previous->value[field] + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+    }
+    *previous = sample;
+    return used;
+}
+
+static void History_Store(const struct history_sample_t* sample)
+{
+    uint8_t encoded[HISTORY_SAMPLE_MAX];
+    uint32_t index = (history_next - 1) & HISTORY_BLOCK_MASK;
+    uint16_t length = 0;
+    if (history_next != history_first)
+        length = History_Encode(&history_last, sample, encoded);
+    if (history_next == history_first || history_used[index] + length > HISTORY_BLOCK_SIZE)
+    {
+        // New block, starting against zero. Drop the oldest when full.
+        if (history_next - history_first == HISTORY_BLOCKS)
+            history_first++;
+        index = history_next++ & HISTORY_BLOCK_MASK;
+        history_used[index] = history_count[index] = 0;
+        length = History_Encode(NULL, sample, encoded);
+    }
+    memcpy(history_data[index] + history_used[index], encoded, length);
+    history_used[index] += length;
+    history_count[index]++;
+    history_last = *sample;
+    history_persist_pending = 1;
+}
+
+static void History_Close()
+{
+    if (history_power_count != 0)
+        history_current.value[HISTORY_FIELD_P_AVG] = (uint32_t)(history_power_sum / history_power_count);
+    else
+    {
+        history_current.value[HISTORY_FIELD_P_AVG] = HISTORY_POWER_NONE;
+        history_current.value[HISTORY_FIELD_P_MIN] = HISTORY_POWER_NONE;
+        history_current.value[HISTORY_FIELD_P_MAX] = HISTORY_POWER_NONE;
+    }
+    History_Store(&history_current);
+    history_open = 0;
+}
+
+static uint32_t History_Counter(const struct dsmr_data_t* data, enum dsmr_field_t field, uint32_t value)
+{
+    return (data->present & DSMR_FIELD_MASK(field)) ? value : HISTORY_NONE;
+}
+
+void History_Add(const struct dsmr_data_t* data)
+{
+    if (!History_ValidTime(data))
+        return;
+    uint32_t minutes = History_Minutes(&data->timestamp);
+    uint32_t start = minutes - minutes % HISTORY_INTERVAL;
+    if (history_open && start != history_current.value[HISTORY_FIELD_TIME])
+    {
+        if (start < history_current.value[HISTORY_FIELD_TIME])
+            return;     // meter clock set back
+        History_Close();
+    }
+    if (!history_open)
+    {
+        history_open = 1;
+        history_current.value[HISTORY_FIELD_TIME] = start;
+        history_power_sum = 0;
+        history_power_count = 0;
+    }
+
+    history_current.value[HISTORY_FIELD_E_IN1] = History_Counter(data, DSMR_FIELD_E_IN1, data->E_in[0]);
+    history_current.value[HISTORY_FIELD_E_IN2] = History_Counter(data, DSMR_FIELD_E_IN2, data->E_in[1]);
+    history_current.value[HISTORY_FIELD_E_OUT1] = History_Counter(data, DSMR_FIELD_E_OUT1, data->E_out[0]);
+    history_current.value[HISTORY_FIELD_E_OUT2] = History_Counter(data, DSMR_FIELD_E_OUT2, data->E_out[1]);
+    history_current.value[HISTORY_FIELD_GAS_IN] = History_Counter(data, DSMR_FIELD_GAS_IN, data->gas_in);
+    if (data->present & DSMR_FIELD_MASK(DSMR_FIELD_P_IN_TOTAL))
+    {
+        int32_t power = (int32_t)data->P_in_total;
+        if (data->present & DSMR_FIELD_MASK(DSMR_FIELD_P_OUT_TOTAL))
+            power -= (int32_t)data->P_out_total;
+        if (history_power_count == 0 || power < (int32_t)history_current.value[HISTORY_FIELD_P_MIN])
+            history_current.value[HISTORY_FIELD_P_MIN] = (uint32_t)power;
+        if (history_power_count == 0 || power > (int32_t)history_current.value[HISTORY_FIELD_P_MAX])
+            history_current.value[HISTORY_FIELD_P_MAX] = (uint32_t)power;
+        history_power_sum += power;
+        history_power_count++;
+    }
+}
+
+// Cursor at the start of a RAM block, or the end of the history when past it
+static void History_StartBlock(struct history_cursor_t* cursor, uint32_t block)
+{
+    cursor->in_flash = 0;
+    cursor->block = block;
+    cursor->offset = 0;
+    memset(&cursor->previous, 0, sizeof(cursor->previous));
+}
+
+// Next sample in the flash log, 0 at its end
+static int History_NextRecord(struct history_cursor_t* cursor, struct history_sample_t* sample)
+{
+    if (FlashLog_Dropped(&cursor->record))
+    {
+        FlashLog_Rewind(&cursor->record);   // overwritten while reading
+        cursor->offset = 0;
+    }
+    for (;;)
+    {
+        struct flashlog_cursor_t next = cursor->record;
+        uint8 type;
+        uint16 length;
+        const uint8* data = FlashLog_Next(&next, &type, &length);
+        if (data == NULL)
+            return 0;
+        if (cursor->offset == 0)
+            memset(&cursor->previous, 0, sizeof(cursor->previous));
+        if (type == FLASHLOG_TYPE_HISTORY && cursor->offset < length)
+        {
+            uint16_t used = History_Decode(&cursor->previous, data + cursor->offset,
+                (uint16_t)(length - cursor->offset));
+            if (used != 0)
+            {
+                cursor->offset += used;
+                *sample = cursor->previous;
+                return 1;
+            }
+        }
+        cursor->record = next;
+        cursor->offset = 0;
+    }
+}
+
+// Next sample in RAM
+static int History_NextBlock(struct history_cursor_t* cursor, struct history_sample_t* sample)
+{
+    if ((int32_t)(cursor->block - history_first) < 0)
+        History_StartBlock(cursor, history_first);     // dropped while reading
+    while (cursor->block != history_next)
+    {
+        uint32_t index = cursor->block & HISTORY_BLOCK_MASK;
+        if (cursor->offset < history_used[index])
+        {
+            cursor->offset += History_Decode(&cursor->previous, history_data[index] + cursor->offset,
+                (uint16_t)(history_used[index] - cursor->offset));
+            *sample = cursor->previous;
+            return 1;
+        }
+        if (cursor->block + 1 == history_next)
+            return 0;   // newest block, samples are appended here
+        History_StartBlock(cursor, cursor->block + 1);
+    }
+    return 0;
+}
+
+// Cursor at the first sample in RAM with time at or after from
+static void History_SeekBlock(struct history_cursor_t* cursor, uint32_t from)
+{
+    // Skip blocks starting before from, when the next block does too
+    uint32_t block = history_first;
+    while ((int32_t)(block + 1 - history_next) < 0)
+    {
+        struct history_sample_t first;
+        memset(&first, 0, sizeof(first));
+        uint32_t index = (block + 1) & HISTORY_BLOCK_MASK;
+        History_Decode(&first, history_data[index], history_used[index]);
+        if (first.value[HISTORY_FIELD_TIME] > from)
+            break;
+        block++;
+    }
+    History_StartBlock(cursor, block);
+
+    struct history_cursor_t next = *cursor;
+    struct history_sample_t sample;
+    while (History_NextBlock(&next, &sample) && sample.value[HISTORY_FIELD_TIME] < from)
+        *cursor = next;
+}
+
+int History_Next(struct history_cursor_t* cursor, struct history_sample_t* sample)
+{
+    if (cursor->in_flash)
+    {
+        if (History_NextRecord(cursor, sample))
+        {
+            if (sample->value[HISTORY_FIELD_TIME] >= cursor->from)
+                cursor->from = sample->value[HISTORY_FIELD_TIME] + 1;
+            return 1;
+        }
+        History_SeekBlock(cursor, cursor->from);
+    }
+    return History_NextBlock(cursor, sample);
+}
+
+void History_Seek(struct history_cursor_t* cursor, uint32_t from)
+{
+    // Last history record in the flash log starting at or before from
+    struct flashlog_cursor_t next;
+    FlashLog_Rewind(&next);
+    cursor->record = next;
+    for (;;)
+    {
+        struct flashlog_cursor_t record = next;
+        struct history_sample_t first;
+        uint8 type;
+        uint16 length;
+        const uint8* data = FlashLog_Next(&next, &type, &length);
+        if (data == NULL)
+            break;
+        if (type != FLASHLOG_TYPE_HISTORY)
+            continue;
+        memset(&first, 0, sizeof(first));
+        if (History_Decode(&first, data, length) == 0 || first.value[HISTORY_FIELD_TIME] > from)
+            break;
+        cursor->record = record;
+    }
+    cursor->in_flash = 1;
+    cursor->offset = 0;
+    cursor->from = from;
+
+    // Skip samples before from, RAM is sought directly
+    struct history_cursor_t skip = *cursor;
+    struct history_sample_t sample;
+    while (skip.in_flash && History_Next(&skip, &sample) && sample.value[HISTORY_FIELD_TIME] < from)
+        *cursor = skip;
+}
+
+void History_ProcessEvents()
+{
+    // Samples not in flash yet, once they fill the rest of the row
+    if (!history_persist_pending)
+        return;
+    uint16_t free = FlashLog_Free();
+    if (free == 0)
+        return;     // row being written
+    struct history_cursor_t cursor = history_persist, next = cursor;
+    struct history_sample_t sample, previous;
+    uint16_t length = 0;
+    while (History_NextBlock(&next, &sample))
+    {
+        uint8_t encoded[HISTORY_SAMPLE_MAX];
+        uint16_t size = History_Encode(length != 0 ? &previous : NULL, &sample, encoded);
+        if (length + size > free)
+        {
+            if (length != 0)
+                FlashLog_Append(FLASHLOG_TYPE_HISTORY, history_record, length);
+            FlashLog_Commit();
+            history_persist = cursor;
+            return;
+        }
+        memcpy(history_record + length, encoded, size);
+        length += size;
+        previous = sample;
+        cursor = next;
+    }
+    history_persist_pending = 0;    // wait for more samples
+}
+
+uint32_t History_Count()
+{
+    uint32_t count = 0;
+    for (uint32_t block = history_first; block != history_next; ++block)
+        count += history_count[block & HISTORY_BLOCK_MASK];
+    return count;
+}
+
+uint16_t History_Used()
+{
+    uint16_t used = 0;
+    for (uint32_t block = history_first; block != history_next; ++block)
+        used += history_used[block & HISTORY_BLOCK_MASK];
+    return used;
+}
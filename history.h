@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include "flashlog.h"
+
+struct dsmr_data_t;
+struct dsmr_timestamp_t;
+
+/*
+History of per-interval samples in RAM, so centrals can catch up after
+being out of range. Telegrams are aggregated into a sample per
+HISTORY_INTERVAL minutes, closed by the first telegram of a later interval.
+
+Samples are stored in blocks, each starting with a sample encoded against
+zero, later samples against the previous one. Every field is encoded as
+the zigzag of the difference, as a varint (7 bits per byte, low first,
+high bit set on all but the last byte). Counters and the interval change
+little, so a sample typically takes about 12 bytes. When full, the oldest
+block is dropped.
+
+Samples are also written to the flash log (flashlog.h), a row at a time
+once they fill the rest of a row, each record starting against zero. The
+flash log holds weeks of samples and survives a reset, reading continues
+from the flash log into RAM. Samples not yet in flash are lost on reset.
+
+The same encoding is used for transfer (bulk.h), starting against zero.
+*/
+
+#define HISTORY_INTERVAL    5u          // minutes per sample
+#define HISTORY_BLOCK_SIZE  256u        // bytes
+#define HISTORY_BLOCKS      16u         // power of 2, about a day of samples
+
+// Fields of a sample, in encoding order
+enum history_field_t {
+    HISTORY_FIELD_TIME,                 // start of interval, minutes since 2000 UTC
+    HISTORY_FIELD_E_IN1,                // Wh, last telegram of the interval
+    HISTORY_FIELD_E_IN2,
+    HISTORY_FIELD_E_OUT1,
+    HISTORY_FIELD_E_OUT2,
+    HISTORY_FIELD_P_AVG,                // W, P_in_total - P_out_total (signed)
+    HISTORY_FIELD_P_MIN,
+    HISTORY_FIELD_P_MAX,
+    HISTORY_FIELD_GAS_IN,               // dm3
+    HISTORY_FIELD_COUNT
+};
+#define HISTORY_SAMPLE_MAX  (5u * HISTORY_FIELD_COUNT)  // encoded bytes
+#define HISTORY_NONE        0xFFFFFFFFu // counter not in the telegrams
+#define HISTORY_POWER_NONE  0x80000000u // power not in the telegrams
+
+struct history_sample_t {
+    uint32_t value[HISTORY_FIELD_COUNT];
+};
+
+// Position in the history, stays valid while samples are added. Reading
+// continues at the oldest sample when its block or row was dropped.
+struct history_cursor_t {
+    struct flashlog_cursor_t record;    // while in_flash
+    uint32_t block;                     // free running RAM block number
+    uint16_t offset;                    // in the record or block
+    uint8_t in_flash;
+    uint32_t from;                      // RAM samples before this time are in flash
+    struct history_sample_t previous;
+};
+
+void History_Reset();                   // RAM only, the flash log is kept
+// Aggregate a telegram, ignored without valid timestamp or older than the sample
+void History_Add(const struct dsmr_data_t* data);
+void History_ProcessEvents();           // call from main loop, writes to the flash log
+// Timestamp present and within range, required by History_Minutes
+int History_ValidTime(const struct dsmr_data_t* data);
+// DSMR local time (CET, CEST when dst is summer) to minutes since 2000-01-01
+// UTC, 0 when out of range
+uint32_t History_Minutes(const struct dsmr_timestamp_t* timestamp);
+
+// Cursor at the first stored sample with time at or after from
+void History_Seek(struct history_cursor_t* cursor, uint32_t from);
+// Next sample, 0 at the end of the stored samples
+int History_Next(struct history_cursor_t* cursor, struct history_sample_t* sample);
+uint32_t History_Count();               // samples in RAM
+uint16_t History_Used();                // bytes in use, of HISTORY_BLOCKS * HISTORY_BLOCK_SIZE
+
+// Sample against previous (NULL: zero), HISTORY_SAMPLE_MAX bytes at most.
+// Returns bytes written.
+uint16_t History_Encode(const struct history_sample_t* previous,
+    const struct history_sample_t* sample, uint8_t* buffer);
+// Sample against previous, which is updated. Returns bytes used, 0 when
+// the buffer ends within the sample.
+uint16_t History_Decode(struct history_sample_t* previous, const uint8_t* buffer, uint16_t length);
+
+#endif // HISTORY_H
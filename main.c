@@ -3,10 +3,24 @@
 
 #include <project.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "dsmr.h"
+#include "aggregate.h"
+#include "beacon.h"
+#include "bulk.h"
 #include "common.h"
+#include "config.h"
+#include "demand.h"
+#include "flashlog.h"
+#include "history.h"
 #include "meter.h"
+#include "connparam.h"
+#include "deadband.h"
+#include "eventlog.h"
+#include "notify.h"
+#include "power.h"
+#include "snapshot.h"
 
 void StackEventHandler(uint32 eventCode, void *eventParam);
 
@@ -17,10 +31,21 @@ enum BleIndications {
     BLE_INDICATIONS_POWER_INSTANTANEOUSPOWER = 0x08,
     BLE_INDICATIONS_POWER_INSTANTANEOUSPHASEINFO = 0x10,
     BLE_INDICATIONS_GAS_CONSUMPTION = 0x20,
-    BLE_INDICATIONS_GAS_TIMESTAMP = 0x40
+    BLE_INDICATIONS_GAS_TIMESTAMP = 0x40,
+    BLE_INDICATIONS_POWER_SNAPSHOT = 0x80,
+    BLE_INDICATIONS_POWER_AGGREGATE = 0x100,
+    BLE_INDICATIONS_POWER_DEMAND = 0x200,
+    BLE_INDICATIONS_HISTORY_CONTROL = 0x400,
+    BLE_INDICATIONS_HISTORY_DATA = 0x800
 };
+#define BLE_INDICATIONS_READINGS    0x3FFu  // characteristics of the telegram
+#define BLE_INDICATIONS_HISTORY     (BLE_INDICATIONS_HISTORY_CONTROL | BLE_INDICATIONS_HISTORY_DATA)
 static uint32 bleNotificationsEnabled = 0;
+static uint32 bleStale = 0; // GATT database value older than latest telegram
+static uint16 bleMtu = CYBLE_GATT_DEFAULT_MTU;
 static uint32 blePasscode = 0;
+static uint8 bleBeaconKey[BEACON_KEY_SIZE];
+static uint8 bleScanRspLength = 0;  // configured scan response, the beacon follows
 static uint8 userFactoryReset = 0;
 
 static uint32 CharacteristicToIndicationMask(CYBLE_GATT_DB_ATTR_HANDLE_T characteristic)
@@ -34,6 +59,9 @@ static uint32 CharacteristicToIndicationMask(CYBLE_GATT_DB_ATTR_HANDLE_T charact
     case CYBLE_POWER_METER_INSTANTANEOUS_PHASEINFO_CHAR_HANDLE: return BLE_INDICATIONS_POWER_INSTANTANEOUSPHASEINFO;
     case CYBLE_GAS_METER_CONSUMPTION_CHAR_HANDLE:               return BLE_INDICATIONS_GAS_CONSUMPTION;
     case CYBLE_GAS_METER_TIMESTAMP_CHAR_HANDLE:                 return BLE_INDICATIONS_GAS_TIMESTAMP;
+    case CYBLE_POWER_METER_SNAPSHOT_CHAR_HANDLE:                return BLE_INDICATIONS_POWER_SNAPSHOT;
+    case CYBLE_POWER_METER_AGGREGATE_CHAR_HANDLE:               return BLE_INDICATIONS_POWER_AGGREGATE;
+    case CYBLE_POWER_METER_DEMAND_CHAR_HANDLE:                  return BLE_INDICATIONS_POWER_DEMAND;
     default:                                                    return 0;
     }
 }
@@ -49,6 +77,11 @@ static uint32 CccdToIndicationMask(CYBLE_GATT_DB_ATTR_HANDLE_T characteristic)
     case CYBLE_POWER_METER_INSTANTANEOUS_PHASEINFO_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE: return BLE_INDICATIONS_POWER_INSTANTANEOUSPHASEINFO;
     case CYBLE_GAS_METER_CONSUMPTION_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE:               return BLE_INDICATIONS_GAS_CONSUMPTION;
     case CYBLE_GAS_METER_TIMESTAMP_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE:                 return BLE_INDICATIONS_GAS_TIMESTAMP;
+    case CYBLE_POWER_METER_SNAPSHOT_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE:                return BLE_INDICATIONS_POWER_SNAPSHOT;
+    case CYBLE_POWER_METER_AGGREGATE_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE:               return BLE_INDICATIONS_POWER_AGGREGATE;
+    case CYBLE_POWER_METER_DEMAND_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE:                  return BLE_INDICATIONS_POWER_DEMAND;
+    case CYBLE_POWER_METER_HISTORY_CONTROL_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE:         return BLE_INDICATIONS_HISTORY_CONTROL;
+    case CYBLE_POWER_METER_HISTORY_DATA_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE:            return BLE_INDICATIONS_HISTORY_DATA;
     default:                                                                                        return 0;
     }
 }
@@ -61,9 +94,15 @@ void LowPower(void)
         CyBle_EnterLPM(CYBLE_BLESS_DEEPSLEEP);
     }
 
-    // Always do flash writes and wait for debug UART
-    if (cyBle_pendingFlashWrite != 0
-        || UART_Debug_SpiUartGetTxBufferSize() != 0 || UART_Debug_GET_TX_FIFO_SR_VALID != 0)
+    // Event log output only while awake for the meter, it would keep the
+    // device out of deep sleep otherwise
+    enum METER_POWER_STATE_T appState = Meter_GetPowerState();
+    EventLog_Drain(appState != METER_POWER_STATE_DEEPSLEEP);
+
+    // Always do flash writes. The debug UART keeps sending in sleep (its
+    // interrupt wakes the CPU), it only keeps the device out of deep sleep.
+    uint8 debugBusy = UART_Debug_SpiUartGetTxBufferSize() != 0 || UART_Debug_GET_TX_FIFO_SR_VALID != 0;
+    if (cyBle_pendingFlashWrite != 0)
     {
         return;
     }
@@ -73,25 +112,29 @@ void LowPower(void)
     
     // Check power states
     CYBLE_BLESS_STATE_T blessState = CyBle_GetBleSsState();
-    enum METER_POWER_STATE_T appState = Meter_GetPowerState();
+    appState = Meter_GetPowerState();
     
     if((blessState == CYBLE_BLESS_STATE_ECO_ON || blessState == CYBLE_BLESS_STATE_DEEPSLEEP)
-        && appState == METER_POWER_STATE_DEEPSLEEP)
+        && appState == METER_POWER_STATE_DEEPSLEEP && !debugBusy)
     {
         UART_Debug_Sleep();
+        Power_Sleep(POWER_STATE_DEEPSLEEP);
         CySysPmDeepSleep(); /* System Deep-Sleep. 1.3uA mode */
+        Power_Wake();
         UART_Debug_Wakeup();
     }
     else if (blessState != CYBLE_BLESS_STATE_EVENT_CLOSE)
     {
-        if (appState == METER_POWER_STATE_DEEPSLEEP)
+        if (appState == METER_POWER_STATE_DEEPSLEEP && !debugBusy)
         {
             /* Change HF clock source from IMO to ECO, as IMO can be stopped to save power as application doesn't need it */
             CySysClkWriteHfclkDirect(CY_SYS_CLK_HFCLK_ECO); 
             /* Stop IMO for reducing power consumption */
             CySysClkImoStop(); 
             /* Put the CPU to Sleep. 1.1mA mode */
+            Power_Sleep(POWER_STATE_SLEEP_ECO);
             CySysPmSleep();
+            Power_Wake();
             /* Starts execution after waking up, start IMO */
             CySysClkImoStart();
             /* Change HF clock source back to IMO */
@@ -102,7 +145,9 @@ void LowPower(void)
             /* Divide system clock, lowering core, but not peripheral clocks */
             CySysClkWriteSysclkDiv(CY_SYS_CLK_SYSCLK_DIV4);
             /* Put the CPU to Sleep. 1.1mA mode */
+            Power_Sleep(POWER_STATE_SLEEP);
             CySysPmSleep();
+            Power_Wake();
             /* Change divider to improve performance */
             CySysClkWriteSysclkDiv(CY_SYS_CLK_SYSCLK_DIV1);
         }
@@ -110,68 +155,440 @@ void LowPower(void)
     CyExitCriticalSection(intStatus);
 }
 
-static void BleNotify(CYBLE_GATT_HANDLE_VALUE_PAIR_T* handle)
+// Fields carried by each characteristic
+#define BLE_FIELDS_POWER_CONSUMPTION \
+    (DSMR_FIELD_MASK(DSMR_FIELD_E_IN1) | DSMR_FIELD_MASK(DSMR_FIELD_E_IN2) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_E_OUT1) | DSMR_FIELD_MASK(DSMR_FIELD_E_OUT2))
+#define BLE_FIELDS_POWER_TARIFF             DSMR_FIELD_MASK(DSMR_FIELD_TARIFF)
+#define BLE_FIELDS_POWER_TIMESTAMP          DSMR_FIELD_MASK(DSMR_FIELD_TIMESTAMP)
+#define BLE_FIELDS_POWER_INSTANTANEOUSPOWER \
+    (DSMR_FIELD_MASK(DSMR_FIELD_P_IN_TOTAL) | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT_TOTAL) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_P_THRESHOLD))
+#define BLE_FIELDS_POWER_INSTANTANEOUSPHASEINFO \
+    (DSMR_FIELD_MASK(DSMR_FIELD_I1) | DSMR_FIELD_MASK(DSMR_FIELD_I2) | DSMR_FIELD_MASK(DSMR_FIELD_I3) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_V1) | DSMR_FIELD_MASK(DSMR_FIELD_V2) | DSMR_FIELD_MASK(DSMR_FIELD_V3) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_P_IN1) | DSMR_FIELD_MASK(DSMR_FIELD_P_IN2) | DSMR_FIELD_MASK(DSMR_FIELD_P_IN3) \
+    | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT1) | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT2) | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT3))
+#define BLE_FIELDS_GAS_CONSUMPTION          DSMR_FIELD_MASK(DSMR_FIELD_GAS_IN)
+#define BLE_FIELDS_GAS_TIMESTAMP            DSMR_FIELD_MASK(DSMR_FIELD_GAS_TIMESTAMP)
+#define BLE_FIELDS_POWER_SNAPSHOT           UINT32_MAX
+#define BLE_FIELDS_POWER_AGGREGATE          UINT32_MAX
+#define BLE_FIELDS_POWER_DEMAND             UINT32_MAX
+
+static uint8 bleSnapshot[SNAPSHOT_SIZE];
+static uint8 bleAggregate[AGGREGATE_SIZE_MAX];
+static uint8 bleDemand[DEMAND_SIZE];
+static struct deadband_t bleSent[CONFIG_DEADBANDS];  // last notified, by deadband index
+
+// Set handle and value of characteristic (BleIndications) from telegram data.
+// Values point into data, except for the snapshot, the aggregate of the
+// telegrams of the reading and the quarter hour demand.
+static int BleMaterialize(uint32 indication, const struct dsmr_data_t* data,
+    CYBLE_GATT_HANDLE_VALUE_PAIR_T* handle, uint32* fields)
 {
-    if (bleNotificationsEnabled & CharacteristicToIndicationMask(handle->attrHandle))
+    switch (indication)
     {
-        // TODO retry needed due to exceeded stack buffer?
-        CyBle_GattsNotification(cyBle_connHandle, handle);
-        CyBle_ProcessEvents();
+    case BLE_INDICATIONS_POWER_CONSUMPTION:
+        handle->attrHandle = CYBLE_POWER_METER_CONSUMPTION_CHAR_HANDLE;
+        handle->value.val = (uint8_t*)&(data->E_in[0]);
+        handle->value.len = 4 * 2 * MAX_TARIFFS;
+        *fields = BLE_FIELDS_POWER_CONSUMPTION;
+        break;
+    case BLE_INDICATIONS_POWER_TARIFF:
+        handle->attrHandle = CYBLE_POWER_METER_TARIFF_CHAR_HANDLE;
+        handle->value.val = (uint8_t*)&(data->tariff);
+        handle->value.len = 1;
+        *fields = BLE_FIELDS_POWER_TARIFF;
+        break;
+    case BLE_INDICATIONS_POWER_TIMESTAMP:
+        handle->attrHandle = CYBLE_POWER_METER_TIMESTAMP_CHAR_HANDLE;
+        handle->value.val = (uint8_t*)&(data->timestamp);
+        handle->value.len = 8;
+        *fields = BLE_FIELDS_POWER_TIMESTAMP;
+        break;
+    // Power meter instantanous
+    case BLE_INDICATIONS_POWER_INSTANTANEOUSPOWER:
+        handle->attrHandle = CYBLE_POWER_METER_INSTANTANEOUS_POWER_CHAR_HANDLE;
+        handle->value.val = (uint8_t*)&(data->P_in_total);
+        handle->value.len = 12;
+        *fields = BLE_FIELDS_POWER_INSTANTANEOUSPOWER;
+        break;
+    case BLE_INDICATIONS_POWER_INSTANTANEOUSPHASEINFO:
+        handle->attrHandle = CYBLE_POWER_METER_INSTANTANEOUS_PHASEINFO_CHAR_HANDLE;
+        handle->value.val = (uint8_t*)&(data->I[0]);
+        handle->value.len = 4 * 4 * MAX_PHASES;
+        *fields = BLE_FIELDS_POWER_INSTANTANEOUSPHASEINFO;
+        break;
+    // Gas meter
+    case BLE_INDICATIONS_GAS_CONSUMPTION:
+        handle->attrHandle = CYBLE_GAS_METER_CONSUMPTION_CHAR_HANDLE;
+        handle->value.val = (uint8_t*)&(data->gas_in);
+        handle->value.len = 4;
+        *fields = BLE_FIELDS_GAS_CONSUMPTION;
+        break;
+    case BLE_INDICATIONS_GAS_TIMESTAMP:
+        handle->attrHandle = CYBLE_GAS_METER_TIMESTAMP_CHAR_HANDLE;
+        handle->value.val = (uint8_t*)&(data->gas_timestamp);
+        handle->value.len = 8;
+        *fields = BLE_FIELDS_GAS_TIMESTAMP;
+        break;
+    // All fields
+    case BLE_INDICATIONS_POWER_SNAPSHOT:
+        handle->attrHandle = CYBLE_POWER_METER_SNAPSHOT_CHAR_HANDLE;
+        handle->value.val = bleSnapshot;
+        handle->value.len = Snapshot_Pack(data, bleSnapshot);
+        *fields = BLE_FIELDS_POWER_SNAPSHOT;
+        break;
+    case BLE_INDICATIONS_POWER_AGGREGATE:
+        handle->attrHandle = CYBLE_POWER_METER_AGGREGATE_CHAR_HANDLE;
+        handle->value.val = bleAggregate;
+        handle->value.len = Aggregate_Pack(Meter_GetAggregate(), bleAggregate);
+        *fields = BLE_FIELDS_POWER_AGGREGATE;
+        break;
+    case BLE_INDICATIONS_POWER_DEMAND:
+        handle->attrHandle = CYBLE_POWER_METER_DEMAND_CHAR_HANDLE;
+        handle->value.val = bleDemand;
+        handle->value.len = Demand_Pack(Demand_Get(), bleDemand);
+        *fields = BLE_FIELDS_POWER_DEMAND;
+        break;
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+// Deadband (config_t) index of characteristics of uint32 values, -1 for
+// others, these are notified on every change
+static int BleDeadbandIndex(uint32 indication)
+{
+    switch (indication)
+    {
+    case BLE_INDICATIONS_POWER_CONSUMPTION:             return 0;
+    case BLE_INDICATIONS_POWER_INSTANTANEOUSPOWER:      return 1;
+    case BLE_INDICATIONS_POWER_INSTANTANEOUSPHASEINFO:  return 2;
+    case BLE_INDICATIONS_GAS_CONSUMPTION:               return 3;
+    case BLE_INDICATIONS_POWER_DEMAND:                  return 4;
+    default:                                            return -1;
+    }
+}
+
+// Telegram time, seconds since 2000. 0 without a valid timestamp.
+static uint32 BleTelegramTime(const struct dsmr_data_t* data)
+{
+    if (!History_ValidTime(data))
+        return 0;
+    return History_Minutes(&data->timestamp) * 60u + data->timestamp.second;
+}
+
+// Time for the silence period, seconds. Without a telegram time (DSMR 2.2
+// and 3.0) the LFCLK seconds, which wrap after 36 hours: the value is then
+// sent once, as when the meter clock is set back.
+static uint32 BleSilenceTime(const struct dsmr_data_t* data)
+{
+    uint32 time = BleTelegramTime(data);
+    return time != 0 ? time : CySysWdtGetCount(CY_SYS_WDT_COUNTER2) / 32768u;
+}
+
+// Notification queue callback, always sends latest value
+static int BleFillNotification(uint32 indication, CYBLE_GATT_HANDLE_VALUE_PAIR_T* handle)
+{
+    uint32 fields;
+    const struct dsmr_data_t* data = Meter_GetLatestDsmr();
+    if (data == NULL || !(bleNotificationsEnabled & indication)
+        || !BleMaterialize(indication, data, handle, &fields))
+        return 0;
+    // The snapshot and aggregate are only notified when they fit in the ATT
+    // MTU, otherwise clients can still read them (using read blob).
+    if (handle->value.len > bleMtu - 3)
+        return 0;
+    int index = BleDeadbandIndex(indication);
+    if (index >= 0)
+        Deadband_Sent(&bleSent[index], handle->value.val, handle->value.len, BleSilenceTime(data));
+    return 1;
+}
+
+// Characteristic with a deadband or silence period configured: 1 if the
+// value moved enough since the last notification, or it was silent too long
+static int BleDeadbandExceeded(uint32 indication, const CYBLE_GATT_VALUE_T* value, const struct dsmr_data_t* data)
+{
+    const struct config_t* config = Config_Get();
+    int index = BleDeadbandIndex(indication);
+    return Deadband_Exceeded(&bleSent[index], value->val, value->len, BleSilenceTime(data),
+        config->deadband[index], config->silence[index]);
+}
+
+static int BleHasDeadband(uint32 indication)
+{
+    const struct config_t* config = Config_Get();
+    int index = BleDeadbandIndex(indication);
+    return index >= 0 && (config->deadband[index] != 0 || config->silence[index] != 0);
+}
+
+// Next value of the characteristics is notified regardless of the deadband
+static void BleResetDeadbands(uint32 indications)
+{
+    for (uint32 indication = 1; indication <= BLE_INDICATIONS_POWER_DEMAND; indication <<= 1)
+    {
+        int index = BleDeadbandIndex(indication);
+        if (index >= 0 && (indications & indication))
+            Deadband_Reset(&bleSent[index]);
     }
 }
 
-void Meter_ReceivedHandler(struct dsmr_data_t* data)
+// Write value of characteristic in GATT database from latest telegram
+static void BleWriteAttribute(uint32 indication, const struct dsmr_data_t* data)
 {
     CYBLE_GATT_HANDLE_VALUE_PAIR_T handle;
-    CyBle_ExitLPM();
+    uint32 fields;
+    if (data != NULL && BleMaterialize(indication, data, &handle, &fields))
+    {
+        CyBle_GattsWriteAttributeValue(&handle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
+    }
+    bleStale &= ~indication;
+}
 
-    // Power meter
-    
-    handle.attrHandle = CYBLE_POWER_METER_CONSUMPTION_CHAR_HANDLE;
-    handle.value.val = (uint8_t*)&(data->E_in[0]);
-    handle.value.len = 4 * 2 * MAX_TARIFFS;
-    CyBle_GattsWriteAttributeValue(&handle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
-    BleNotify(&handle);
+// Readings follow the interval while a central is subscribed to readings
+// or the beacon is on, otherwise the (longer) idle interval
+static void BleUpdateInterval()
+{
+    const struct config_t* config = Config_Get();
+    Meter_SetInterval(((bleNotificationsEnabled & BLE_INDICATIONS_READINGS) || config->beacon)
+        ? config->interval : config->interval_idle);
+    Meter_SetBurst(config->burst);
+}
 
-    handle.attrHandle = CYBLE_POWER_METER_TARIFF_CHAR_HANDLE;
-    handle.value.val = (uint8_t*)&(data->tariff);
-    handle.value.len = 1;
-    CyBle_GattsWriteAttributeValue(&handle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
-    BleNotify(&handle);
-    
-    handle.attrHandle = CYBLE_POWER_METER_TIMESTAMP_CHAR_HANDLE;
-    handle.value.val = (uint8_t*)&(data->timestamp);
-    handle.value.len = 8;
+// Interval characteristic: interval, idle interval (writable), the minimum
+// interval within the energy budget (read-only) and the burst (writable),
+// in seconds
+static void BleWriteIntervalAttribute()
+{
+    const struct config_t* config = Config_Get();
+    uint16 minimum = Meter_GetMinInterval();
+    uint8 value[8] = {
+        LO8(config->interval), HI8(config->interval),
+        LO8(config->interval_idle), HI8(config->interval_idle),
+        LO8(minimum), HI8(minimum),
+        LO8(config->burst), HI8(config->burst)
+    };
+    CYBLE_GATT_HANDLE_VALUE_PAIR_T handle;
+    handle.attrHandle = CYBLE_POWER_METER_INTERVAL_CHAR_HANDLE;
+    handle.value.val = value;
+    handle.value.len = sizeof(value);
     CyBle_GattsWriteAttributeValue(&handle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
-    BleNotify(&handle);
-    
-    // Power meter instantanous
-    
-    handle.attrHandle = CYBLE_POWER_METER_INSTANTANEOUS_POWER_CHAR_HANDLE;
-    handle.value.val = (uint8_t*)&(data->P_in_total);
-    handle.value.len = 12;
+}
+
+// Deadband characteristic: deadband (uint32, units of the characteristic)
+// and silence (uint16, s) by deadband index
+static void BleWriteDeadbandAttribute()
+{
+    const struct config_t* config = Config_Get();
+    uint8 value[6 * CONFIG_DEADBANDS];
+    uint8* p = value;
+    for (uint32 i = 0; i < CONFIG_DEADBANDS; ++i)
+    {
+        for (uint32 b = 0; b < 4; ++b)
+            *p++ = (uint8)(config->deadband[i] >> (8 * b));
+        *p++ = LO8(config->silence[i]);
+        *p++ = HI8(config->silence[i]);
+    }
+    CYBLE_GATT_HANDLE_VALUE_PAIR_T handle;
+    handle.attrHandle = CYBLE_POWER_METER_DEADBAND_CHAR_HANDLE;
+    handle.value.val = value;
+    handle.value.len = sizeof(value);
     CyBle_GattsWriteAttributeValue(&handle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
-    BleNotify(&handle);
+}
 
-    handle.attrHandle = CYBLE_POWER_METER_INSTANTANEOUS_PHASEINFO_CHAR_HANDLE;
-    handle.value.val = (uint8_t*)&(data->I[0]);
-    handle.value.len = 4 * 4 * MAX_PHASES;
+// Diagnostics characteristic: residency counters (power_stats_t), in
+// LFCLK ticks since start
+static void BleWriteDiagnosticsAttribute()
+{
+    const struct power_stats_t* stats = Power_GetStats();
+    uint8 value[8 * (POWER_STATE_COUNT + POWER_LOAD_COUNT) + 4 * POWER_WAKEUP_COUNT + 1];
+    uint8* p = value;
+    for (uint32 i = 0; i < POWER_STATE_COUNT + POWER_LOAD_COUNT; ++i)
+    {
+        uint64 ticks = i < POWER_STATE_COUNT ? stats->state_ticks[i] : stats->load_ticks[i - POWER_STATE_COUNT];
+        for (uint32 b = 0; b < 8; ++b)
+            *p++ = (uint8)(ticks >> (8 * b));
+    }
+    for (uint32 i = 0; i < POWER_WAKEUP_COUNT; ++i)
+    {
+        for (uint32 b = 0; b < 4; ++b)
+            *p++ = (uint8)(stats->wakeups[i] >> (8 * b));
+    }
+    *p++ = stats->last_wakeup;
+    CYBLE_GATT_HANDLE_VALUE_PAIR_T handle;
+    handle.attrHandle = CYBLE_POWER_METER_DIAGNOSTICS_CHAR_HANDLE;
+    handle.value.val = value;
+    handle.value.len = sizeof(value);
     CyBle_GattsWriteAttributeValue(&handle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
-    BleNotify(&handle);
-    
-    // Gas meter
-    
-    handle.attrHandle = CYBLE_GAS_METER_CONSUMPTION_CHAR_HANDLE;
-    handle.value.val = (uint8_t*)&(data->gas_in);
-    handle.value.len = 4;
+}
+
+// Event log characteristic: sequence and the oldest entries that fit the
+// read response, kept until acknowledged (retried and blob reads)
+static void BleWriteEventLogAttribute()
+{
+    uint8 value[CYBLE_GATT_MTU - 1];
+    CYBLE_GATT_HANDLE_VALUE_PAIR_T handle;
+    handle.attrHandle = CYBLE_POWER_METER_EVENT_LOG_CHAR_HANDLE;
+    handle.value.val = value;
+    handle.value.len = EventLog_Read(value, bleMtu - 1);
     CyBle_GattsWriteAttributeValue(&handle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
-    BleNotify(&handle);
+}
 
-    handle.attrHandle = CYBLE_GAS_METER_TIMESTAMP_CHAR_HANDLE;
-    handle.value.val = (uint8_t*)&(data->gas_timestamp);
-    handle.value.len = 8;
+// Intervals only, or as read with the burst (minimum ignored)
+static CYBLE_GATT_ERR_CODE_T BleWriteInterval(const CYBLE_GATT_VALUE_T* value)
+{
+    if (value->len != 4 && value->len != 8)
+        return CYBLE_GATT_ERR_INVALID_ATTRIBUTE_LEN;
+    uint16 interval = (uint16)(value->val[0] | (value->val[1] << 8));
+    uint16 interval_idle = (uint16)(value->val[2] | (value->val[3] << 8));
+    uint16 burst = value->len == 8 ? (uint16)(value->val[6] | (value->val[7] << 8)) : Config_Get()->burst;
+    if (burst > CONFIG_BURST_MAX || !Config_SetInterval(interval, interval_idle))
+        return CYBLE_GATT_ERR_OUT_OF_RANGE;
+    Config_SetBurst(burst);
+    BleUpdateInterval();
+    BleWriteIntervalAttribute();
+    return CYBLE_GATT_ERR_NONE;
+}
+
+// Beacon (beacon.h) after the configured scan response, refreshed with each
+// telegram while advertising. Without data or a valid telegram time, or
+// turned off, only the configured scan response. The advertising data is
+// only updated when it changed, that wakes the BLE subsystem.
+static void BleUpdateBeacon(const struct dsmr_data_t* data)
+{
+    CYBLE_GAPP_SCAN_RSP_DATA_T* scanRsp = cyBle_discoveryModeInfo.scanRspData;
+    uint32 sequence = data != NULL ? BleTelegramTime(data) : 0;
+    uint8 beacon[BEACON_AD_SIZE];
+    uint8 length = 0;
+    if (Config_Get()->beacon && sequence != 0
+        && (uint32)bleScanRspLength + BEACON_AD_SIZE <= CYBLE_GAP_MAX_SCAN_RSP_DATA_LEN)
+    {
+        int32 power = INT32_MIN;
+        if (data->present & DSMR_FIELD_MASK(DSMR_FIELD_P_IN_TOTAL))
+        {
+            power = (int32)data->P_in_total;
+            if (data->present & DSMR_FIELD_MASK(DSMR_FIELD_P_OUT_TOTAL))
+                power -= (int32)data->P_out_total;
+        }
+        uint8 tariff = (data->present & DSMR_FIELD_MASK(DSMR_FIELD_TARIFF)) ? (uint8)data->tariff : 0;
+        length = (uint8)Beacon_Pack(bleBeaconKey, sequence, power, tariff, beacon);
+    }
+    if (scanRsp->scanRspDataLen == bleScanRspLength + length
+        && memcmp(scanRsp->scanRspData + bleScanRspLength, beacon, length) == 0)
+        return;
+    memcpy(scanRsp->scanRspData + bleScanRspLength, beacon, length);
+    scanRsp->scanRspDataLen = bleScanRspLength + length;
+    if (CyBle_GetState() == CYBLE_STATE_ADVERTISING)
+    {
+        CyBle_ExitLPM();
+        CyBle_GapUpdateAdvData(cyBle_discoveryModeInfo.advData, scanRsp);
+    }
+}
+
+static void BleWriteBeaconAttribute()
+{
+    uint8 value = Config_Get()->beacon;
+    CYBLE_GATT_HANDLE_VALUE_PAIR_T handle;
+    handle.attrHandle = CYBLE_POWER_METER_BEACON_CHAR_HANDLE;
+    handle.value.val = &value;
+    handle.value.len = 1;
     CyBle_GattsWriteAttributeValue(&handle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
-    BleNotify(&handle);
+}
+
+// Acknowledged event log entries: sequence after the last entry received
+static CYBLE_GATT_ERR_CODE_T BleWriteEventLog(const CYBLE_GATT_VALUE_T* value)
+{
+    if (value->len != 2)
+        return CYBLE_GATT_ERR_INVALID_ATTRIBUTE_LEN;
+    EventLog_Acknowledge((uint16)(value->val[0] | (value->val[1] << 8)));
+    return CYBLE_GATT_ERR_NONE;
+}
+
+// Beacon on (1) or off (0)
+static CYBLE_GATT_ERR_CODE_T BleWriteBeacon(const CYBLE_GATT_VALUE_T* value)
+{
+    if (value->len != 1)
+        return CYBLE_GATT_ERR_INVALID_ATTRIBUTE_LEN;
+    if (!Config_SetBeacon(value->val[0]))
+        return CYBLE_GATT_ERR_OUT_OF_RANGE;
+    BleUpdateInterval();
+    BleUpdateBeacon(Meter_GetLatestDsmr());
+    BleWriteBeaconAttribute();
+    return CYBLE_GATT_ERR_NONE;
+}
+
+// Deadband of one characteristic: index, deadband, silence
+static CYBLE_GATT_ERR_CODE_T BleWriteDeadband(const CYBLE_GATT_VALUE_T* value)
+{
+    if (value->len != 7)
+        return CYBLE_GATT_ERR_INVALID_ATTRIBUTE_LEN;
+    uint32 deadband = (uint32)value->val[1] | ((uint32)value->val[2] << 8)
+        | ((uint32)value->val[3] << 16) | ((uint32)value->val[4] << 24);
+    uint16 silence = (uint16)(value->val[5] | (value->val[6] << 8));
+    if (!Config_SetDeadband(value->val[0], deadband, silence))
+        return CYBLE_GATT_ERR_OUT_OF_RANGE;
+    BleWriteDeadbandAttribute();
+    return CYBLE_GATT_ERR_NONE;
+}
+
+void Meter_ReceivedHandler(const struct dsmr_data_t* data)
+{
+    History_Add(data);
+    Demand_Add(data);
+    BleUpdateBeacon(data);
+
+    // Only characteristics with notifications enabled are written and
+    // notified now. Others are written when read (see
+    // CYBLE_EVT_GATTS_READ_CHAR_VAL_ACCESS_REQ), so without subscribers
+    // there is no GATT work at all. Subscribed characteristics with a
+    // deadband are compared with the value last notified instead.
+    for (uint32 indication = 1; indication <= BLE_INDICATIONS_POWER_DEMAND; indication <<= 1)
+    {
+        CYBLE_GATT_HANDLE_VALUE_PAIR_T handle;
+        uint32 fields;
+        if (!BleMaterialize(indication, data, &handle, &fields))
+            continue;
+        if ((bleNotificationsEnabled & indication) && BleHasDeadband(indication))
+        {
+            if (BleDeadbandExceeded(indication, &handle.value, data))
+            {
+                CyBle_ExitLPM();
+                BleWriteAttribute(indication, data);
+                Notify_Queue(indication);
+            }
+            else
+            {
+                bleStale |= indication;
+            }
+            continue;
+        }
+        if ((data->changed & fields) == 0)
+            continue;
+        if (bleNotificationsEnabled & indication)
+        {
+            CyBle_ExitLPM();
+            BleWriteAttribute(indication, data);
+            Notify_Queue(indication);
+        }
+        else
+        {
+            bleStale |= indication;
+        }
+    }
+}
+
+// A row write may take the CPU away from a connection event. With the
+// write shorter than half the time between events the peripheral listens
+// to, at most one is missed, and the supervision timeout exceeds twice that
+// time (Core Vol 6 Part B 4.5.2).
+static uint8 BleFlashWritable()
+{
+    if (CyBle_GetState() != CYBLE_STATE_CONNECTED)
+        return 1;
+    uint32 listen_us = (1u + ConnParam_GetLatency()) * ConnParam_GetInterval() * 1250u;
+    return listen_us >= 2u * 1000u * FLASHLOG_WRITE_MS;
 }
 
 void Ble_StoreState()
@@ -181,7 +598,7 @@ void Ble_StoreState()
         if (Meter_GetPowerState() == METER_POWER_STATE_DEEPSLEEP)
         {
             CYBLE_API_RESULT_T res = CyBle_StoreBondingData(0);
-            printf("Save %d\n", res);
+            EventLog_Add(EVENTLOG_BOND_SAVE, res);
         }
     }
 }
@@ -253,6 +670,7 @@ static void PerformFactoryReset()
     {
         CyBle_GapRemoveBondedDevice(list.bdAddrList + (--list.count));
     }
+    Config_Reset();
     
     userFactoryReset = 0;
 }
@@ -288,6 +706,11 @@ int main(void)
 
     UART_Debug_Start();
     UART_Debug_UartPutString("SmartMeter BLE by Joris Dobbelsteen\r\n");
+    Power_Start();
+    EventLog_Add(EVENTLOG_START, 0);
+    FlashLog_Start();
+    Config_Start();
+    Demand_Start();
 
     CyBle_Start(StackEventHandler);
     
@@ -305,8 +728,11 @@ int main(void)
         CyBle_ProcessEvents();
     }
     
+    Notify_Start(BleFillNotification);
     Meter_SetReceivedDsmrHandler(Meter_ReceivedHandler);
     Meter_Start();
+    BleUpdateInterval();
+    BleWriteIntervalAttribute();
     
     PrintOwnAddress();
     PrintDevices();
@@ -315,7 +741,19 @@ int main(void)
     {
         CyBle_ProcessEvents();
         Meter_ProcessEvents();
+        Notify_ProcessEvents();
+        Bulk_ProcessEvents(bleMtu);
+        // Shorten connection interval while notifications are backlogged
+        // or history is downloaded
+        ConnParam_SetFast(CONNPARAM_FAST_NOTIFY, Notify_GetPending() != 0);
+        ConnParam_SetFast(CONNPARAM_FAST_BULK, Bulk_Active());
+        ConnParam_ProcessEvents();
         Ble_StoreState();
+        Config_Store();
+        Demand_ProcessEvents();
+        History_ProcessEvents();
+        FlashLog_ProcessEvents(Meter_GetPowerState() == METER_POWER_STATE_DEEPSLEEP, BleFlashWritable());
+        Power_ProcessEvents();
         LowPower();
     }
 }
@@ -324,7 +762,6 @@ int main(void)
 
 void StackEventHandler(uint32 eventCode, void *eventParam)
 {
-    printf("BLE %lu\n", eventCode);
     (void)eventParam;
     switch(eventCode)
     {
@@ -335,6 +772,7 @@ void StackEventHandler(uint32 eventCode, void *eventParam)
 
         case CYBLE_EVT_STACK_ON:
         {
+            EventLog_Add(EVENTLOG_BLE_STACK_ON, 0);
             CYBLE_BLESS_CLK_CFG_PARAMS_T clockConfig;
             CyBle_GetBleClockCfgParam(&clockConfig);
             clockConfig.bleLlSca = CYBLE_LL_SCA_000_TO_020_PPM; // lowest power, using Cypress development boards
@@ -342,6 +780,10 @@ void StackEventHandler(uint32 eventCode, void *eventParam)
             PerformFactoryReset();                              // do factory reset is required
             blePasscode = Ble_ComputePasscode();
             CyBle_GapFixAuthPassKey(1, blePasscode);
+            CYBLE_GAP_BD_ADDR_T addr;
+            CyBle_GetDeviceAddress(&addr);
+            Beacon_Key(bleBeaconKey, blePasscode, addr.bdAddr);   // scan response MAC
+            bleScanRspLength = cyBle_discoveryModeInfo.scanRspData->scanRspDataLen;
             LED_Advertising_Write(LED_OFF);                     // turn led off when BLE is running
             LED_Disconnect_Write(LED_ON);                       // turn disconnect led on when BLE just reset
             CyBle_GappStartAdvertisement( CYBLE_ADVERTISING_FAST );
@@ -349,117 +791,177 @@ void StackEventHandler(uint32 eventCode, void *eventParam)
         break;
 
         case CYBLE_EVT_TIMEOUT:
-            printf("TIMEOUT\n");
+            EventLog_Add(EVENTLOG_BLE_TIMEOUT, 0);
         break;
 
         case CYBLE_EVT_HARDWARE_ERROR:
-            printf("HARDWARE_ERROR\n");
+            EventLog_Add(EVENTLOG_BLE_HARDWARE_ERROR, 0);
         break;
 
         case CYBLE_EVT_HCI_STATUS:
-            printf("HCI_STATUS\n");
+            EventLog_Add(EVENTLOG_BLE_HCI_STATUS, 0);
         break;
 
         case CYBLE_EVT_STACK_BUSY_STATUS:
-            printf("STACK_BUSY_STATUS\n");
+            // Pending notifications are sent from the main loop when free
+            EventLog_Add(EVENTLOG_BLE_STACK_BUSY, *(uint8*)eventParam);
         break;
 
         case CYBLE_EVT_PENDING_FLASH_WRITE:
             // Flash write already in variable cyBle_pendingFlashWrite
-            printf("PENDING_FLASH_WRITE\n");
+            EventLog_Add(EVENTLOG_BLE_PENDING_FLASH_WRITE, 0);
         break;
 
 
         /* GAP events */
 
         case CYBLE_EVT_GAP_AUTH_REQ:
-            printf("GAP_AUTH_REQ\n");
+            EventLog_Add(EVENTLOG_BLE_AUTH_REQ, 0);
         break;
 
         case CYBLE_EVT_GAP_PASSKEY_ENTRY_REQUEST:
-            printf("GAP_PASSKEY_ENTRY_REQUEST\n");
+            EventLog_Add(EVENTLOG_BLE_PASSKEY_ENTRY_REQUEST, 0);
         break;
 
         case CYBLE_EVT_GAP_PASSKEY_DISPLAY_REQUEST:
-            printf("GAP_PASSKEY_DISPLAY_REQUEST\n");
+            EventLog_Add(EVENTLOG_BLE_PASSKEY_DISPLAY_REQUEST, 0);
         break;
 
         case CYBLE_EVT_GAP_AUTH_COMPLETE:
-            printf("GAP_AUTH_COMPLETE\n");
+            EventLog_Add(EVENTLOG_BLE_AUTH_COMPLETE, 0);
+            ConnParam_Secured();
         break;
 
         case CYBLE_EVT_GAP_AUTH_FAILED:
-            printf("GAP_AUTH_FAILED\n");
+            EventLog_Add(EVENTLOG_BLE_AUTH_FAILED, 0);
             CyBle_GapDisconnect(cyBle_connHandle.bdHandle);
         break;
 
         case CYBLE_EVT_GAP_DEVICE_CONNECTED:
             // See CYBLE_EVT_GAP_ENHANCE_CONN_COMPLETE when link-layer privacy is enabled
-            printf("GAP_DEVICE_CONNECTED\n");
+        {
+            const CYBLE_GAP_CONN_PARAM_UPDATED_IN_CONTROLLER_T* param = (CYBLE_GAP_CONN_PARAM_UPDATED_IN_CONTROLLER_T*)eventParam;
+            EventLog_Add(EVENTLOG_BLE_CONNECTED, 0);
             CyBle_GapAuthReq(cyBle_connHandle.bdHandle, &cyBle_authInfo);
+            ConnParam_Connected(param->connIntv, param->connLatency);
             LED_Disconnect_Write(LED_OFF);
+        }
         break;
 
         case CYBLE_EVT_GAP_DEVICE_DISCONNECTED:
-            printf("GAP_DEVICE_DISCONNECTED\n");
+            EventLog_Add(EVENTLOG_BLE_DISCONNECTED, 0);
             LED_Disconnect_Write(LED_ON);
             bleNotificationsEnabled = 0;
+            Notify_Cancel(UINT32_MAX);
+            Bulk_Cancel();
+            bleMtu = CYBLE_GATT_DEFAULT_MTU;
+            ConnParam_Disconnected();
+            BleUpdateInterval();
             CyBle_GappStartAdvertisement(CYBLE_ADVERTISING_FAST);
         break;
 
         case CYBLE_EVT_GAP_ENCRYPT_CHANGE:
-            printf("GAP_ENCRYPT_CHANGE\n");
+            EventLog_Add(EVENTLOG_BLE_ENCRYPT_CHANGE, *(uint8*)eventParam);
+            // Reconnect with an existing bond does not repeat authentication
+            if (*(uint8*)eventParam)
+                ConnParam_Secured();
         break;
 
         case CYBLE_EVT_GAP_CONNECTION_UPDATE_COMPLETE:
-            printf("GAP_CONNECTION_UPDATE_COMPLETE\n");
+            EventLog_Add(EVENTLOG_BLE_CONNECTION_UPDATE, 0);
+            ConnParam_Updated((CYBLE_GAP_CONN_PARAM_UPDATED_IN_CONTROLLER_T*)eventParam);
         break;
 
         case CYBLE_EVT_GAP_KEYINFO_EXCHNGE_CMPLT:
-            printf("GAP_KEYINFO_EXCHNGE_CMPLT\n");
+            EventLog_Add(EVENTLOG_BLE_KEYINFO_EXCHANGE, 0);
         break;
 
         case CYBLE_EVT_GAP_DATA_LENGTH_CHANGE:
-            printf("GAP_DATA_LENGTH_CHANGE\n");
+            EventLog_Add(EVENTLOG_BLE_DATA_LENGTH_CHANGE, 0);
         break;
             
         case CYBLE_EVT_GAP_ENHANCE_CONN_COMPLETE:
-            printf("GAP_ENHANCE_CONN_COMPLETE\n");
+        {
+            const CYBLE_GAP_ENHANCE_CONN_COMPLETE_T* param = (CYBLE_GAP_ENHANCE_CONN_COMPLETE_T*)eventParam;
+            EventLog_Add(EVENTLOG_BLE_ENHANCE_CONN_COMPLETE, 0);
             CyBle_GapAuthReq(cyBle_connHandle.bdHandle, &cyBle_authInfo);
+            ConnParam_Connected(param->connIntv, param->connLatency);
             LED_Disconnect_Write(LED_OFF);
+        }
         break;
             
         case CYBLE_EVT_GAP_SMP_NEGOTIATED_AUTH_INFO:
-            printf("GAP_SMP_NEGOTIATED_AUTH_INFO\n");
+            EventLog_Add(EVENTLOG_BLE_NEGOTIATED_AUTH_INFO, 0);
         break;
             
         /* GAP Peripheral events */
 
         case CYBLE_EVT_GAPP_ADVERTISEMENT_START_STOP:
-            printf("GAPP_ADVERTISEMENT_START_STOP\n");
+            EventLog_Add(EVENTLOG_BLE_ADVERTISEMENT_START_STOP, 0);
+            // Advertising timed out, the beacon continues slowly
+            if (CyBle_GetState() == CYBLE_STATE_DISCONNECTED && Config_Get()->beacon)
+                CyBle_GappStartAdvertisement(CYBLE_ADVERTISING_SLOW);
         break;
 
         /* GATT events */
 
         case CYBLE_EVT_GATT_CONNECT_IND:
-            printf("GATT_CONNECT_IND\n");
+            EventLog_Add(EVENTLOG_BLE_GATT_CONNECT, 0);
         break;
 
         case CYBLE_EVT_GATT_DISCONNECT_IND:
-            printf("GATT_DISCONNECT_IND\n");
+            EventLog_Add(EVENTLOG_BLE_GATT_DISCONNECT, 0);
         break;
 
             
         /* GATT Server events (CYBLE_EVENT_T) */
 
         case CYBLE_EVT_GATTS_XCNHG_MTU_REQ:
-            printf("GATTS_XCNHG_MTU_REQ\n");
+        {
+            // Response is sent by the BLE component with CYBLE_GATT_MTU, the
+            // negotiated MTU is the minimum of both
+            CYBLE_GATT_XCHG_MTU_PARAM_T* mtuReq = (CYBLE_GATT_XCHG_MTU_PARAM_T*)eventParam;
+            bleMtu = (mtuReq->mtu < CYBLE_GATT_MTU) ? mtuReq->mtu : CYBLE_GATT_MTU;
+            EventLog_Add(EVENTLOG_BLE_MTU, bleMtu);
+            if (bleMtu > CYBLE_GATT_DEFAULT_MTU)
+            {
+                // Fit the ATT packet (plus L2CAP header) in a single link layer packet
+                uint16 octets = bleMtu + 4;
+                CyBle_GapSetDataLength(cyBle_connHandle.bdHandle, octets, (octets + 14) * 8);
+            }
+        }
         break;
 
         case CYBLE_EVT_GATTS_READ_CHAR_VAL_ACCESS_REQ:
         {
+            // Called before the value is read from the GATT database
             CYBLE_GATTS_CHAR_VAL_READ_REQ_T* rdReq = (CYBLE_GATTS_CHAR_VAL_READ_REQ_T*)eventParam;
-            printf("READ_CHAR_VAL_ACCESS_REQ 0x%x\n", rdReq->attrHandle);
+            EventLog_Add(EVENTLOG_BLE_READ, rdReq->attrHandle);
+            uint32 indication = CharacteristicToIndicationMask(rdReq->attrHandle);
+            if (bleStale & indication)
+            {
+                BleWriteAttribute(indication, Meter_GetLatestDsmr());
+            }
+            else if (rdReq->attrHandle == CYBLE_POWER_METER_INTERVAL_CHAR_HANDLE)
+            {
+                BleWriteIntervalAttribute(); // minimum depends on receive state
+            }
+            else if (rdReq->attrHandle == CYBLE_POWER_METER_BEACON_CHAR_HANDLE)
+            {
+                BleWriteBeaconAttribute();
+            }
+            else if (rdReq->attrHandle == CYBLE_POWER_METER_DEADBAND_CHAR_HANDLE)
+            {
+                BleWriteDeadbandAttribute();
+            }
+            else if (rdReq->attrHandle == CYBLE_POWER_METER_DIAGNOSTICS_CHAR_HANDLE)
+            {
+                BleWriteDiagnosticsAttribute();
+            }
+            else if (rdReq->attrHandle == CYBLE_POWER_METER_EVENT_LOG_CHAR_HANDLE)
+            {
+                BleWriteEventLogAttribute();
+            }
         }
         break;    
             
@@ -467,14 +969,23 @@ void StackEventHandler(uint32 eventCode, void *eventParam)
         case CYBLE_EVT_GATTS_WRITE_CMD_REQ:
         {
             CYBLE_GATTS_WRITE_REQ_PARAM_T* wrReqParam = (CYBLE_GATTS_WRITE_REQ_PARAM_T*)eventParam;
-            printf("GATTS_WRITE_(CMD)_REQ %hu\n", wrReqParam->handleValPair.attrHandle);
+            EventLog_Add(EVENTLOG_BLE_WRITE, wrReqParam->handleValPair.attrHandle);
+            CYBLE_GATT_ERR_CODE_T err = CYBLE_GATT_ERR_NONE;
             uint32 eventMask = CccdToIndicationMask(wrReqParam->handleValPair.attrHandle);
             if (eventMask) // Indication enable / disable
             {
                 if (wrReqParam->handleValPair.value.val[0])
+                {
                     bleNotificationsEnabled |= eventMask;  // enable
+                    BleResetDeadbands(eventMask);
+                }
                 else
-                    bleNotificationsEnabled &= !eventMask; // disable
+                {
+                    bleNotificationsEnabled &= ~eventMask; // disable
+                    Notify_Cancel(eventMask);
+                    if (eventMask & BLE_INDICATIONS_HISTORY)
+                        Bulk_Cancel();
+                }
                 
 				uint8 CCDValue[2] = {wrReqParam->handleValPair.value.val[0], 0};
                 CYBLE_GATT_HANDLE_VALUE_PAIR_T  NotificationCCDHandle;
@@ -482,32 +993,60 @@ void StackEventHandler(uint32 eventCode, void *eventParam)
                 NotificationCCDHandle.value.val = CCDValue;
                 NotificationCCDHandle.value.len = 2;
                 CyBle_GattsWriteAttributeValue(&NotificationCCDHandle, 0, &cyBle_connHandle, CYBLE_GATT_DB_LOCALLY_INITIATED);
+                BleUpdateInterval();
+            }
+            else if (wrReqParam->handleValPair.attrHandle == CYBLE_POWER_METER_INTERVAL_CHAR_HANDLE)
+            {
+                err = BleWriteInterval(&wrReqParam->handleValPair.value);
+            }
+            else if (wrReqParam->handleValPair.attrHandle == CYBLE_POWER_METER_BEACON_CHAR_HANDLE)
+            {
+                err = BleWriteBeacon(&wrReqParam->handleValPair.value);
+            }
+            else if (wrReqParam->handleValPair.attrHandle == CYBLE_POWER_METER_DEADBAND_CHAR_HANDLE)
+            {
+                err = BleWriteDeadband(&wrReqParam->handleValPair.value);
+            }
+            else if (wrReqParam->handleValPair.attrHandle == CYBLE_POWER_METER_EVENT_LOG_CHAR_HANDLE)
+            {
+                err = BleWriteEventLog(&wrReqParam->handleValPair.value);
+            }
+            else if (wrReqParam->handleValPair.attrHandle == CYBLE_POWER_METER_HISTORY_CONTROL_CHAR_HANDLE)
+            {
+                err = Bulk_Control(&wrReqParam->handleValPair.value,
+                    (bleNotificationsEnabled & BLE_INDICATIONS_HISTORY) == BLE_INDICATIONS_HISTORY);
             }
             
             if (eventCode == CYBLE_EVT_GATTS_WRITE_REQ)
             {
-                CyBle_GattsWriteRsp(cyBle_connHandle);
+                if (err == CYBLE_GATT_ERR_NONE)
+                    CyBle_GattsWriteRsp(cyBle_connHandle);
+                else
+                {
+                    CYBLE_GATTS_ERR_PARAM_T errParam;
+                    errParam.opcode = CYBLE_GATT_WRITE_REQ;
+                    errParam.attrHandle = wrReqParam->handleValPair.attrHandle;
+                    errParam.errorCode = err;
+                    CyBle_GattsErrorRsp(cyBle_connHandle, &errParam);
+                }
             }
         }
         break;
 
-            printf("GATTS_WRITE_CMD_REQ\n");
-        break;
-
         case CYBLE_EVT_GATTS_PREP_WRITE_REQ:
-            printf("GATTS_PREP_WRITE_REQ\n");
+            EventLog_Add(EVENTLOG_BLE_PREP_WRITE, 0);
         break;
 
         case CYBLE_EVT_GATTS_EXEC_WRITE_REQ:
-            printf("GATTS_EXEC_WRITE_REQ\n");
+            EventLog_Add(EVENTLOG_BLE_EXEC_WRITE, 0);
         break;
 
         case CYBLE_EVT_GATTS_HANDLE_VALUE_CNF:
-            printf("GATTS_HANDLE_VALUE_CNF\n");
+            EventLog_Add(EVENTLOG_BLE_HANDLE_VALUE_CNF, 0);
         break;
 
         case CYBLE_EVT_GATTS_DATA_SIGNED_CMD_REQ:
-            printf("GATTS_DATA_SIGNED_CMD_REQ\n");
+            EventLog_Add(EVENTLOG_BLE_SIGNED_WRITE, 0);
         break;
 
 
@@ -516,14 +1055,14 @@ void StackEventHandler(uint32 eventCode, void *eventParam)
         case CYBLE_EVT_GATTS_INDICATION_ENABLED:
         {
             CYBLE_GATTS_WRITE_REQ_PARAM_T* write_req_param = (CYBLE_GATTS_WRITE_REQ_PARAM_T*)eventParam;
-            printf("GATTS_INDICATION_ENABLED %d\n", write_req_param->handleValPair.attrHandle);
+            EventLog_Add(EVENTLOG_BLE_INDICATION_ENABLED, write_req_param->handleValPair.attrHandle);
         }
         break;
 
         case CYBLE_EVT_GATTS_INDICATION_DISABLED:
         {
             CYBLE_GATTS_WRITE_REQ_PARAM_T* write_req_param = (CYBLE_GATTS_WRITE_REQ_PARAM_T*)eventParam;
-            printf("GATTS_INDICATION_DISABLED %d\n", write_req_param->handleValPair.attrHandle);
+            EventLog_Add(EVENTLOG_BLE_INDICATION_DISABLED, write_req_param->handleValPair.attrHandle);
         }
         break;
 
@@ -534,6 +1073,7 @@ void StackEventHandler(uint32 eventCode, void *eventParam)
         break;
 
         case CYBLE_EVT_L2CAP_CONN_PARAM_UPDATE_RSP:
+            ConnParam_Response(*(uint16*)eventParam);
         break;
 
         case CYBLE_EVT_L2CAP_COMMAND_REJ:
@@ -567,7 +1107,7 @@ void StackEventHandler(uint32 eventCode, void *eventParam)
         /* default catch-all case */
 
         default:
-            printf("CYBLE_???\n");
+            EventLog_Add(EVENTLOG_BLE_UNKNOWN, eventCode);
         break;
     }
 }
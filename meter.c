@@ -2,8 +2,14 @@
 /* Copyright (C) 2021, Joris Dobbelsteen. */
 
 #include "meter.h"
+#include "aggregate.h"
 #include "common.h"
 #include "parser.h"
+#include "schedule.h"
+#include "ring.h"
+#include "uartrx.h"
+#include "power.h"
+#include "eventlog.h"
 #include "dsmr.h"
 #include <project.h>
 
@@ -13,36 +19,58 @@ static enum METER_STATE_T
 {
     METER_STATE_STOPPED,   // Functionality disabled
     METER_STATE_SLEEP,     // Waiting between two intervals
-    METER_STATE_RECEIVING  // Communication and request active
+    METER_STATE_RECEIVING, // Communication and request active
+    METER_STATE_BURST      // Receiving every telegram until the burst ends
 } meter_state = METER_STATE_STOPPED;
 
-static enum METER_ISR_STATE_T
-{
-    METER_ISR_RECEIVE,
-    METER_ISR_WAITFORSTART
-} meter_isr_state = METER_ISR_WAITFORSTART;
+// Receive buffer, power of 2. See Meter_GetReceiveStats for the actual use.
+#ifndef METER_RX_BUFFERSIZE
+#define METER_RX_BUFFERSIZE 256
+#endif
+#if METER_RX_BUFFERSIZE & (METER_RX_BUFFERSIZE - 1)
+#error METER_RX_BUFFERSIZE must be a power of 2
+#endif
+static volatile uint8 uart_buffer[METER_RX_BUFFERSIZE];
+static struct ring_t uart_ring;
+
+// WDT2 is a free running LFCLK counter, used as clock for the scheduler.
+// The WDT0 match interrupt wakes up at the scheduler deadline.
+static struct meter_schedule_t meter_schedule;
+static uint32 meter_deadline = 0;
+static volatile uint8 meter_wakeup = 0;         // deadline passed
 
-#define UART_BUFFERSIZE 256
-static volatile char uart_buffer[UART_BUFFERSIZE];
-static uint8 uart_read_loc = 0;
-static volatile uint8 uart_write_loc = 0;
-static volatile uint8 wdt_triggered = 0;
+static struct dsmr_parser_t meter_parser;
 
-static const int uart_receive_timeout = 10;
+// Requested time between readings (seconds)
+static uint16 meter_interval = 30;
+// Seconds of telegrams per reading, aggregated and published at the end
+static uint16 meter_burst = 0;
+static struct aggregate_t meter_aggregate;      // reading in progress
+static struct aggregate_t meter_published;
+static uint32 meter_changed = 0;                // fields changed during the burst
+static struct dsmr_data_t meter_burst_data;     // last telegram, changed over the burst
+// Average current budget for reading the meter, limits the interval
+#define METER_BUDGET_UA 1000u
+// Request line 5 mA, CPU sleep with UART 1.1 mA, LED 0.5 mA
+#define METER_RECEIVE_UA 6600u
 
-CY_ISR_PROTO(ISR_UART_Meter_Interrupt);
-CY_ISR_PROTO(Meter_Wdt_Timer2_Callback);
+CY_ISR_PROTO(Meter_Wdt_Timer0_Callback);
 
-static void Meter_Dsmr_Received(struct dsmr_data_t*);
-static void Meter_Dsmr_ParserError();
+static void Meter_Dsmr_Received(void* user, const struct dsmr_data_t*);
+static void Meter_Dsmr_ParserError(void* user);
 
-static void(*Meter_Dsmr_ReceivedHandler)(struct dsmr_data_t*) = NULL;
+static void(*Meter_Dsmr_ReceivedHandler)(const struct dsmr_data_t*) = NULL;
+
+static void Meter_Publish(const struct dsmr_data_t* data);
+static void Meter_UpdateInterval();
 
 static void Meter_Receive_Start();
 static void Meter_Receive_Stop();
 
-// Trigger in at least delay time (but not too much more)
-static void Meter_Wdt_TriggerIn(int delay);
+static uint32 Meter_Now();
+// Wake up at tick, Meter_ProcessEvents is called from then on
+static void Meter_Wdt_WakeAt(uint32 tick);
+static void Meter_Wdt_Arm();
 
 void Meter_Start(void)
 {
@@ -51,35 +79,35 @@ void Meter_Start(void)
     // Set LED to on as we start receiving
     LED_Meter_Write(LED_ON);
     
-    // ISR init
-    meter_isr_state = METER_ISR_WAITFORSTART;
-
     // Uart init
-    UART_Meter_SetCustomInterruptHandler(ISR_UART_Meter_Interrupt);
-    Meter_Parser_SetReceivedHandler(Meter_Dsmr_Received);
-    Meter_Parser_SetErrorHandler(Meter_Dsmr_ParserError);
+    Ring_Init(&uart_ring, uart_buffer, METER_RX_BUFFERSIZE);
+    UartRx_Init(&uart_ring);
+    Meter_Parser_Init(&meter_parser, Meter_Dsmr_Received, Meter_Dsmr_ParserError, NULL);
     
-    // Enable receiving mode
+    // Enable WDT0, free running with match interrupt
+    CySysWdtSetMode(CY_SYS_WDT_COUNTER0, CY_SYS_WDT_MODE_INT);
+    CySysWdtSetClearOnMatch(CY_SYS_WDT_COUNTER0, 0);
+    CySysWdtSetIsrCallback(CY_SYS_WDT_COUNTER0, Meter_Wdt_Timer0_Callback);
+    CySysWdtEnable(CY_SYS_WDT_COUNTER0_MASK);
+
+    // Enable receiving mode, with wide window as period is not known yet
+    Meter_Schedule_Init(&meter_schedule, Meter_Now());
+    Meter_Schedule_SetInterval(&meter_schedule, (uint32)meter_interval * SCHEDULE_TICKS_PER_SECOND, Meter_Now());
     Meter_Receive_Start();
-    // Set timeout
-    Meter_Wdt_TriggerIn(uart_receive_timeout);
+    Meter_Wdt_WakeAt(Meter_Schedule_Next(&meter_schedule));
     meter_state = METER_STATE_RECEIVING;
-
-    // Enable WDT2
-    CySysWdtSetIsrCallback(CY_SYS_WDT_COUNTER2, Meter_Wdt_Timer2_Callback);
-    CySysWdtEnableCounterIsr(CY_SYS_WDT_COUNTER2);
 }
 
 enum METER_POWER_STATE_T Meter_GetPowerState()
 {
     if (meter_state == METER_STATE_STOPPED 
-        || (meter_state == METER_STATE_SLEEP && wdt_triggered != 0))
+        || (meter_state == METER_STATE_SLEEP && !meter_wakeup))
     {
         // UART inactive
         return METER_POWER_STATE_DEEPSLEEP;
     }
-    else if (uart_read_loc != uart_write_loc
-            || wdt_triggered == 0)
+    else if (!Ring_Empty(&uart_ring)
+            || meter_wakeup)
     {
         // Need to call Meter_ProcessEvents
         return METER_POWER_STATE_ACTIVE;
@@ -99,33 +127,65 @@ void Meter_ProcessEvents()
         CYASSERT(0);
         break;
     case METER_STATE_SLEEP:
-        if (wdt_triggered == 0)
+        if (meter_wakeup)
         {
-            //printf("Sleep timeout %lu\n", CySysWdtGetCount(CY_SYS_WDT_COUNTER2));
-            // Start receiving
-            LED_Meter_Write(LED_ON);
-            Meter_Receive_Start();
-            // Set timeout
-            Meter_Wdt_TriggerIn(uart_receive_timeout);
-            meter_state = METER_STATE_RECEIVING;
+            //printf("Sleep timeout %lu\n", Meter_Now());
+            if (Meter_Schedule_Timeout(&meter_schedule, Meter_Now(), 0))
+            {
+                // Start receiving
+                LED_Meter_Write(LED_ON);
+                Meter_Receive_Start();
+                meter_state = METER_STATE_RECEIVING;
+            }
+            Meter_Wdt_WakeAt(Meter_Schedule_Next(&meter_schedule));
         }
         break;
     case METER_STATE_RECEIVING:
-        while (uart_read_loc != uart_write_loc)
+    case METER_STATE_BURST:
+        // Bytes below the FIFO trigger level (idle line)
+        UartRx_Poll();
+        for (;;)
         {
-            // parse character
-            Meter_Parser_Parse(uart_buffer[uart_read_loc]);
-            uart_read_loc++;
+            // parse contiguous part of the buffer, up to the write location
+            // or the end of the buffer
+            const uint8_t* data;
+            size_t length = Ring_Peek(&uart_ring, &data);
+            if (length == 0)
+                break;
+            Meter_Parser_ParseBuffer(&meter_parser, (const char*)data, length);
+            Ring_Consume(&uart_ring, length);
         }
-        // Meter_Parser_Parse might call Meter_Dsmr_Received, which will disable wdt_triggered
-        if (wdt_triggered == 0)
+        if (Ring_Resync(&uart_ring))
         {
-            //printf("Receive timeout %lu\n", CySysWdtGetCount(CY_SYS_WDT_COUNTER2));
-            // Leave meter LED on
+            // Bytes were lost, the telegram is incomplete. Wait for the next
+            // telegram start (ISR only stores from the next '/').
+            EventLog_Add(EVENTLOG_METER_OVERRUN, (uart_ring.stats.overruns & 0xFFFF)
+                | ((uint32)uart_ring.stats.high_water << 16));
+            Meter_Parser_Reset(&meter_parser);
+        }
+        // Meter_Parser_Parse might call Meter_Dsmr_Received, which resets the deadline
+        if (meter_state == METER_STATE_RECEIVING && meter_wakeup)
+        {
+            //printf("Receive timeout %lu\n", Meter_Now());
+            // Missed prediction continues with the wide window
+            if (!Meter_Schedule_Timeout(&meter_schedule, Meter_Now(), UartRx_Started()))
+            {
+                // Leave meter LED on
+                Meter_Receive_Stop();
+                meter_state = METER_STATE_SLEEP;
+            }
+            Meter_Wdt_WakeAt(Meter_Schedule_Next(&meter_schedule));
+        }
+        else if (meter_state == METER_STATE_BURST && meter_wakeup)
+        {
+            // Publish the last telegram, with the fields changed during the burst
+            EventLog_Add(EVENTLOG_METER_BURST, meter_aggregate.count | ((uint32)meter_aggregate.duration << 16));
             Meter_Receive_Stop();
-            // Set timeout
-            Meter_Wdt_TriggerIn(30 - uart_receive_timeout);
             meter_state = METER_STATE_SLEEP;
+            Meter_Wdt_WakeAt(Meter_Schedule_Next(&meter_schedule));
+            meter_burst_data = *Meter_GetLatestDsmr();
+            meter_burst_data.changed = meter_changed;
+            Meter_Publish(&meter_burst_data);
         }
         break;
     }
@@ -136,109 +196,196 @@ static void Meter_Receive_Start()
     //printf("Meter Receive Start\n");
     // Restore XOR
     Meter_Invert_VALUE_Write(1);
-    Meter_Parser_Reset();
+    Meter_Parser_Reset(&meter_parser);
 //    Meter_Invert_IN_Write(1); // Pull high, switch on resistive pull-up
 //    Meter_Invert_IN_SetDriveMode(Meter_Invert_IN_DM_RES_UPDWN);
     // What about the OUT and UART_in pins?
-    UART_Meter_Start();
+    UartRx_Start();
+    Power_SetLoad(POWER_LOAD_UART, 1);
     // Initiate request, enable strong drive to 5 volt
     Meter_Request_OUT_Write(3);
+    Power_SetLoad(POWER_LOAD_REQUEST, 1);
 }
 
 static void Meter_Receive_Stop()
 {
     //printf("Meter Receive Stop\n");
-    UART_Meter_Stop();
+    UartRx_Stop();
+    Power_SetLoad(POWER_LOAD_UART, 0);
     // Disable request, lower request line, disables drive
     Meter_Request_OUT_Write(0);
+    Power_SetLoad(POWER_LOAD_REQUEST, 0);
     //Meter_Invert_VALUE_Sleep(); // after deep sleep, its set anyways
     // Pin to High-Z, disable pull-up
 //    Meter_Invert_IN_SetDriveMode(Meter_Invert_IN_DM_DIG_HIZ);
     // What about the OUT and UART_in pins? Floating I/O can consume power, minimum leakage is better.
 }
 
-static void Meter_Wdt_TriggerIn(int delay)
+static uint32 Meter_Now()
+{
+    return CySysWdtGetCount(CY_SYS_WDT_COUNTER2);
+}
+
+static void Meter_Wdt_WakeAt(uint32 tick)
 {
-    //printf("TriggerIn %d at %lu\n", delay, CySysWdtGetCount(CY_SYS_WDT_COUNTER2));
+    //printf("WakeAt %lu at %lu\n", tick, Meter_Now());
     // reset trigger, ensure no WDT interrupt happens here
     uint8 intStatus = CyEnterCriticalSection();
-    wdt_triggered = (delay + 1) >> 1;
+    meter_deadline = tick;
+    meter_wakeup = 0;
+    Meter_Wdt_Arm();
     CyExitCriticalSection(intStatus);
 }
 
+static void Meter_Wdt_Arm()
+{
+    int32 remaining = (int32)(meter_deadline - Meter_Now());
+    if (remaining <= 0)
+    {
+        meter_wakeup = 1;
+        return;
+    }
+    // WDT0 is 16 bits, re-armed on match for longer delays. Match register
+    // updates take a few LFCLK cycles to synchronize.
+    if (remaining > 0xF000)
+        remaining = 0xF000;
+    else if (remaining < 4)
+        remaining = 4;
+    CySysWdtSetMatch(CY_SYS_WDT_COUNTER0, (CySysWdtGetCount(CY_SYS_WDT_COUNTER0) + remaining) & 0xFFFF);
+}
+
 
-static void Meter_Dsmr_Received(struct dsmr_data_t* data)
+static void Meter_Dsmr_Received(void* user, const struct dsmr_data_t* data)
 {
-    //printf("Parsed data at %lu\n", CySysWdtGetCount(CY_SYS_WDT_COUNTER2));
-    if (Meter_Dsmr_ReceivedHandler)
+    (void)user;
+    //printf("Parsed data at %lu\n", Meter_Now());
+    Aggregate_Add(&meter_aggregate, data);
+    if (meter_state == METER_STATE_BURST)
     {
-        Meter_Dsmr_ReceivedHandler(data);
+        meter_changed |= data->changed;
+        return;
     }
-    
+
     if (meter_state == METER_STATE_RECEIVING)
     {
         LED_Meter_Write(LED_OFF); // Success, turn LED off
-        Meter_Receive_Stop();
-        meter_state = METER_STATE_SLEEP;
-        
-        int delay = 30;
-        if (data->timestamp.second < 60)
+
+        // Align readings to multiples of the interval (e.g. whole minutes)
+        uint32 interval = meter_interval;
+        uint32 min_interval = Meter_GetMinInterval();
+        if (interval < min_interval)
+            interval = min_interval;
+        uint32 delay = interval;
+        if (data->timestamp.second < 60 && data->timestamp.minute < 60 && data->timestamp.hour < 24)
         {
-            delay = 60 - data->timestamp.second;
-            if (delay > 30)
-                delay -= 30;
+            uint32 second = ((uint32)data->timestamp.hour * 60 + data->timestamp.minute) * 60 + data->timestamp.second;
+            delay = interval - second % interval;
         }
-        Meter_Wdt_TriggerIn(delay);
+        // Continues receiving while learning the period
+        if (!Meter_Schedule_Received(&meter_schedule, UartRx_StartTick(), Meter_Now(),
+            delay * SCHEDULE_TICKS_PER_SECOND))
+        {
+            if (meter_burst != 0)
+            {
+                // Ends between telegrams, half a second before the one
+                // after the burst
+                meter_changed = data->changed;
+                meter_state = METER_STATE_BURST;
+                Meter_Wdt_WakeAt(UartRx_StartTick() + (uint32)meter_burst * SCHEDULE_TICKS_PER_SECOND
+                    - SCHEDULE_TICKS_PER_SECOND / 2);
+                return;
+            }
+            Meter_Receive_Stop();
+            meter_state = METER_STATE_SLEEP;
+        }
+        Meter_Wdt_WakeAt(Meter_Schedule_Next(&meter_schedule));
+    }
+    Meter_Publish(data);
+}
+
+static void Meter_Publish(const struct dsmr_data_t* data)
+{
+    meter_published = meter_aggregate;
+    Aggregate_Reset(&meter_aggregate);
+    if (Meter_Dsmr_ReceivedHandler)
+    {
+        Meter_Dsmr_ReceivedHandler(data);
     }
 }
 
-static void Meter_Dsmr_ParserError()
+static void Meter_Dsmr_ParserError(void* user)
 {
-    printf("Parsing failed\n");
+    (void)user;
+    EventLog_Add(EVENTLOG_METER_PARSE_FAILED, 0);
 
-    // Ignored, as these might be suprious.
-    // Handled with timeout instead
+    // Ignored, as these might be suprious (e.g. CRC mismatch due to line noise).
+    // Receiving continues, so the next telegram within the receive window is
+    // used. Otherwise handled with timeout.
 }
 
-void Meter_SetReceivedDsmrHandler(void(*handler)(struct dsmr_data_t*))
+void Meter_SetReceivedDsmrHandler(void(*handler)(const struct dsmr_data_t*))
 {
     Meter_Dsmr_ReceivedHandler = handler;
 }
 
-CY_ISR(ISR_UART_Meter_Interrupt)
+const struct ring_stats_t* Meter_GetReceiveStats()
 {
-    /* Returns the status/identity of which enabled RX interrupt source caused interrupt event */
-    uint32 source = UART_Meter_GetRxInterruptSource();
-	
-	/* Checks for "RX FIFO AND not empty" interrupt */
-    if(UART_Meter_INTR_RX_NOT_EMPTY & source)
-    {
-        /* Get the character from terminal */
-        do {
-            char data = UART_Meter_SpiUartReadRxData();
-            if (meter_isr_state == METER_ISR_RECEIVE || data == '/')
-            {
-                uart_buffer[uart_write_loc++] = data;
-                meter_isr_state = METER_ISR_RECEIVE;
-            }
-        } while (UART_Meter_SpiUartGetRxBufferSize());
-                
-        /* Clear UART "RX FIFO not empty interrupt" */
-        UART_Meter_ClearRxInterruptSource(UART_Meter_INTR_RX_NOT_EMPTY);
-    }
-    if ((UART_Meter_INTR_RX_OVERFLOW | UART_Meter_INTR_RX_FRAME_ERROR) & source) {
-        meter_isr_state = METER_ISR_WAITFORSTART;
-        UART_Meter_ClearRxInterruptSource(UART_Meter_INTR_RX_OVERFLOW | UART_Meter_INTR_RX_FRAME_ERROR);
-        // TODO: Manage receive error when they happen, signal upstream...
-    }
-    UART_Meter_ClearPendingInt();
+    return &uart_ring.stats;
+}
+
+const struct dsmr_data_t* Meter_GetLatestDsmr()
+{
+    return Meter_Parser_GetLatest(&meter_parser);
+}
+
+const struct aggregate_t* Meter_GetAggregate()
+{
+    return &meter_published;
+}
+
+void Meter_SetInterval(uint16 seconds)
+{
+    if (seconds == 0 || seconds == meter_interval)
+        return;
+    meter_interval = seconds;
+    Meter_UpdateInterval();
+}
+
+void Meter_SetBurst(uint16 seconds)
+{
+    if (seconds == meter_burst)
+        return;
+    meter_burst = seconds;
+    Meter_UpdateInterval();
+}
+
+// Requested interval, raised to the minimum, to the scheduler
+static void Meter_UpdateInterval()
+{
+    if (meter_state == METER_STATE_STOPPED)
+        return;
+    uint16 min_interval = Meter_GetMinInterval();
+    Meter_Schedule_SetInterval(&meter_schedule,
+        (uint32)(meter_interval > min_interval ? meter_interval : min_interval) * SCHEDULE_TICKS_PER_SECOND, Meter_Now());
+    if (meter_state == METER_STATE_SLEEP)
+        Meter_Wdt_WakeAt(Meter_Schedule_Next(&meter_schedule));
+}
+
+uint16 Meter_GetMinInterval()
+{
+    // Charge per reading divided by the budget, rounded up. Only short
+    // intervals once the telegram period is learned (narrow window). A
+    // burst keeps receiving after the window.
+    uint32 window = Meter_Schedule_Window(&meter_schedule);
+    uint32 ms = (uint32)((uint64)window * 1000 / SCHEDULE_TICKS_PER_SECOND) + (uint32)meter_burst * 1000;
+    uint32 min_interval = (ms * (METER_RECEIVE_UA / 100) / (METER_BUDGET_UA / 100) + 999) / 1000;
+    return min_interval > 0 ? min_interval : 1;
 }
 
-CY_ISR(Meter_Wdt_Timer2_Callback)
+CY_ISR(Meter_Wdt_Timer0_Callback)
 {
-    // set flag
-    uint8 value = wdt_triggered;
-    if (value > 0)
-        value--;
-    wdt_triggered = value;
+    Power_Wakeup(POWER_WAKEUP_TIMER);
+    // set flag when deadline passed, otherwise wait for next match
+    if (!meter_wakeup)
+        Meter_Wdt_Arm();
 }
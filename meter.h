@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: GPL-3.0-only */
 /* Copyright (C) 2021, Joris Dobbelsteen. */
 
+#include <stdint.h>
+
 enum METER_POWER_STATE_T
 {
     METER_POWER_STATE_ACTIVE,     // must call Meter_ProcessEvents
@@ -10,10 +12,21 @@ enum METER_POWER_STATE_T
 
 enum METER_POWER_STATE_T Meter_GetPowerState();  // more complicated
 
+struct aggregate_t;
 struct dsmr_data_t;
+struct ring_stats_t;
 
 void Meter_Start();
 //void Meter_Stop();  // No need found, always active
 void Meter_ProcessEvents();
 
-void Meter_SetReceivedDsmrHandler(void(*handler)(struct dsmr_data_t*));
+void Meter_SetReceivedDsmrHandler(void(*handler)(const struct dsmr_data_t*));
+const struct dsmr_data_t* Meter_GetLatestDsmr();  // last complete telegram, NULL if none
+const struct aggregate_t* Meter_GetAggregate();   // telegrams of the last published reading
+
+void Meter_SetInterval(uint16_t seconds);   // requested time between readings
+// Keep receiving for seconds after the first telegram of a reading (0 off),
+// the reading is published at the end with the aggregate of all telegrams
+void Meter_SetBurst(uint16_t seconds);
+uint16_t Meter_GetMinInterval();            // shortest interval within energy budget
+const struct ring_stats_t* Meter_GetReceiveStats();  // receive buffer use
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "notify.h"
+
+static uint32 notify_pending = 0;
+static struct notify_stats_t notify_stats;
+static int(*notify_fill)(uint32 mask, CYBLE_GATT_HANDLE_VALUE_PAIR_T* handle) = NULL;
+
+static uint8 Notify_Count(uint32 mask)
+{
+    uint8 count = 0;
+    for (; mask != 0; mask &= mask - 1)
+        count++;
+    return count;
+}
+
+void Notify_Start(int(*fill)(uint32 mask, CYBLE_GATT_HANDLE_VALUE_PAIR_T* handle))
+{
+    notify_fill = fill;
+    notify_pending = 0;
+}
+
+void Notify_Queue(uint32 mask)
+{
+    notify_stats.queued += Notify_Count(mask);
+    notify_stats.coalesced += Notify_Count(notify_pending & mask);
+    notify_pending |= mask;
+}
+
+void Notify_Cancel(uint32 mask)
+{
+    notify_stats.dropped += Notify_Count(notify_pending & mask);
+    notify_pending &= ~mask;
+}
+
+uint32 Notify_GetPending()
+{
+    return notify_pending;
+}
+
+void Notify_ProcessEvents()
+{
+    while (notify_pending != 0)
+    {
+        if (CyBle_GetState() != CYBLE_STATE_CONNECTED)
+        {
+            Notify_Cancel(notify_pending);
+            return;
+        }
+        if (CyBle_GattGetBusyStatus() == CYBLE_STACK_STATE_BUSY)
+        {
+            // Continue after CYBLE_EVT_STACK_BUSY_STATUS reports free
+            notify_stats.busy++;
+            return;
+        }
+
+        uint32 mask = notify_pending & (~notify_pending + 1); // lowest bit
+        CYBLE_GATT_HANDLE_VALUE_PAIR_T handle;
+        if (notify_fill == NULL || !notify_fill(mask, &handle))
+        {
+            // Would not be sent later either (disabled, exceeds the MTU)
+            notify_stats.skipped++;
+            notify_pending &= ~mask;
+            continue;
+        }
+
+        CYBLE_API_RESULT_T result = CyBle_GattsNotification(cyBle_connHandle, &handle);
+        if (result == CYBLE_ERROR_OK)
+        {
+            notify_stats.sent++;
+            notify_pending &= ~mask;
+        }
+        else if (result == CYBLE_ERROR_INSUFFICIENT_RESOURCES)
+        {
+            // Stack buffer full, retry later
+            notify_stats.busy++;
+            return;
+        }
+        else
+        {
+            notify_stats.dropped++;
+            notify_pending &= ~mask;
+        }
+    }
+}
+
+const struct notify_stats_t* Notify_GetStats()
+{
+    return &notify_stats;
+}
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <project.h>
+
+// Pending notifications, one slot per characteristic (bit in a mask), so
+// a newer update of a characteristic replaces the pending one. The value
+// is only retrieved when it is sent, so the latest value is always used.
+// Sending stops while the BLE stack is busy and continues when it is free.
+
+struct notify_stats_t {
+    uint32 queued;      // updates queued
+    uint32 sent;        // notifications accepted by the stack
+    uint32 coalesced;   // updates replaced by a newer one before sending
+    uint32 dropped;     // updates lost (disconnect, stack error)
+    uint32 skipped;     // updates with nothing to send (fill returned 0)
+    uint32 busy;        // times sending was postponed as stack was busy
+};
+
+// fill: sets the handle and value of the characteristic for the given mask
+// bit, returns 0 if there is nothing to send
+void Notify_Start(int(*fill)(uint32 mask, CYBLE_GATT_HANDLE_VALUE_PAIR_T* handle));
+void Notify_Queue(uint32 mask);
+void Notify_Cancel(uint32 mask);    // e.g. notifications disabled or disconnect
+uint32 Notify_GetPending();
+void Notify_ProcessEvents();        // call from main loop
+const struct notify_stats_t* Notify_GetStats();
+
+#endif // NOTIFY_H
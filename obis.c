@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "obis.h"
+#include "dsmr.h"
+
+#define UINT32(a, b, c, d, e, field, member, decimal, dsmr_field) \
+    { OBIS_KEY(a, b, c, d, e, field), offsetof(struct dsmr_data_t, member), OBIS_KIND_UINT32, decimal, dsmr_field }
+#define TIMESTAMP(a, b, c, d, e, field, member, dsmr_field) \
+    { OBIS_KEY(a, b, c, d, e, field), offsetof(struct dsmr_data_t, member), OBIS_KIND_TIMESTAMP, 0, dsmr_field }
+
+// Must be sorted on key, so on A, B, C, D, E, field
+const struct obis_descriptor_t obis_table[] = {
+    // 0-0:1.0.0(101209113020W)
+    TIMESTAMP(0, 0,  1,  0, 0, 0, timestamp, DSMR_FIELD_TIMESTAMP),
+    // 0-0:17.0.0(016.1*kW)
+    UINT32(0, 0, 17,  0, 0, 0, P_threshold, 3, DSMR_FIELD_P_THRESHOLD),
+    // 0-0:96.14.0(0002)
+    UINT32(0, 0, 96, 14, 0, 0, tariff, 0, DSMR_FIELD_TARIFF),
+    // 0-1:24.2.1(101209112500W)(12785.123*m3)
+    TIMESTAMP(0, 1, 24,  2, 1, 0, gas_timestamp, DSMR_FIELD_GAS_TIMESTAMP),
+    UINT32(0, 1, 24,  2, 1, 1, gas_in, 3, DSMR_FIELD_GAS_IN),
+    // 0-1:24.3.0(090212160000)(00)(60)(1)(0-1:24.2.1)(m3)(00000.000)
+    // DSMR 2.2 only (legacy standard) -> if not set before
+    { OBIS_KEY(0, 1, 24, 3, 0, 0), offsetof(struct dsmr_data_t, gas_timestamp), OBIS_KIND_TIMESTAMP_LEGACY, 0, DSMR_FIELD_GAS_TIMESTAMP },
+    { OBIS_KEY(0, 1, 24, 3, 0, 6), offsetof(struct dsmr_data_t, gas_in), OBIS_KIND_UINT32_LEGACY, 3, DSMR_FIELD_GAS_IN },
+    // 1-0:1.4.0(02.351*kW)
+    UINT32(1, 0,  1,  4, 0, 0, P_demand, 3, DSMR_FIELD_P_DEMAND),
+    // 1-0:1.6.0(200509134558S)(02.589*kW)
+    TIMESTAMP(1, 0,  1,  6, 0, 0, P_demand_max_timestamp, DSMR_FIELD_P_DEMAND_MAX_TIMESTAMP),
+    UINT32(1, 0,  1,  6, 0, 1, P_demand_max, 3, DSMR_FIELD_P_DEMAND_MAX),
+    // 1-0:[12].7.0(01.193*kW)
+    UINT32(1, 0,  1,  7, 0, 0, P_in_total, 3, DSMR_FIELD_P_IN_TOTAL),
+    // 1-0:[12].8.[12](123456.789*kWh)
+    UINT32(1, 0,  1,  8, 1, 0, E_in[0], 3, DSMR_FIELD_E_IN1),
+    UINT32(1, 0,  1,  8, 2, 0, E_in[1], 3, DSMR_FIELD_E_IN2),
+    UINT32(1, 0,  2,  7, 0, 0, P_out_total, 3, DSMR_FIELD_P_OUT_TOTAL),
+    UINT32(1, 0,  2,  8, 1, 0, E_out[0], 3, DSMR_FIELD_E_OUT1),
+    UINT32(1, 0,  2,  8, 2, 0, E_out[1], 3, DSMR_FIELD_E_OUT2),
+    // 1-0:[246]1.7.0(01.111*kW) P_in, 1-0:[246]2.7.0(04.444*kW) P_out
+    // 1-0:[357]1.7.0(001*A) Current, 1-0:[357]2.7.0(220.1*V) Voltage
+    UINT32(1, 0, 21,  7, 0, 0, P_in[0], 3, DSMR_FIELD_P_IN1),
+    UINT32(1, 0, 22,  7, 0, 0, P_out[0], 3, DSMR_FIELD_P_OUT1),
+    UINT32(1, 0, 31,  7, 0, 0, I[0], 3, DSMR_FIELD_I1),
+    UINT32(1, 0, 32,  7, 0, 0, V[0], 3, DSMR_FIELD_V1),
+    UINT32(1, 0, 41,  7, 0, 0, P_in[1], 3, DSMR_FIELD_P_IN2),
+    UINT32(1, 0, 42,  7, 0, 0, P_out[1], 3, DSMR_FIELD_P_OUT2),
+    UINT32(1, 0, 51,  7, 0, 0, I[1], 3, DSMR_FIELD_I2),
+    UINT32(1, 0, 52,  7, 0, 0, V[1], 3, DSMR_FIELD_V2),
+    UINT32(1, 0, 61,  7, 0, 0, P_in[2], 3, DSMR_FIELD_P_IN3),
+    UINT32(1, 0, 62,  7, 0, 0, P_out[2], 3, DSMR_FIELD_P_OUT3),
+    UINT32(1, 0, 71,  7, 0, 0, I[2], 3, DSMR_FIELD_I3),
+    UINT32(1, 0, 72,  7, 0, 0, V[2], 3, DSMR_FIELD_V3),
+};
+
+const size_t obis_table_size = sizeof(obis_table) / sizeof(obis_table[0]);
+
+const struct obis_descriptor_t* Obis_Lookup(uint32_t key)
+{
+    // binary search
+    size_t low = 0, high = obis_table_size;
+    while (low < high)
+    {
+        size_t mid = (low + high) >> 1;
+        uint32_t mid_key = obis_table[mid].key;
+        if (mid_key == key)
+            return &obis_table[mid];
+        else if (mid_key < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return NULL;
+}
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef OBIS_H
+#define OBIS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Packed OBIS key A-B:C.D.E + value field (n-th "(" on the line)
+// A: 4 bits, B: 4 bits, C: 8 bits, D: 8 bits, E: 5 bits, field: 3 bits
+#define OBIS_KEY(a, b, c, d, e, field) \
+    (((uint32_t)(a) << 28) | ((uint32_t)(b) << 24) | ((uint32_t)(c) << 16) \
+    | ((uint32_t)(d) << 8) | ((uint32_t)(e) << 3) | (uint32_t)(field))
+#define OBIS_KEY_VALID(a, b, c, d, e, field) \
+    ((a) < 16 && (b) < 16 && (c) < 256 && (d) < 256 && (e) < 32 && (field) < 8)
+
+enum obis_kind_t {
+    OBIS_KIND_UINT32,           // fixed point, scaled by 10^decimal
+    OBIS_KIND_TIMESTAMP,        // YYMMDDhhmmssX
+    OBIS_KIND_UINT32_LEGACY,    // as uint32, only when not set by a newer OBIS code
+    OBIS_KIND_TIMESTAMP_LEGACY  // as timestamp, only when not set by a newer OBIS code
+};
+
+struct obis_descriptor_t {
+    uint32_t key;       // OBIS_KEY
+    uint8_t offset;     // offset in struct dsmr_data_t
+    uint8_t kind;       // enum obis_kind_t
+    uint8_t decimal;    // number of decimals stored (scale)
+    uint8_t field;      // enum dsmr_field_t
+};
+
+// Sorted on key
+extern const struct obis_descriptor_t obis_table[];
+extern const size_t obis_table_size;
+
+const struct obis_descriptor_t* Obis_Lookup(uint32_t key);
+
+#endif // OBIS_H
@@ -4,12 +4,15 @@
 //#pragma GCC diagnostic ignored "-Wunused-label"
 //#pragma GCC diagnostic ignored "-Wunused-variable"
     
+#include "parser.h"
 #include "dsmr.h"
+#include "obis.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if defined(NDEBUG) || __ARM_ARCH_6M__ || __ARM_ARCH_7M__ || __ARM_ARCH_7EM__
-#  define DEBUGLOG(format, ...)
+#  define DEBUGLOG(format, ...) do { } while(0)
 #else
 #  include <stdio.h>
 #  define DEBUGLOG(...) do { printf(__VA_ARGS__ ); printf("\n"); } while(0)
@@ -70,7 +73,7 @@ line = OBIS_id ( "(" value ( "*" unit )? ")" )+
 OBIS_id = obis_concept "-" obis_channel ":" obis
 */
 
-static enum parser_state_t {
+enum parser_state_t {
     sreset,  // search for start of packet
     // header
     shstart,
@@ -113,334 +116,377 @@ static enum parser_state_t {
     secrc3,
     secrc4,
     self
-} parser_state;
-static uint16_t parser_obis_a, parser_obis_b, parser_obis_c, parser_obis_d, parser_obis_e, parser_obis_f, parser_obis_field;
+};
 
-static union {
-	struct {
-		uint32_t uint;
-		uint8_t decimal;
-		uint8_t size; // 0 = uint32, 1 = uint8, 2 = uint16
-	};
-	struct dsmr_timestamp_t timestamp;
-} parser_v;
-static union {
-	uint8_t* uint8;
-	uint32_t* uint32;
-	struct dsmr_timestamp_t* timestamp;
-} parser_set;
+// CRC16 (x^16+x^15+x^2+1, LSB first), processed a nibble at a time.
+// The 32 byte table is a good trade-off on the Cortex-M0 (no barrel shift
+// loop of 8 iterations, no 512 byte table in flash).
+static const uint16_t parser_crc_table[16] = {
+	0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+	0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
 
-static struct dsmr_data_t dsmr;
-static void(*parser_error)(void) = NULL;
-static void(*parser_packet_received)(struct dsmr_data_t*) = NULL;
+static uint16_t parser_crc_update(uint16_t crc, char c)
+{
+	crc = (crc >> 4) ^ parser_crc_table[(crc ^ (uint8_t)c) & 0x0F];
+	crc = (crc >> 4) ^ parser_crc_table[(crc ^ ((uint8_t)c >> 4)) & 0x0F];
+	return crc;
+}
 
-static void Meter_Parser_ClearDSMR()
+// hex digit 0 - 9, A - F (a - f), returns 16 if no hex digit
+static uint8_t parser_hex_digit(char c)
 {
-	dsmr_timestamp_clear(&dsmr.timestamp);
-	dsmr_timestamp_clear(&dsmr.gas_timestamp);
-	dsmr.tariff = 0;
-    dsmr.E_in[0] = dsmr.E_in[1] = UINT32_MAX;
-	dsmr.E_out[0] = dsmr.E_out[1]  = UINT32_MAX;
-	dsmr.P_in_total = dsmr.P_out_total = dsmr.P_threshold = UINT32_MAX;
-    dsmr.I[0] = dsmr.I[1] = dsmr.I[2] = UINT32_MAX;
-	dsmr.V[0] = dsmr.V[1] = dsmr.V[2] = UINT32_MAX;
-	dsmr.P_in[0] = dsmr.P_in[1] = dsmr.P_in[2] = UINT32_MAX;
-    dsmr.P_out[0] = dsmr.P_out[1] = dsmr.P_out[2] = UINT32_MAX;
-    dsmr.gas_in = UINT32_MAX;
+	if (c >= '0' && c <= '9') return (uint8_t)(c - '0');
+	if (c >= 'A' && c <= 'F') return (uint8_t)(c - 'A' + 10);
+	if (c >= 'a' && c <= 'f') return (uint8_t)(c - 'a' + 10);
+	return 16;
 }
 
-void Meter_Parser_SetReceivedHandler(void(*packet_received_func)(struct dsmr_data_t*))
+static void Meter_Parser_ClearDSMR(struct dsmr_parser_t* p)
 {
-	parser_packet_received = packet_received_func;
+	dsmr_timestamp_clear(&p->data->timestamp);
+	dsmr_timestamp_clear(&p->data->gas_timestamp);
+	dsmr_timestamp_clear(&p->data->P_demand_max_timestamp);
+	p->data->tariff = 0;
+    p->data->E_in[0] = p->data->E_in[1] = UINT32_MAX;
+	p->data->E_out[0] = p->data->E_out[1]  = UINT32_MAX;
+	p->data->P_in_total = p->data->P_out_total = p->data->P_threshold = UINT32_MAX;
+    p->data->I[0] = p->data->I[1] = p->data->I[2] = UINT32_MAX;
+	p->data->V[0] = p->data->V[1] = p->data->V[2] = UINT32_MAX;
+	p->data->P_in[0] = p->data->P_in[1] = p->data->P_in[2] = UINT32_MAX;
+    p->data->P_out[0] = p->data->P_out[1] = p->data->P_out[2] = UINT32_MAX;
+    p->data->gas_in = UINT32_MAX;
+    p->data->P_demand = p->data->P_demand_max = UINT32_MAX;
+    p->data->present = p->data->changed = 0;
 }
 
-void Meter_Parser_SetErrorHandler(void(*error_func)(void))
+void Meter_Parser_Init(struct dsmr_parser_t* p,
+	void(*packet_received_func)(void* user, const struct dsmr_data_t*),
+	void(*error_func)(void* user),
+	void* user)
 {
-	parser_error = error_func;
+	p->packet_received = packet_received_func;
+	p->error = error_func;
+	p->user = user;
+	p->state = sreset;
+	p->data = &p->dsmr[0];
+	p->latest = NULL;
+	Meter_Parser_ClearDSMR(p);
 }
 
-void Meter_Parser_Reset()
+void Meter_Parser_Reset(struct dsmr_parser_t* p)
 {
-    parser_state = sreset;
+    p->state = sreset;
 }
 
-static enum parser_state_t parser_get_data_start()
+static enum parser_state_t parser_get_data_start(struct dsmr_parser_t* p)
 {
-	parser_v.uint = 0; parser_v.size = 0;
-	DEBUGLOG("%d-%d:%d.%d.%d*%d #%d", parser_obis_a, parser_obis_b, parser_obis_c, parser_obis_d, parser_obis_e, parser_obis_f, parser_obis_field);
-	// 1-0 (no fields)
-	if (parser_obis_a == 1 && parser_obis_b == 0 && parser_obis_field == 0)
+	p->v.uint = 0; p->v.size = 0;
+	DEBUGLOG("%d-%d:%d.%d.%d*%d #%d", p->obis_a, p->obis_b, p->obis_c, p->obis_d, p->obis_e, p->obis_f, p->obis_field);
+	if (!OBIS_KEY_VALID(p->obis_a, p->obis_b, p->obis_c, p->obis_d, p->obis_e, p->obis_field))
+		return sldatanone;
+	const struct obis_descriptor_t* obis = Obis_Lookup(
+		OBIS_KEY(p->obis_a, p->obis_b, p->obis_c, p->obis_d, p->obis_e, p->obis_field));
+	if (obis == NULL)
+		return sldatanone;
+
+	uint8_t* target = (uint8_t*)p->data + obis->offset;
+	DEBUGLOG(" offset %d", obis->offset);
+	p->set_field = DSMR_FIELD_MASK(obis->field);
+	switch (obis->kind)
 	{
-		// 1-0:[12].8.[12](123456.789*kWh)
-		if (parser_obis_d == 8 && parser_obis_e >= 1  && parser_obis_e <= MAX_TARIFFS) {
-			parser_v.decimal = 3;
-			if (parser_obis_c == 1) { DEBUGLOG(" E_in"); parser_set.uint32 = &(dsmr.E_in[parser_obis_e - 1]); return sldatauint32; }
-			if (parser_obis_c == 2) { DEBUGLOG(" E_out"); parser_set.uint32 = &(dsmr.E_out[parser_obis_e - 1]); return sldatauint32; }
-		}
-		// 1-0:x.7.0
-		if (parser_obis_d == 7 && parser_obis_e == 0) {
-			parser_v.decimal = 3;
-			switch(parser_obis_c) {
-			// 1-0:[12].7.0(01.193*kW)
-			case 1: DEBUGLOG(" P_in"); parser_set.uint32 = &(dsmr.P_in_total); return sldatauint32;
-			case 2: DEBUGLOG(" P_out"); parser_set.uint32 = &(dsmr.P_out_total); return sldatauint32;
-			// 1-0:[357]1.7.0(220.1*V) Current
-			case 31: DEBUGLOG(" I1"); parser_set.uint32 = &(dsmr.I[0]); return sldatauint32;
-			case 51: DEBUGLOG(" I2"); parser_set.uint32 = &(dsmr.I[1]); return sldatauint32;
-			case 71: DEBUGLOG(" I3"); parser_set.uint32 = &(dsmr.I[2]); return sldatauint32;
-			// 1-0:[357]2.7.0(001*A) Voltage
-			case 32: DEBUGLOG(" V1"); parser_set.uint32 = &(dsmr.V[0]); return sldatauint32;
-			case 52: DEBUGLOG(" V2"); parser_set.uint32 = &(dsmr.V[1]); return sldatauint32;
-			case 72: DEBUGLOG(" V3"); parser_set.uint32 = &(dsmr.V[2]); return sldatauint32;
-			// 1-0:[246]1.7.0(01.111*kW) P_in
-			case 21: DEBUGLOG(" P_in1"); parser_set.uint32 = &(dsmr.P_in[0]); return sldatauint32;
-			case 41: DEBUGLOG(" P_in2"); parser_set.uint32 = &(dsmr.P_in[1]); return sldatauint32;
-			case 61: DEBUGLOG(" P_in3"); parser_set.uint32 = &(dsmr.P_in[2]); return sldatauint32;
-			// 1-0:[246]2.7.0(04.444*kW) P_out
-			case 22: DEBUGLOG(" P_out1"); parser_set.uint32 = &(dsmr.P_out[0]); return sldatauint32;
-			case 42: DEBUGLOG(" P_out1"); parser_set.uint32 = &(dsmr.P_out[1]); return sldatauint32;
-			case 62: DEBUGLOG(" P_out1"); parser_set.uint32 = &(dsmr.P_out[2]); return sldatauint32;
-			default: break;
-			}
-		}
-	}
-	// 0-0 (no fields)
-	if (parser_obis_a == 0 && parser_obis_b == 0 && parser_obis_field == 0) {
-		// 0-0:1.0.0(101209113020W)
-		if (parser_obis_c == 1 && parser_obis_d == 0 && parser_obis_e == 0) {
-			DEBUGLOG(" timestamp");
-			dsmr_timestamp_clear(&(parser_v.timestamp)); parser_set.timestamp = &(dsmr.timestamp); return sldatatimestamp;
-		}
-		// 0-0:17.0.0(016.1*kW)
-		if (parser_obis_c == 17 && parser_obis_d == 0 && parser_obis_e == 0) {
-			DEBUGLOG(" P_threshold");
-			parser_v.decimal = 3; parser_set.uint32 = &(dsmr.P_threshold); return sldatauint32;
-		}
-		// 0-0:96.14.0
-		if (parser_obis_c == 96 && parser_obis_d == 14 && parser_obis_e == 0) {
-			DEBUGLOG(" tariff");
-			parser_v.decimal = 0; parser_set.uint32 = &(dsmr.tariff); return sldatauint32;
-		}
+	case OBIS_KIND_UINT32_LEGACY:
+		if (p->data->present & p->set_field) return sldatanone;
+		// fall through
+	case OBIS_KIND_UINT32:
+		p->v.decimal = obis->decimal; p->set.uint32 = (uint32_t*)target; return sldatauint32;
+	case OBIS_KIND_TIMESTAMP_LEGACY:
+		if (p->data->present & p->set_field) return sldatanone;
+		// fall through
+	case OBIS_KIND_TIMESTAMP:
+		dsmr_timestamp_clear(&(p->v.timestamp)); p->set.timestamp = (struct dsmr_timestamp_t*)target; return sldatatimestamp;
+	default:
+		return sldatanone;
 	}
-	// 0-1 !!! fields !!!
-	if (parser_obis_a == 0 && parser_obis_b == 1) {
-		// 0-1:24.2.1(101209112500W)(12785.123*m3)
-		if (parser_obis_c == 24 && parser_obis_d == 2 && parser_obis_e == 1) {
-			if (parser_obis_field == 0) {
-				DEBUGLOG(" gas_timestamp");
-				dsmr_timestamp_clear(&(parser_v.timestamp)); parser_set.timestamp = &(dsmr.gas_timestamp); return sldatatimestamp;
-			}
-			if (parser_obis_field == 1) {
-				DEBUGLOG(" gas_in");
-				parser_v.decimal = 3; parser_set.uint32 = &(dsmr.gas_in); return sldatauint32;
-			}
-		}
-		// 0-1:24.3.0(090212160000)(00)(60)(1)(0-1:24.2.1)(m3)(00000.000)
-		// DSMR 2.2 only (legacy standard) -> if not set before
-		if (parser_obis_c == 24 && parser_obis_d == 3 && parser_obis_e == 0 && dsmr.gas_in == UINT32_MAX) {
-			if (parser_obis_field == 0) {
-				DEBUGLOG(" gas_timestamp (legacy)");
-				dsmr_timestamp_clear(&(parser_v.timestamp)); parser_set.timestamp = &(dsmr.gas_timestamp); return sldatatimestamp;
-			}
-			if (parser_obis_field == 6) {
-				DEBUGLOG(" gas_in (legacy)");
-				parser_v.decimal = 3; parser_set.uint32 = &(dsmr.gas_in); return sldatauint32;
-			}
-		}
-	}
-	return sldatanone;
 }
 
-static void parser_store_uint32()
+static void parser_store_uint32(struct dsmr_parser_t* p)
+{
+	while (p->v.decimal--)
+		p->v.uint *= 10;
+	*p->set.uint32 = p->v.uint;
+	p->data->present |= p->set_field;
+}
+
+static void parser_store_timestamp(struct dsmr_parser_t* p)
 {
-	while (parser_v.decimal--)
-		parser_v.uint *= 10;
-	*parser_set.uint32 = parser_v.uint;
+	if (p->v.timestamp.year < 100) p->v.timestamp.year += 2000;
+	*(p->set.timestamp) = p->v.timestamp;
+	p->data->present |= p->set_field;
 }
 
-static void parser_store_timestamp()
+// Fields present in only one of both, or with a different value
+static uint32_t parser_changed_fields(const struct dsmr_data_t* data, const struct dsmr_data_t* previous)
 {
-	if (parser_v.timestamp.year < 100) parser_v.timestamp.year += 2000;
-	*(parser_set.timestamp) = parser_v.timestamp;
+	if (previous == NULL)
+		return data->present;
+	uint32_t changed = data->present ^ previous->present;
+	for (size_t i = 0; i < obis_table_size; ++i)
+	{
+		const struct obis_descriptor_t* obis = &obis_table[i];
+		uint32_t mask = DSMR_FIELD_MASK(obis->field);
+		if ((data->present & ~changed & mask) == 0)
+			continue;
+		size_t size = (obis->kind == OBIS_KIND_TIMESTAMP || obis->kind == OBIS_KIND_TIMESTAMP_LEGACY)
+			? sizeof(struct dsmr_timestamp_t) : sizeof(uint32_t);
+		if (memcmp((const uint8_t*)data + obis->offset, (const uint8_t*)previous + obis->offset, size) != 0)
+			changed |= mask;
+	}
+	return changed;
 }
 
-void Meter_Parser_Parse(char c)
+void Meter_Parser_Parse(struct dsmr_parser_t* p, char c)
 {
     // start of packet detection
     if (c == '/')
     {
-        if (parser_state != sreset)
+        if (p->state != sreset)
         {
-            if (parser_error) parser_error();    
+            if (p->error) p->error(p->user);    
         }
-        Meter_Parser_ClearDSMR();
-        parser_state = shstart;
+        Meter_Parser_ClearDSMR(p);
+        p->crc = parser_crc_update(0, c);
+        p->state = shstart;
         DEBUGLOG("Start of packet");
         return;
     }
     
+    // CRC covers everything from "/" up to and including "!"
+    if (p->state != sreset && p->state < seend)
+        p->crc = parser_crc_update(p->crc, c);
+
     // digit 0 - 9;
     uint8_t digit = (uint8_t)(c - '0');
 #	define is_digit (digit < 10)
 #	define add_digit(x) do { (x = (x * 10) + digit); }  while(0)
 
-    enum parser_state_t prev_state = parser_state;
-    switch(parser_state)
+    enum parser_state_t prev_state = p->state;
+    switch(p->state)
     {
         // sreset is ignored
     case shstart: // header start, ignore entire header
-		if (c == '\r') { parser_state = slstart; DEBUGLOG("Start of line"); }
+		if (c == '\r') { p->state = slstart; DEBUGLOG("Start of line"); }
 		break;
     case slerror: // ignore rest of line
-    	if (prev_state != slerror) DEBUGLOG("Line error");
-		if (c == '\r') parser_state = slstart;
+		if (c == '\r') p->state = slstart;
 		break;
     case slstart: // line start
-		if (c == '\n') parser_state = slstart; // ignore LF
-		else if (is_digit) { parser_obis_a = digit; parser_state = slobisa; } // obis_a
-		else if (c == '!') parser_state = seend; // end of packet
-		else parser_state = slerror;
+		if (c == '\n') p->state = slstart; // ignore LF
+		else if (is_digit) { p->obis_a = digit; p->state = slobisa; } // obis_a
+		else if (c == '!') p->state = seend; // end of packet
+		else p->state = slerror;
 		break;
     case slobisa:
-    	if (is_digit) add_digit(parser_obis_a);
-    	else if (c == '-') parser_state = slobisab;
-    	else parser_state = slerror;
+    	if (is_digit) add_digit(p->obis_a);
+    	else if (c == '-') p->state = slobisab;
+    	else p->state = slerror;
     	break;
     case slobisab:
-		if (is_digit) { parser_obis_b = digit; parser_state = slobisb; }
-		else parser_state = slerror;
+		if (is_digit) { p->obis_b = digit; p->state = slobisb; }
+		else p->state = slerror;
 		break;
     case slobisb:
-    	if (is_digit) add_digit(parser_obis_b);
-    	else if (c == ':') { parser_state = slobisbc; }
-    	else parser_state = slerror;
+    	if (is_digit) add_digit(p->obis_b);
+    	else if (c == ':') { p->state = slobisbc; }
+    	else p->state = slerror;
     	break;
     case slobisbc:
-		if (is_digit) { parser_obis_c = digit; parser_state = slobisc; }
-		else parser_state = slerror;
+		if (is_digit) { p->obis_c = digit; p->state = slobisc; }
+		else p->state = slerror;
 		break;
     case slobisc:
-    	if (is_digit) add_digit(parser_obis_c);
-    	else if (c == '.') { parser_state = slobiscd; }
-    	else parser_state = slerror;
+    	if (is_digit) add_digit(p->obis_c);
+    	else if (c == '.') { p->state = slobiscd; }
+    	else p->state = slerror;
     	break;
     case slobiscd:
-		if (is_digit) { parser_obis_d = digit; parser_state = slobisd; }
-		else parser_state = slerror;
+		if (is_digit) { p->obis_d = digit; p->state = slobisd; }
+		else p->state = slerror;
 		break;
     case slobisd:
-    	if (is_digit) add_digit(parser_obis_d);
-    	else if (c == '.') { parser_state = slobisde; }
-    	else parser_state = slerror;
+    	if (is_digit) add_digit(p->obis_d);
+    	else if (c == '.') { p->state = slobisde; }
+    	else p->state = slerror;
     	break;
     case slobisde:
-    	parser_obis_field = 0; // reset value
-		if (is_digit) { parser_obis_e = digit; parser_state = slobise; }
-		else parser_state = slerror;
+    	p->obis_field = 0; // reset value
+		if (is_digit) { p->obis_e = digit; p->state = slobise; }
+		else p->state = slerror;
 		break;
     case slobise:
-    	if (is_digit) add_digit(parser_obis_e);
-    	else if (c == '*') { parser_state = slobisef; }
-    	else if (c == '(') { parser_obis_f = 255; parser_state = parser_get_data_start(); }
-    	else parser_state = slerror;
+    	if (is_digit) add_digit(p->obis_e);
+    	else if (c == '*') { p->state = slobisef; }
+    	else if (c == '(') { p->obis_f = 255; p->state = parser_get_data_start(p); }
+    	else p->state = slerror;
     	break;
     case slobisef:
-		if (is_digit) { parser_obis_f = digit; parser_state = slobisf; }
-		else parser_state = slerror;
+		if (is_digit) { p->obis_f = digit; p->state = slobisf; }
+		else p->state = slerror;
 		break;
     case slobisf:
-    	if (is_digit) add_digit(parser_obis_f);
-    	else if (c == '(') parser_state = parser_get_data_start();
-		else parser_state = slerror;
+    	if (is_digit) add_digit(p->obis_f);
+    	else if (c == '(') p->state = parser_get_data_start(p);
+		else p->state = slerror;
 		break;
 	// data
     case sldatanone:
-		if (c == '\r') { parser_state = slstart; }
-		else if (c == '(') { parser_obis_field++; parser_state = parser_get_data_start(); }
+		if (c == '\r') { p->state = slstart; }
+		else if (c == '(') { p->obis_field++; p->state = parser_get_data_start(p); }
     	break;
     case sldatauint32:
-    	if (is_digit) add_digit(parser_v.uint);
-    	else if (c == '.') { parser_state = sldatauint32d; }
-    	else if (c == '*') { parser_store_uint32(); parser_state = sldataunit; }
-    	else if (c == ')') { parser_store_uint32(); parser_state = sldatanone; }
-		else parser_state = slerror;
+    	if (is_digit) add_digit(p->v.uint);
+    	else if (c == '.') { p->state = sldatauint32d; }
+    	else if (c == '*') { parser_store_uint32(p); p->state = sldataunit; }
+    	else if (c == ')') { parser_store_uint32(p); p->state = sldatanone; }
+		else p->state = slerror;
 		break;
     case sldatauint32d:
-    	if (is_digit) { if(parser_v.decimal--) add_digit(parser_v.uint); }
-    	else if (c == '*') { parser_store_uint32(); parser_state = sldataunit; }
-    	else if (c == ')') { parser_store_uint32(); parser_state = sldatanone; }
-		else parser_state = slerror;
+    	if (is_digit) { if(p->v.decimal--) add_digit(p->v.uint); }
+    	else if (c == '*') { parser_store_uint32(p); p->state = sldataunit; }
+    	else if (c == ')') { parser_store_uint32(p); p->state = sldatanone; }
+		else p->state = slerror;
 		break;
     case sldataunit:
-    	if (c == ')') { parser_state = sldatanone; }
+    	if (c == ')') { p->state = sldatanone; }
     	// ignore everything else
 		break;
     case sldatatimestamp:
     case sldatatimestampy2:
-    	if (is_digit) { add_digit(parser_v.timestamp.year); parser_state++; }
-		else parser_state = slerror;
+    	if (is_digit) { add_digit(p->v.timestamp.year); p->state++; }
+		else p->state = slerror;
     	break;
     case sldatatimestampmo1:
     case sldatatimestampmo2:
-    	if (is_digit) { add_digit(parser_v.timestamp.month); parser_state++; }
-		else parser_state = slerror;
+    	if (is_digit) { add_digit(p->v.timestamp.month); p->state++; }
+		else p->state = slerror;
     	break;
     case sldatatimestampd1:
     case sldatatimestampd2:
-    	if (is_digit) { add_digit(parser_v.timestamp.day); parser_state++; }
-		else parser_state = slerror;
+    	if (is_digit) { add_digit(p->v.timestamp.day); p->state++; }
+		else p->state = slerror;
     	break;
     case sldatatimestamph1:
     case sldatatimestamph2:
-    	if (is_digit) { add_digit(parser_v.timestamp.hour); parser_state++; }
-		else parser_state = slerror;
+    	if (is_digit) { add_digit(p->v.timestamp.hour); p->state++; }
+		else p->state = slerror;
     	break;
     case sldatatimestampmi1:
     case sldatatimestampmi2:
-    	if (is_digit) { add_digit(parser_v.timestamp.minute); parser_state++; }
-		else parser_state = slerror;
+    	if (is_digit) { add_digit(p->v.timestamp.minute); p->state++; }
+		else p->state = slerror;
     	break;
     case sldatatimestamps1:
     case sldatatimestamps2:
-    	if (is_digit) { add_digit(parser_v.timestamp.second); parser_state++; }
-		else parser_state = slerror;
+    	if (is_digit) { add_digit(p->v.timestamp.second); p->state++; }
+		else p->state = slerror;
     	break;
     case sldatatimestampdst:
-    	if (c == 'W') { parser_v.timestamp.dst = 1; parser_state = sldatatimestampend; }
-    	else if (c == 'S') { parser_v.timestamp.dst = 2; parser_state = sldatatimestampend; }
-    	else if (c == ')') { parser_store_timestamp(); parser_state = sldatanone; }
-		else parser_state = slerror;
+    	if (c == 'W') { p->v.timestamp.dst = 1; p->state = sldatatimestampend; }
+    	else if (c == 'S') { p->v.timestamp.dst = 2; p->state = sldatatimestampend; }
+    	else if (c == ')') { parser_store_timestamp(p); p->state = sldatanone; }
+		else p->state = slerror;
     	break;
     case sldatatimestampend:
-    	if (c == ')') { parser_store_timestamp(); parser_state = sldatanone; }
-		else parser_state = slerror;
+    	if (c == ')') { parser_store_timestamp(p); p->state = sldatanone; }
+		else p->state = slerror;
     	break;
 	// end
     case seend: // either CRC or CR
 		DEBUGLOG("End of packet");
-		if (c == '\r') parser_state = self;
-		else parser_state = secrc2;
-		break;
+		if (c == '\r') { p->crc_received = p->crc; p->state = self; break; } // DSMR 2.2 / 3.0 have no CRC
+		p->crc_received = 0;
+		// fall through
     case secrc2:
-		parser_state = secrc3;
-		break;
     case secrc3:
-		parser_state = secrc4;
-		break;
     case secrc4:
-		parser_state = self;
+		digit = parser_hex_digit(c);
+		if (digit < 16) {
+			p->crc_received = (p->crc_received << 4) | digit;
+			p->state = (p->state == seend) ? secrc2 : p->state + 1;
+		} else {
+			DEBUGLOG("Invalid CRC digit");
+			if (p->error) p->error(p->user);
+			p->state = sreset;
+		}
 		break;
     case self:
-		if (parser_packet_received) parser_packet_received(&dsmr);
-		parser_state = sreset;
+		if (p->crc_received != p->crc) {
+			DEBUGLOG("CRC mismatch %04X != %04X", p->crc_received, p->crc);
+			if (p->error) p->error(p->user);
+		}
+		else {
+			// Publish, the other buffer is filled by the next telegram
+			struct dsmr_data_t* latest = p->data;
+			latest->changed = parser_changed_fields(latest, p->latest);
+			p->latest = latest;
+			p->data = (latest == &p->dsmr[0]) ? &p->dsmr[1] : &p->dsmr[0];
+			if (p->packet_received) p->packet_received(p->user, latest);
+		}
+		p->state = sreset;
 		break;
     case sreset:
 		// ignore
 		break;
     default:
-		DEBUGLOG("Invalid state %d", parser_state);
-		parser_state = sreset;
+		DEBUGLOG("Invalid state %d", p->state);
+		p->state = sreset;
 		break;
     }
+    if (p->state == slerror && prev_state != slerror) DEBUGLOG("Line error");
 #	undef is_digit
 }
+
+void Meter_Parser_ParseBuffer(struct dsmr_parser_t* p, const char* buffer, size_t length)
+{
+	const char* end = buffer + length;
+	while (buffer != end)
+	{
+		switch (p->state)
+		{
+		case sreset: // only start of packet is relevant
+			buffer = memchr(buffer, '/', (size_t)(end - buffer));
+			if (buffer == NULL)
+				return;
+			break;
+		case shstart:    // wait for CR
+		case slerror:    // wait for CR
+		case sldatanone: // wait for CR or (
+		case sldataunit: // wait for )
+		{
+			// Skip content that does not change state, e.g. text messages,
+			// equipment identifiers and event logs. Only the CRC is updated.
+			uint16_t crc = p->crc;
+			while (buffer != end)
+			{
+				char c = *buffer;
+				if (c == '\r' || c == '(' || c == ')' || c == '/')
+					break;
+				crc = parser_crc_update(crc, c);
+				buffer++;
+			}
+			p->crc = crc;
+			if (buffer == end)
+				return;
+		}
+			break;
+		default:
+			break;
+		}
+		Meter_Parser_Parse(p, *buffer++);
+	}
+}
+
+const struct dsmr_data_t* Meter_Parser_GetLatest(const struct dsmr_parser_t* p)
+{
+	return p->latest;
+}
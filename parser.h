@@ -4,12 +4,54 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-struct dsmr_data_t;
+#include "dsmr.h"
+#include <stddef.h>
 
-void Meter_Parser_Reset();
-void Meter_Parser_Parse(char c);
+// Parser context, one per P1 stream. All state is kept here, so
+// independent streams can be parsed concurrently (e.g. on different
+// threads) without locking.
+struct dsmr_parser_t {
+	uint8_t state; // enum parser_state_t
+	uint16_t obis_a, obis_b, obis_c, obis_d, obis_e, obis_f, obis_field;
+	uint16_t crc, crc_received;
 
-void Meter_Parser_SetReceivedHandler(void(*parser_packet_received)(struct dsmr_data_t*));
-void Meter_Parser_SetErrorHandler(void(*parser_error)(void));
+	union {
+		struct {
+			uint32_t uint;
+			uint8_t decimal;
+			uint8_t size; // 0 = uint32, 1 = uint8, 2 = uint16
+		};
+		struct dsmr_timestamp_t timestamp;
+	} v;
+	union {
+		uint8_t* uint8;
+		uint32_t* uint32;
+		struct dsmr_timestamp_t* timestamp;
+	} set;
+	uint32_t set_field; // DSMR_FIELD_MASK of value being parsed
+
+	// Double buffered: data is filled while parsing, latest is the last
+	// complete telegram with valid CRC. The pointer swap is a single word
+	// write, so readers always see a consistent snapshot.
+	struct dsmr_data_t dsmr[2];
+	struct dsmr_data_t* data;
+	const struct dsmr_data_t* volatile latest;
+
+	void(*packet_received)(void* user, const struct dsmr_data_t*);
+	void(*error)(void* user);
+	void* user;
+};
+
+void Meter_Parser_Init(struct dsmr_parser_t* parser,
+	void(*packet_received)(void* user, const struct dsmr_data_t*),
+	void(*error)(void* user),
+	void* user);
+void Meter_Parser_Reset(struct dsmr_parser_t* parser);
+void Meter_Parser_Parse(struct dsmr_parser_t* parser, char c);
+void Meter_Parser_ParseBuffer(struct dsmr_parser_t* parser, const char* buffer, size_t length);
+
+// Last complete telegram (NULL if none yet). It is not modified until a
+// newer telegram is published and yet another telegram is started.
+const struct dsmr_data_t* Meter_Parser_GetLatest(const struct dsmr_parser_t* parser);
 
 #endif // PARSER_H
@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "power.h"
+#include "eventlog.h"
+
+// Event log period, one hour
+#define POWER_LOG_TICKS (3600ul * 32768ul)
+
+static struct power_stats_t power_stats;
+static enum POWER_STATE_T power_state = POWER_STATE_ACTIVE;
+static uint32 power_since = 0;                  // tick of last accounting
+static uint8 power_loads = 0;                   // mask of POWER_LOAD_T
+static volatile uint8 power_woken = 0;          // no interrupt since wake-up
+static uint32 power_logged = 0;
+
+static uint32 Power_Now()
+{
+    return CySysWdtGetCount(CY_SYS_WDT_COUNTER2);
+}
+
+// Add time since the last accounting to the current state and loads
+static void Power_Account()
+{
+    uint32 now = Power_Now();
+    uint32 elapsed = now - power_since;
+    power_since = now;
+    power_stats.state_ticks[power_state] += elapsed;
+    for (uint32 load = 0; load < POWER_LOAD_COUNT; ++load)
+    {
+        if (power_loads & (1u << load))
+            power_stats.load_ticks[load] += elapsed;
+    }
+}
+
+void Power_Start()
+{
+    power_since = power_logged = Power_Now();
+}
+
+void Power_Sleep(enum POWER_STATE_T state)
+{
+    if (power_woken)
+    {
+        // No known interrupt handler ran since the last wake-up
+        power_woken = 0;
+        power_stats.wakeups[POWER_WAKEUP_OTHER]++;
+        power_stats.last_wakeup = POWER_WAKEUP_OTHER;
+    }
+    Power_Account();
+    power_state = state;
+}
+
+void Power_Wake()
+{
+    Power_Account();
+    power_state = POWER_STATE_ACTIVE;
+    power_woken = 1;
+}
+
+void Power_Wakeup(enum POWER_WAKEUP_T reason)
+{
+    if (power_woken)
+    {
+        power_woken = 0;
+        power_stats.wakeups[reason]++;
+        power_stats.last_wakeup = reason;
+    }
+}
+
+void Power_SetLoad(enum POWER_LOAD_T load, uint8 on)
+{
+    uint8 intStatus = CyEnterCriticalSection();
+    Power_Account();
+    if (on)
+        power_loads |= 1u << load;
+    else
+        power_loads &= ~(1u << load);
+    CyExitCriticalSection(intStatus);
+}
+
+const struct power_stats_t* Power_GetStats()
+{
+    uint8 intStatus = CyEnterCriticalSection();
+    Power_Account();
+    CyExitCriticalSection(intStatus);
+    return &power_stats;
+}
+
+// Residency of each state in per mille since start
+void Power_Log()
+{
+    const struct power_stats_t* stats = Power_GetStats();
+    uint64 total = 0;
+    for (uint32 state = 0; state < POWER_STATE_COUNT; ++state)
+        total += stats->state_ticks[state];
+    if (total == 0)
+        return;
+    for (uint32 state = 0; state < POWER_STATE_COUNT; ++state)
+        EventLog_Add(EVENTLOG_POWER_RESIDENCY, state | (uint32)(stats->state_ticks[state] * 1000 / total) << 8);
+}
+
+void Power_ProcessEvents()
+{
+    if (Power_Now() - power_logged >= POWER_LOG_TICKS)
+    {
+        power_logged += POWER_LOG_TICKS;
+        Power_Log();
+    }
+}
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <project.h>
+
+// Residency counters, in WDT2 (LFCLK, 32768 Hz) ticks. Short active
+// periods are below one tick, these are counted statistically: on average
+// the tick difference equals the duration.
+
+enum POWER_STATE_T {
+    POWER_STATE_ACTIVE,
+    POWER_STATE_SLEEP,          // CPU sleep, system clock divided
+    POWER_STATE_SLEEP_ECO,      // CPU sleep, IMO stopped (HFCLK from ECO)
+    POWER_STATE_DEEPSLEEP,
+    POWER_STATE_COUNT
+};
+
+// Peripherals drawing current independent of the CPU state
+enum POWER_LOAD_T {
+    POWER_LOAD_REQUEST,         // meter request line (RTS)
+    POWER_LOAD_UART,            // meter UART
+    POWER_LOAD_COUNT
+};
+
+// First interrupt after a sleep. The BLE interrupt is inside the
+// component, so BLE wake-ups count as other.
+enum POWER_WAKEUP_T {
+    POWER_WAKEUP_TIMER,         // WDT0, meter schedule
+    POWER_WAKEUP_UART,          // meter data
+    POWER_WAKEUP_OTHER,
+    POWER_WAKEUP_COUNT
+};
+
+struct power_stats_t {
+    uint64 state_ticks[POWER_STATE_COUNT];
+    uint64 load_ticks[POWER_LOAD_COUNT];
+    uint32 wakeups[POWER_WAKEUP_COUNT];
+    uint8 last_wakeup;          // POWER_WAKEUP_T
+};
+
+void Power_Start();
+void Power_Sleep(enum POWER_STATE_T state); // before sleeping, interrupts disabled
+void Power_Wake();                          // after waking, interrupts disabled
+void Power_Wakeup(enum POWER_WAKEUP_T reason); // from interrupt handlers
+void Power_SetLoad(enum POWER_LOAD_T load, uint8 on);
+const struct power_stats_t* Power_GetStats();  // counted up to now
+void Power_Log();                           // residency to the event log
+void Power_ProcessEvents();                 // call from main loop, hourly log
+
+#endif // POWER_H
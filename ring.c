@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "ring.h"
+
+void Ring_Init(struct ring_t* ring, volatile uint8_t* buffer, uint16_t size)
+{
+	// size must be a power of 2, at most 32768 with 16-bit indices
+	ring->data = buffer;
+	ring->mask = size - 1;
+	ring->head = ring->tail = 0;
+	ring->overrun = 0;
+	ring->stats.received = ring->stats.dropped = ring->stats.overruns = ring->stats.errors = 0;
+	ring->stats.high_water = 0;
+	ring->stats.size = size;
+}
+
+int Ring_Put(struct ring_t* ring, uint8_t c)
+{
+	uint16_t head = ring->head;
+	uint16_t used = (uint16_t)(head - ring->tail);
+	if (ring->overrun || used > ring->mask)
+	{
+		// Full, or waiting for consumer to reach the gap
+		if (!ring->overrun)
+		{
+			ring->overrun = 1;
+			ring->stats.overruns++;
+		}
+		ring->stats.dropped++;
+		return 0;
+	}
+	ring->data[head & ring->mask] = c;
+	ring->head = head + 1; // publish after data is written
+	ring->stats.received++;
+	if (used + 1 > ring->stats.high_water)
+		ring->stats.high_water = used + 1;
+	return 1;
+}
+
+void Ring_Gap(struct ring_t* ring)
+{
+	ring->stats.errors++;
+	if (!ring->overrun)
+	{
+		ring->overrun = 1;
+		ring->stats.overruns++;
+	}
+}
+
+size_t Ring_Peek(const struct ring_t* ring, const uint8_t** data)
+{
+	uint16_t tail = ring->tail;
+	uint16_t used = (uint16_t)(ring->head - tail);
+	uint16_t offset = tail & ring->mask;
+	uint16_t contiguous = ring->mask + 1 - offset;
+	*data = (const uint8_t*)ring->data + offset;
+	return used < contiguous ? used : contiguous;
+}
+
+void Ring_Consume(struct ring_t* ring, size_t length)
+{
+	ring->tail = ring->tail + (uint16_t)length;
+}
+
+void Ring_Flush(struct ring_t* ring)
+{
+	ring->tail = ring->head;
+	ring->overrun = 0;
+}
+
+int Ring_Resync(struct ring_t* ring)
+{
+	// Head does not move during an overrun, so all data before the gap is
+	// consumed when empty
+	if (!ring->overrun || !Ring_Empty(ring))
+		return 0;
+	ring->overrun = 0;
+	return 1;
+}
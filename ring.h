@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Single producer (ISR) / single consumer (main loop) byte ring, without
+// locking. The producer only writes head, the consumer only writes tail.
+// When full, the producer drops bytes and marks an overrun. Nothing is
+// stored until the consumer reached that point and resynchronized, so the
+// gap is always at the end of the buffered data.
+
+struct ring_stats_t {
+	uint32_t received;      // bytes stored
+	uint32_t dropped;       // bytes lost due to overruns
+	uint32_t overruns;      // number of overruns (gaps)
+	uint32_t errors;        // bytes lost before the ring (Ring_Gap)
+	uint16_t high_water;    // maximum bytes buffered
+	uint16_t size;
+};
+
+struct ring_t {
+	volatile uint8_t* data;
+	uint16_t mask;              // size - 1, size is a power of 2
+	volatile uint16_t head;     // free running, written by producer
+	volatile uint16_t tail;     // free running, written by consumer
+	volatile uint8_t overrun;   // set by producer, cleared by consumer
+	struct ring_stats_t stats;  // written by producer
+};
+
+void Ring_Init(struct ring_t* ring, volatile uint8_t* buffer, uint16_t size);
+
+// Producer: store byte, returns 0 when dropped (overrun)
+int Ring_Put(struct ring_t* ring, uint8_t c);
+// Producer: bytes were lost before reaching the ring (e.g. hardware FIFO
+// overflow), handled as an overrun at this point
+void Ring_Gap(struct ring_t* ring);
+
+// Consumer
+static inline int Ring_Empty(const struct ring_t* ring)
+{
+	return ring->head == ring->tail;
+}
+size_t Ring_Peek(const struct ring_t* ring, const uint8_t** data); // contiguous bytes
+void Ring_Consume(struct ring_t* ring, size_t length);
+void Ring_Flush(struct ring_t* ring);   // discard all, only while producer is stopped
+int Ring_Resync(struct ring_t* ring);   // returns 1 once, when the gap of an overrun is reached
+
+#endif // RING_H
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "schedule.h"
+
+enum schedule_mode_t {
+	SCHEDULE_MODE_WIDE,     // period unknown, wait for any telegram
+	SCHEDULE_MODE_LEARN,    // one telegram seen, wait for the next one
+	SCHEDULE_MODE_LOCKED    // period and phase known
+};
+
+#define SCHEDULE_AFTER(a, b) ((int32_t)((a) - (b)) >= 0)
+
+static void schedule_close(struct meter_schedule_t* s, uint32_t now)
+{
+	s->receiving = 0;
+	s->window_last = now - s->open;
+	s->window_total += s->window_last;
+}
+
+// Start of predicted telegram nearest to the target
+static uint32_t schedule_predict(const struct meter_schedule_t* s, uint32_t now)
+{
+	uint32_t distance = s->target - s->phase;
+	uint32_t predicted = s->phase + (distance + s->period / 2) / s->period * s->period;
+	// Processing might be late for short periods, use a later telegram
+	while (!SCHEDULE_AFTER(predicted - SCHEDULE_LEAD, now))
+		predicted += s->period;
+	return predicted;
+}
+
+static uint32_t schedule_nominal(uint32_t period)
+{
+	static const uint32_t nominal[] = { SCHEDULE_MS(1000), SCHEDULE_MS(10000) };
+	for (unsigned i = 0; i < sizeof(nominal) / sizeof(nominal[0]); ++i)
+	{
+		uint32_t error = period > nominal[i] ? period - nominal[i] : nominal[i] - period;
+		if (error < nominal[i] / 20)
+			return nominal[i];
+	}
+	return period;
+}
+
+void Meter_Schedule_Init(struct meter_schedule_t* s, uint32_t now)
+{
+	s->mode = SCHEDULE_MODE_WIDE;
+	s->receiving = 1;
+	s->misses = 0;
+	s->open = now;
+	s->next = now + SCHEDULE_WIDE_WINDOW;
+	s->period = 0;
+	s->phase = now;
+	s->target = now;
+	s->interval = SCHEDULE_MS(30000);
+	s->window_last = s->window_total = s->misses_total = 0;
+}
+
+uint32_t Meter_Schedule_Next(const struct meter_schedule_t* s)
+{
+	return s->next;
+}
+
+void Meter_Schedule_SetInterval(struct meter_schedule_t* s, uint32_t interval, uint32_t now)
+{
+	s->interval = interval;
+	if (s->receiving || SCHEDULE_AFTER(now + interval, s->next))
+		return;
+	// Sleeping longer than the new interval, read earlier
+	s->target = now + interval;
+	s->next = s->mode == SCHEDULE_MODE_LOCKED ? schedule_predict(s, now) - SCHEDULE_LEAD : s->target;
+}
+
+uint32_t Meter_Schedule_Window(const struct meter_schedule_t* s)
+{
+	// Learning completes with the next telegram
+	return s->mode != SCHEDULE_MODE_WIDE ? SCHEDULE_LEAD + SCHEDULE_LATE : SCHEDULE_WIDE_WINDOW;
+}
+
+uint8_t Meter_Schedule_Timeout(struct meter_schedule_t* s, uint32_t now, uint8_t started)
+{
+	if (!s->receiving)
+	{
+		// Wake up, open receive window
+		s->receiving = 1;
+		s->open = now;
+		if (s->mode == SCHEDULE_MODE_LOCKED)
+			s->next = schedule_predict(s, now) + SCHEDULE_LATE;
+		else
+			s->next = now + SCHEDULE_WIDE_WINDOW;
+		return 1;
+	}
+
+	switch (s->mode)
+	{
+	case SCHEDULE_MODE_LOCKED:
+		if (started && now - s->open < SCHEDULE_WIDE_WINDOW)
+		{
+			// Telegram in progress (or corrupted), wait within the wide window
+			s->next = s->open + SCHEDULE_WIDE_WINDOW;
+			return 1;
+		}
+		// Missed prediction (meter clock jump, power cycle), continue wide
+		s->misses++;
+		s->misses_total++;
+		s->mode = SCHEDULE_MODE_WIDE;
+		s->next = now + SCHEDULE_WIDE_WINDOW;
+		return 1;
+	case SCHEDULE_MODE_LEARN:
+		// No second telegram, period unknown, retry next reading
+		schedule_close(s, now);
+		s->mode = SCHEDULE_MODE_WIDE;
+		s->next = SCHEDULE_AFTER(s->target, now) ? s->target : now;
+		return 0;
+	default:
+		// No telegram at all
+		schedule_close(s, now);
+		s->next = now + (s->interval > SCHEDULE_WIDE_WINDOW ? s->interval - SCHEDULE_WIDE_WINDOW : 0);
+		return 0;
+	}
+}
+
+uint8_t Meter_Schedule_Received(struct meter_schedule_t* s, uint32_t start, uint32_t now, uint32_t delay)
+{
+	if (!s->receiving)
+		return 0;
+
+	uint32_t distance = start - s->phase;
+	s->target = start + delay;
+
+	switch (s->mode)
+	{
+	case SCHEDULE_MODE_WIDE:
+		// Need a second telegram to learn the period
+		s->mode = SCHEDULE_MODE_LEARN;
+		s->phase = start;
+		s->next = start + SCHEDULE_MAX_PERIOD;
+		return 1;
+	case SCHEDULE_MODE_LEARN:
+		if (distance < SCHEDULE_MIN_PERIOD || distance > SCHEDULE_MAX_PERIOD)
+		{
+			// Not consecutive telegrams, restart learning from this one
+			s->phase = start;
+			s->next = start + SCHEDULE_MAX_PERIOD;
+			return 1;
+		}
+		// Single distance includes jitter of both telegrams, which is
+		// multiplied when predicting far ahead. Start at the nominal period.
+		s->period = schedule_nominal(distance);
+		break;
+	default:
+	{
+		// Refine period over the longer distance, averaging jitter
+		uint32_t k = (distance + s->period / 2) / s->period;
+		if (k > 0)
+		{
+			int32_t error = (int32_t)(distance / k - s->period);
+			s->period += error / 4;
+		}
+		s->misses = 0;
+		break;
+	}
+	}
+
+	s->mode = SCHEDULE_MODE_LOCKED;
+	s->phase = start;
+	schedule_close(s, now);
+	s->next = schedule_predict(s, now) - SCHEDULE_LEAD;
+	return 0;
+}
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+// Receive scheduler for the P1 request line. Learns the period (1 s for
+// DSMR 5, 10 s for DSMR 4) and phase of the telegrams, so the request line
+// is only raised just before the predicted telegram. Falls back to a wide
+// receive window when a prediction is missed.
+//
+// Time is in ticks of a free running 32-bit clock (LFCLK on target, a
+// virtual clock in the host test). All comparisons are wrap-around safe.
+
+#define SCHEDULE_TICKS_PER_SECOND 32768u
+#define SCHEDULE_MS(ms) ((uint32_t)((uint64_t)(ms) * SCHEDULE_TICKS_PER_SECOND / 1000u))
+
+#define SCHEDULE_WIDE_WINDOW SCHEDULE_MS(10000)   // wait for any telegram
+#define SCHEDULE_MAX_PERIOD SCHEDULE_MS(12000)    // DSMR 4 is 10 s
+#define SCHEDULE_MIN_PERIOD SCHEDULE_MS(500)      // DSMR 5 is 1 s
+#define SCHEDULE_LEAD SCHEDULE_MS(50)             // request before predicted start
+#define SCHEDULE_LATE SCHEDULE_MS(100)            // after predicted start, miss
+
+struct meter_schedule_t {
+	uint8_t mode;           // enum schedule_mode_t
+	uint8_t receiving;      // request line should be active
+	uint8_t misses;         // consecutive missed predictions
+	uint32_t next;          // tick of next Meter_Schedule_Timeout
+	uint32_t open;          // tick the receive window was opened
+	uint32_t period;        // learned telegram period, 0 if unknown
+	uint32_t phase;         // start of last telegram received
+	uint32_t target;        // desired start of next reading
+	uint32_t interval;      // time between readings, when no telegram
+
+	// Statistics
+	uint32_t window_last;   // ticks request active last reception
+	uint32_t window_total;  // ticks request active since init
+	uint32_t misses_total;
+};
+
+void Meter_Schedule_Init(struct meter_schedule_t* s, uint32_t now);
+
+// Next time Meter_Schedule_Timeout must be called
+uint32_t Meter_Schedule_Next(const struct meter_schedule_t* s);
+
+// Time of Meter_Schedule_Next passed. Started is set when the start of a
+// telegram was received in this window. Returns 1 if receiving.
+uint8_t Meter_Schedule_Timeout(struct meter_schedule_t* s, uint32_t now, uint8_t started);
+
+// Change time between readings, takes effect immediately when sleeping.
+void Meter_Schedule_SetInterval(struct meter_schedule_t* s, uint32_t interval, uint32_t now);
+
+// Expected time the request is active per reading
+uint32_t Meter_Schedule_Window(const struct meter_schedule_t* s);
+
+// Telegram with valid CRC. Start is the tick the '/' was received, delay
+// the desired time until the next reading. Returns 1 if receiving
+// continues (to learn the period).
+uint8_t Meter_Schedule_Received(struct meter_schedule_t* s, uint32_t start, uint32_t now, uint32_t delay);
+
+#endif // SCHEDULE_H
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "snapshot.h"
+#include "dsmr.h"
+
+static uint8_t* snapshot_put_uint32(uint8_t* p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+    return p + 4;
+}
+
+static uint8_t* snapshot_put_uint32s(uint8_t* p, const uint32_t* values, int count)
+{
+    while (count--)
+        p = snapshot_put_uint32(p, *values++);
+    return p;
+}
+
+static uint8_t* snapshot_put_timestamp(uint8_t* p, const struct dsmr_timestamp_t* ts)
+{
+    *p++ = (uint8_t)ts->year;
+    *p++ = (uint8_t)(ts->year >> 8);
+    *p++ = ts->month;
+    *p++ = ts->day;
+    *p++ = ts->hour;
+    *p++ = ts->minute;
+    *p++ = ts->second;
+    *p++ = ts->dst;
+    return p;
+}
+
+uint16_t Snapshot_Pack(const struct dsmr_data_t* data, uint8_t* buffer)
+{
+    uint8_t* p = buffer;
+    *p++ = SNAPSHOT_VERSION;
+    p = snapshot_put_uint32(p, data->present);
+    p = snapshot_put_timestamp(p, &data->timestamp);
+    *p++ = (uint8_t)data->tariff;
+    p = snapshot_put_uint32s(p, data->E_in, MAX_TARIFFS);
+    p = snapshot_put_uint32s(p, data->E_out, MAX_TARIFFS);
+    p = snapshot_put_uint32(p, data->P_in_total);
+    p = snapshot_put_uint32(p, data->P_out_total);
+    p = snapshot_put_uint32(p, data->P_threshold);
+    p = snapshot_put_uint32s(p, data->I, MAX_PHASES);
+    p = snapshot_put_uint32s(p, data->V, MAX_PHASES);
+    p = snapshot_put_uint32s(p, data->P_in, MAX_PHASES);
+    p = snapshot_put_uint32s(p, data->P_out, MAX_PHASES);
+    p = snapshot_put_timestamp(p, &data->gas_timestamp);
+    p = snapshot_put_uint32(p, data->gas_in);
+    p = snapshot_put_uint32(p, data->P_demand);
+    p = snapshot_put_timestamp(p, &data->P_demand_max_timestamp);
+    p = snapshot_put_uint32(p, data->P_demand_max);
+    return (uint16_t)(p - buffer);
+}
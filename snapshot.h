@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+struct dsmr_data_t;
+
+/*
+Full snapshot characteristic payload, little endian, packed:
+
+offset size
+     0    1  version (SNAPSHOT_VERSION)
+     1    4  present, DSMR_FIELD_MASK of fields in the telegram
+     5    8  timestamp (year:2, month, day, hour, minute, second, dst)
+    13    1  tariff
+    14   16  E_in[2], E_out[2]                     (Wh)
+    30   12  P_in_total, P_out_total, P_threshold  (W)
+    42   48  I[3], V[3], P_in[3], P_out[3]         (mA, mV, W)
+    90    8  gas_timestamp
+    98    4  gas_in                                (dm3)
+   102    4  P_demand                              (W, version 2)
+   106    8  P_demand_max_timestamp
+   114    4  P_demand_max                          (W)
+
+Fields not present are 0xFFFFFFFF (or zero timestamp), as in the other
+characteristics. Newer versions only append fields.
+*/
+#define SNAPSHOT_VERSION    2
+#define SNAPSHOT_SIZE       118
+
+// Needs SNAPSHOT_SIZE bytes, returns number of bytes written
+uint16_t Snapshot_Pack(const struct dsmr_data_t* data, uint8_t* buffer);
+
+#endif // SNAPSHOT_H
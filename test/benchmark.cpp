@@ -0,0 +1,97 @@
+extern "C" {
+#include "parser.h"
+#include "dsmr.h"
+}
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+static const char* cycles_unit = "cycles";
+#else
+static uint64_t cycles()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+static const char* cycles_unit = "ns";
+#endif
+
+#ifndef DSMR_EXAMPLE_DIR
+#  define DSMR_EXAMPLE_DIR "../dsrm-example"
+#endif
+
+static const int iterations = 20000;
+
+struct counters_t
+{
+	unsigned received, errors;
+};
+
+static void received_handler(void* user, const struct dsmr_data_t*) { ((counters_t*)user)->received++; }
+static void error_handler(void* user) { ((counters_t*)user)->errors++; }
+
+// Example files are stored with LF line endings, P1 uses CR LF
+static std::string load(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	std::ostringstream s;
+	s << file.rdbuf();
+	std::string telegram;
+	for (char c : s.str())
+	{
+		if (c == '\n')
+			telegram += '\r';
+		telegram += c;
+	}
+	return telegram;
+}
+
+static double bench_char(struct dsmr_parser_t* parser, const std::string& telegram)
+{
+	uint64_t start = cycles();
+	for (int i = 0; i < iterations; ++i)
+	{
+		for (char c : telegram)
+			Meter_Parser_Parse(parser, c);
+	}
+	return (double)(cycles() - start) / iterations / telegram.size();
+}
+
+static double bench_buffer(struct dsmr_parser_t* parser, const std::string& telegram)
+{
+	uint64_t start = cycles();
+	for (int i = 0; i < iterations; ++i)
+	{
+		Meter_Parser_ParseBuffer(parser, telegram.data(), telegram.size());
+	}
+	return (double)(cycles() - start) / iterations / telegram.size();
+}
+
+int main()
+{
+	const char* examples[] = { "p1-example-3.0.txt", "p1-example-4.0.txt", "p1-example-5.0.txt" };
+	for (const char* example : examples)
+	{
+		std::string telegram = load(std::string(DSMR_EXAMPLE_DIR) + "/" + example);
+		if (telegram.empty())
+		{
+			std::cout << example << ": not found" << std::endl;
+			return 1;
+		}
+
+		counters_t counters = {};
+		struct dsmr_parser_t parser;
+		Meter_Parser_Init(&parser, &received_handler, &error_handler, &counters);
+		double per_char = bench_char(&parser, telegram);
+		double per_buffer = bench_buffer(&parser, telegram);
+
+		printf("%s: %zu bytes, Parse %.2f %s/byte, ParseBuffer %.2f %s/byte (received %u, errors %u)\n",
+				example, telegram.size(), per_char, cycles_unit, per_buffer, cycles_unit, counters.received, counters.errors);
+	}
+}
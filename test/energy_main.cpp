@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Energy model over a trace written by dsmr_sim -t, to compare model
+// parameters (energy.h) on the same firmware run.
+//
+// dsmr_energy [-m parameter=value]... [--battery mAh] [trace_file]
+//
+// Reads standard input without a trace file.
+
+#include "energy.h"
+#include "sim.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+int main(int argc, char** argv)
+{
+	energy_model_t model = energy_model_default;
+	double battery = 0;
+	FILE* file = stdin;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+		if (arg == "-m" && value)
+		{
+			if (!Energy_SetParameter(&model, argv[++i]))
+			{
+				fprintf(stderr, "Unknown model parameter %s\n", argv[i]);
+				return 2;
+			}
+		}
+		else if (arg == "--battery" && value)
+			battery = atof(argv[++i]);
+		else if (arg[0] == '-' || file != stdin)
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 2;
+		}
+		else if ((file = fopen(argv[i], "r")) == nullptr)
+		{
+			fprintf(stderr, "Cannot read %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	energy_t energy;
+	Energy_Init(&energy, &model);
+	unsigned long long time;
+	char name[32];
+	unsigned value;
+	bool end = false;
+	for (unsigned line = 1; !end; ++line)
+	{
+		int fields = fscanf(file, "%llu %31s %u", &time, name, &value);
+		if (fields == EOF)
+			break;
+		sim_signal_t signal = Sim_SignalFromName(name);
+		if (fields != 3 || (signal == SIM_SIGNAL_COUNT && std::string(name) != "end"))
+		{
+			fprintf(stderr, "Invalid trace at line %u\n", line);
+			return 2;
+		}
+		end = signal == SIM_SIGNAL_COUNT;
+		Energy_Trace(sim_trace_t{ time, signal, value }, &energy);
+	}
+	if (!end)
+	{
+		fprintf(stderr, "Trace is incomplete\n");
+		return 2;
+	}
+	Energy_Print(stdout, &energy, battery);
+	return 0;
+}
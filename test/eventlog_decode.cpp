@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "eventlog_decode.h"
+
+namespace {
+	const char* name(uint8 id)
+	{
+		switch ((EVENTLOG_ID_T)id)
+		{
+		case EVENTLOG_LOST: return "Lost";
+		case EVENTLOG_START: return "Start";
+		case EVENTLOG_POWER_RESIDENCY: return "Residency";
+		case EVENTLOG_CONFIG_SAVE: return "Config save";
+		case EVENTLOG_BOND_SAVE: return "Bonding save";
+		case EVENTLOG_CONNECTION_PARAMETERS: return "Connection parameters";
+		case EVENTLOG_METER_OVERRUN: return "Receive overrun";
+		case EVENTLOG_METER_PARSE_FAILED: return "Parsing failed";
+		case EVENTLOG_BLE_UNKNOWN: return "CYBLE_???";
+		case EVENTLOG_BLE_STACK_ON: return "STACK_ON";
+		case EVENTLOG_BLE_TIMEOUT: return "TIMEOUT";
+		case EVENTLOG_BLE_HARDWARE_ERROR: return "HARDWARE_ERROR";
+		case EVENTLOG_BLE_HCI_STATUS: return "HCI_STATUS";
+		case EVENTLOG_BLE_STACK_BUSY: return "STACK_BUSY_STATUS";
+		case EVENTLOG_BLE_PENDING_FLASH_WRITE: return "PENDING_FLASH_WRITE";
+		case EVENTLOG_BLE_AUTH_REQ: return "GAP_AUTH_REQ";
+		case EVENTLOG_BLE_PASSKEY_ENTRY_REQUEST: return "GAP_PASSKEY_ENTRY_REQUEST";
+		case EVENTLOG_BLE_PASSKEY_DISPLAY_REQUEST: return "GAP_PASSKEY_DISPLAY_REQUEST";
+		case EVENTLOG_BLE_AUTH_COMPLETE: return "GAP_AUTH_COMPLETE";
+		case EVENTLOG_BLE_AUTH_FAILED: return "GAP_AUTH_FAILED";
+		case EVENTLOG_BLE_CONNECTED: return "GAP_DEVICE_CONNECTED";
+		case EVENTLOG_BLE_DISCONNECTED: return "GAP_DEVICE_DISCONNECTED";
+		case EVENTLOG_BLE_ENCRYPT_CHANGE: return "GAP_ENCRYPT_CHANGE";
+		case EVENTLOG_BLE_CONNECTION_UPDATE: return "GAP_CONNECTION_UPDATE_COMPLETE";
+		case EVENTLOG_BLE_KEYINFO_EXCHANGE: return "GAP_KEYINFO_EXCHNGE_CMPLT";
+		case EVENTLOG_BLE_DATA_LENGTH_CHANGE: return "GAP_DATA_LENGTH_CHANGE";
+		case EVENTLOG_BLE_ENHANCE_CONN_COMPLETE: return "GAP_ENHANCE_CONN_COMPLETE";
+		case EVENTLOG_BLE_NEGOTIATED_AUTH_INFO: return "GAP_SMP_NEGOTIATED_AUTH_INFO";
+		case EVENTLOG_BLE_ADVERTISEMENT_START_STOP: return "GAPP_ADVERTISEMENT_START_STOP";
+		case EVENTLOG_BLE_GATT_CONNECT: return "GATT_CONNECT_IND";
+		case EVENTLOG_BLE_GATT_DISCONNECT: return "GATT_DISCONNECT_IND";
+		case EVENTLOG_BLE_MTU: return "GATTS_XCNHG_MTU_REQ";
+		case EVENTLOG_BLE_READ: return "READ_CHAR_VAL_ACCESS_REQ";
+		case EVENTLOG_BLE_WRITE: return "GATTS_WRITE_(CMD)_REQ";
+		case EVENTLOG_BLE_PREP_WRITE: return "GATTS_PREP_WRITE_REQ";
+		case EVENTLOG_BLE_EXEC_WRITE: return "GATTS_EXEC_WRITE_REQ";
+		case EVENTLOG_BLE_HANDLE_VALUE_CNF: return "GATTS_HANDLE_VALUE_CNF";
+		case EVENTLOG_BLE_SIGNED_WRITE: return "GATTS_DATA_SIGNED_CMD_REQ";
+		case EVENTLOG_BLE_INDICATION_ENABLED: return "GATTS_INDICATION_ENABLED";
+		case EVENTLOG_BLE_INDICATION_DISABLED: return "GATTS_INDICATION_DISABLED";
+		case EVENTLOG_HISTORY_TRANSFER: return "History transfer";
+		case EVENTLOG_FLASHLOG_START: return "Flash log start";
+		case EVENTLOG_FLASHLOG_COMMIT: return "Flash log commit";
+		case EVENTLOG_METER_BURST: return "Burst end";
+		case EVENTLOG_CONNECTION_PARAMETERS_TIMEOUT: return "Connection parameters timeout";
+		case EVENTLOG_ID_COUNT: break;
+		}
+		return nullptr;
+	}
+
+	uint32 read32(const uint8* p)
+	{
+		return p[0] | (uint32)p[1] << 8 | (uint32)p[2] << 16 | (uint32)p[3] << 24;
+	}
+}
+
+void EventLogDecoder_Init(eventlog_decoder_t* decoder, FILE* out)
+{
+	*decoder = eventlog_decoder_t();
+	decoder->out = out;
+	decoder->pos = -1;
+}
+
+void EventLogDecoder_Put(eventlog_decoder_t* decoder, uint8 data)
+{
+	if (decoder->pos >= 0)
+	{
+		decoder->entry[decoder->pos++] = data;
+		if (decoder->pos == EVENTLOG_ENTRY_SIZE)
+		{
+			decoder->pos = -1;
+			EventLogDecoder_Entry(decoder, decoder->entry);
+		}
+	}
+	else if (data == EVENTLOG_SYNC)
+		decoder->pos = 0;
+	else if (data != '\r')
+		fputc(data, decoder->out);
+}
+
+void EventLogDecoder_Entry(eventlog_decoder_t* decoder, const uint8* entry)
+{
+	static const char* const states[] = { "active", "sleep", "sleep ECO", "deep sleep" };
+	const uint8 id = entry[0];
+	const uint32 tick = read32(entry + 1);
+	const uint32 arg = read32(entry + 5);
+	FILE* out = decoder->out;
+	decoder->entries++;
+
+	fprintf(out, "%11.5f ", tick / 32768.0);
+	if (name(id) == nullptr)
+	{
+		fprintf(out, "Unknown %u %lu\n", id, (unsigned long)arg);
+		return;
+	}
+	fputs(name(id), out);
+	switch ((EVENTLOG_ID_T)id)
+	{
+	case EVENTLOG_LOST:
+		decoder->lost += arg;
+		fprintf(out, " %lu entries", (unsigned long)arg);
+		break;
+	case EVENTLOG_POWER_RESIDENCY:
+		fprintf(out, " %s %lu.%lu%%", (arg & 0xFF) < 4 ? states[arg & 0xFF] : "?",
+			(unsigned long)(arg >> 8) / 10, (unsigned long)(arg >> 8) % 10);
+		break;
+	case EVENTLOG_CONFIG_SAVE:
+	case EVENTLOG_BOND_SAVE:
+	case EVENTLOG_FLASHLOG_COMMIT:
+		fprintf(out, " %ld", (long)(int32_t)arg);
+		break;
+	case EVENTLOG_CONNECTION_PARAMETERS:
+		fprintf(out, " interval %lu latency %lu", (unsigned long)(arg & 0xFFFF), (unsigned long)(arg >> 16));
+		break;
+	case EVENTLOG_METER_OVERRUN:
+		fprintf(out, " %lu, high water %lu", (unsigned long)(arg & 0xFFFF), (unsigned long)(arg >> 16));
+		break;
+	case EVENTLOG_HISTORY_TRANSFER:
+		fprintf(out, " %lu records", (unsigned long)arg);
+		break;
+	case EVENTLOG_METER_BURST:
+		fprintf(out, " %lu telegrams in %lu s", (unsigned long)(arg & 0xFFFF), (unsigned long)(arg >> 16));
+		break;
+	case EVENTLOG_FLASHLOG_START:
+		fprintf(out, " %lu rows", (unsigned long)arg);
+		break;
+	case EVENTLOG_BLE_UNKNOWN:
+	case EVENTLOG_BLE_READ:
+	case EVENTLOG_BLE_WRITE:
+	case EVENTLOG_BLE_INDICATION_ENABLED:
+	case EVENTLOG_BLE_INDICATION_DISABLED:
+		fprintf(out, " 0x%lx", (unsigned long)arg);
+		break;
+	case EVENTLOG_BLE_STACK_BUSY:
+	case EVENTLOG_BLE_ENCRYPT_CHANGE:
+	case EVENTLOG_CONNECTION_PARAMETERS_TIMEOUT:
+	case EVENTLOG_BLE_MTU:
+		fprintf(out, " %lu", (unsigned long)arg);
+		break;
+	default:
+		break;
+	}
+	fputc('\n', out);
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Text of the firmware event log (eventlog.h), from the debug UART (text
+// with framed entries) or from reads of the event log characteristic.
+
+#ifndef EVENTLOG_DECODE_H
+#define EVENTLOG_DECODE_H
+
+extern "C" {
+#include "eventlog.h"
+}
+
+#include <cstdio>
+
+struct eventlog_decoder_t {
+	FILE* out;
+	uint8 entry[EVENTLOG_ENTRY_SIZE];
+	int pos;                // in entry, -1 for text
+	uint32 entries;
+	uint32 lost;
+};
+
+void EventLogDecoder_Init(eventlog_decoder_t* decoder, FILE* out);
+// Debug UART byte, text is copied
+void EventLogDecoder_Put(eventlog_decoder_t* decoder, uint8 data);
+// Entry without the sync byte
+void EventLogDecoder_Entry(eventlog_decoder_t* decoder, const uint8* entry);
+
+#endif // EVENTLOG_DECODE_H
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Decodes the firmware event log to text.
+//
+// dsmr_eventlog [file]       debug UART capture (dsmr_sim -l, or a serial port)
+// dsmr_eventlog -x [file]    hex of event log characteristic reads, one per
+//                            line starting with the sequence
+//
+// Reads standard input without a file.
+
+#include "eventlog_decode.h"
+
+#include <cctype>
+#include <string>
+
+int main(int argc, char** argv)
+{
+	bool hex = false;
+	FILE* file = stdin;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "-x")
+			hex = true;
+		else if (arg[0] == '-' || file != stdin)
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 2;
+		}
+		else if ((file = fopen(argv[i], "rb")) == nullptr)
+		{
+			fprintf(stderr, "Cannot read %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	eventlog_decoder_t decoder;
+	EventLogDecoder_Init(&decoder, stdout);
+	if (!hex)
+	{
+		for (int c; (c = fgetc(file)) != EOF; )
+			EventLogDecoder_Put(&decoder, (uint8)c);
+		return 0;
+	}
+
+	// Hex digits, a line per read, skipping its sequence (uint16)
+	const size_t sequence_size = 2;
+	uint8 entry[EVENTLOG_ENTRY_SIZE];
+	size_t length = 0;
+	size_t skip = sequence_size;
+	int high = -1;
+	for (int c; (c = fgetc(file)) != EOF; )
+	{
+		if (!isxdigit(c))
+		{
+			if (c == '\n')
+			{
+				length = 0;
+				skip = sequence_size;
+				high = -1;
+			}
+			continue;
+		}
+		int digit = isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+		if (high < 0)
+		{
+			high = digit;
+			continue;
+		}
+		entry[length++] = (uint8)(high << 4 | digit);
+		high = -1;
+		if (skip != 0)
+		{
+			skip--;
+			length = 0;
+		}
+		else if (length == EVENTLOG_ENTRY_SIZE)
+		{
+			EventLogDecoder_Entry(&decoder, entry);
+			length = 0;
+		}
+	}
+	return 0;
+}
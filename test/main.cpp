@@ -1,9 +1,27 @@
 extern "C" {
 #include "parser.h"
 #include "dsmr.h"
+#include "obis.h"
+#include "snapshot.h"
+#include "aggregate.h"
+#include "demand.h"
+#include "deadband.h"
+#include "beacon.h"
+#include "eventlog.h"
+#include "flashlog.h"
+#include "history.h"
+#include "schedule.h"
+#include "ring.h"
+#include "uartrx.h"
 }
+#include "sim.h"
+
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
 
 const char* input30 =
 "/ISk5\2MT382-1000\r\n"
@@ -57,7 +75,7 @@ const char* input40 =
 "0-1:96.1.0(3232323241424344313233343536373839)\r\n"
 "0-1:24.2.1(101209110000W)(12785.123*m3)\r\n"
 "0-1:24.4.0(1)\r\n"
-"!522B\r\n";
+"!5888\r\n";
 
 const char* input50 =
 "/ISk5\2MT382-1000\r\n"
@@ -97,20 +115,54 @@ const char* input50 =
 "0-1:24.1.0(003)\r\n"
 "0-1:96.1.0(3232323241424344313233343536373839)\r\n"
 "0-1:24.2.1(101209112500W)(12785.123*m3)\r\n"
-"!EF2F\r\n";
+"!C2AA\r\n";
 
+// Belgian e-MUCS meter, with capacity tariff fields. CRC set by with_crc.
+const char* inputbe =
+"/FLU5\\253769484_A\r\n"
+"\r\n"
+"0-0:96.1.4(50217)\r\n"
+"0-0:96.1.1(3153414733313031303231363035)\r\n"
+"0-0:1.0.0(200512135409S)\r\n"
+"1-0:1.8.1(000000.034*kWh)\r\n"
+"1-0:1.8.2(000015.758*kWh)\r\n"
+"1-0:2.8.1(000000.000*kWh)\r\n"
+"1-0:2.8.2(000000.011*kWh)\r\n"
+"1-0:1.4.0(02.351*kW)\r\n"
+"1-0:1.6.0(200509134558S)(02.589*kW)\r\n"
+"0-0:98.1.0(3)(1-0:1.6.0)(1-0:1.6.0)(200501000000S)(200423192538S)(03.695*kW)(200401000000S)(200305122139S)(05.980*kW)(200301000000S)(200210035421W)(04.318*kW)\r\n"
+"0-0:96.14.0(0001)\r\n"
+"1-0:1.7.0(00.000*kW)\r\n"
+"1-0:2.7.0(00.000*kW)\r\n"
+"1-0:21.7.0(00.000*kW)\r\n"
+"1-0:22.7.0(00.000*kW)\r\n"
+"1-0:32.7.0(234.7*V)\r\n"
+"1-0:31.7.0(000.00*A)\r\n"
+"0-0:96.3.10(1)\r\n"
+"0-0:17.0.0(999.9*kW)\r\n"
+"1-0:31.4.0(999*A)\r\n"
+"0-0:96.13.0()\r\n"
+"0-1:24.1.0(003)\r\n"
+"0-1:96.1.1(37464C4F32313139303333373333)\r\n"
+"0-1:24.4.0(1)\r\n"
+"0-1:24.2.3(200512134558S)(00112.384*m3)\r\n"
+"!0000\r\n";
 
 struct dsmr_data_t parsed_data;
 bool parsed_got_data;
 bool parsed_got_error;
 
-void parser_packet_received_handler(struct dsmr_data_t* data)
+struct dsmr_parser_t parser;
+
+void parser_packet_received_handler(void* user, const struct dsmr_data_t* data)
 {
+	(void)user;
 	parsed_data = *data;
 	parsed_got_data = true;
 }
-void parser_error_handler(void)
+void parser_error_handler(void* user)
 {
+	(void)user;
 	parsed_got_error = true;
 }
 
@@ -122,14 +174,20 @@ std::ostream& operator<<(std::ostream& os, struct dsmr_timestamp_t& timestamp)
 			<< "_" << (int)timestamp.dst;
 }
 
-void parse(const char* input)
+bool parse(const char* input, bool expect_data = true, size_t chunk = 0)
 {
-	Meter_Parser_Reset();
+	Meter_Parser_Reset(&parser);
 	parsed_got_data = parsed_got_error = false;
-	for (const char* i = input; *i != 0; ++i)
+	if (chunk)
+	{
+		// feed in chunks, as when reading from the ring buffer
+		for (size_t i = 0, len = strlen(input); i < len; i += chunk)
+			Meter_Parser_ParseBuffer(&parser, input + i, std::min(chunk, len - i));
+	}
+	else for (const char* i = input; *i != 0; ++i)
 	{
 //		std::cout << "    " << *i << std::endl;
-		Meter_Parser_Parse(*i);
+		Meter_Parser_Parse(&parser, *i);
 	}
 
 	std::cout <<  "Got data = " << (parsed_got_data ? "yes" : "no")
@@ -148,16 +206,919 @@ void parse(const char* input)
 	std::cout << "\tP_out       0: " << parsed_data.P_out[0] << "  1: " << parsed_data.P_out[1] << "  2: " << parsed_data.P_out[2] << std::endl;
 	std::cout << "\tG_timestamp " << parsed_data.gas_timestamp << std::endl;
 	std::cout << "\tG_in        " << parsed_data.gas_in << std::endl;
+
+	return parsed_got_data == expect_data && parsed_got_error != expect_data;
+}
+
+// Telegram with a corrupted digit in the power value, CRC no longer matches
+std::string corrupt(const char* input)
+{
+	std::string s(input);
+	s[s.find("1-0:1.7.0(") + 11] ^= 0x01;
+	return s;
+}
+
+// Two streams interleaved character by character on separate contexts
+bool parse_interleaved(const char* input_a, const char* input_b)
+{
+	struct result_t { struct dsmr_data_t data; int received; } result[2] = {};
+	auto received = [](void* user, const struct dsmr_data_t* data) {
+		result_t* r = (result_t*)user;
+		r->data = *data;
+		r->received++;
+	};
+	struct dsmr_parser_t a, b;
+	Meter_Parser_Init(&a, received, NULL, &result[0]);
+	Meter_Parser_Init(&b, received, NULL, &result[1]);
+	while (*input_a || *input_b)
+	{
+		if (*input_a) Meter_Parser_Parse(&a, *input_a++);
+		if (*input_b) Meter_Parser_Parse(&b, *input_b++);
+	}
+	bool ok = result[0].received == 1 && result[1].received == 1
+			&& result[0].data.P_threshold == 16100 && result[1].data.V[0] == 220100;
+	std::cout << "Interleaved = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// Last good snapshot remains readable while the next telegram is received
+// and when that telegram turns out to be corrupt
+bool check_snapshot()
+{
+	Meter_Parser_Reset(&parser);
+	for (const char* i = input50; *i != 0; ++i)
+		Meter_Parser_Parse(&parser, *i);
+	const struct dsmr_data_t* latest = Meter_Parser_GetLatest(&parser);
+	std::string corrupted = corrupt(input40);
+	bool ok = latest != NULL;
+	for (size_t i = 0; ok && i < corrupted.size(); ++i)
+	{
+		Meter_Parser_Parse(&parser, corrupted[i]);
+		ok = Meter_Parser_GetLatest(&parser) == latest
+				&& latest->P_in_total == 1193 && latest->V[2] == 220300;
+	}
+	std::cout << "Snapshot = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// Replace CRC of telegram with correct one
+std::string with_crc(std::string s)
+{
+	size_t end = s.find('!');
+	uint16_t crc = 0;
+	for (size_t i = 0; i <= end; ++i)
+	{
+		crc ^= (uint8_t)s[i];
+		for (int bit = 0; bit < 8; ++bit)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+	}
+	char hex[5];
+	snprintf(hex, sizeof(hex), "%04X", crc);
+	return s.replace(end + 1, 4, hex);
+}
+
+// Presence of fields, and only modified fields reported as changed
+bool check_changed()
+{
+	Meter_Parser_Init(&parser, &parser_packet_received_handler, &parser_error_handler, NULL);
+	bool ok = parse(input50) && parsed_data.changed == parsed_data.present
+			&& !(parsed_data.present & DSMR_FIELD_MASK(DSMR_FIELD_P_THRESHOLD))
+			&& (parsed_data.present & DSMR_FIELD_MASK(DSMR_FIELD_V3));
+	ok = ok && parse(input50) && parsed_data.changed == 0;
+
+	std::string modified(input50);
+	modified.replace(modified.find("(220.2*V)"), 9, "(221.2*V)");
+	ok = ok && parse(with_crc(modified).c_str()) && parsed_data.changed == DSMR_FIELD_MASK(DSMR_FIELD_V2);
+	std::cout << "Changed = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// Packed snapshot layout
+bool check_snapshot_pack()
+{
+	parse(input50);
+	uint8_t buffer[SNAPSHOT_SIZE + 16];
+	uint16_t size = Snapshot_Pack(&parsed_data, buffer);
+	auto get_uint32 = [&](int offset) {
+		return (uint32_t)buffer[offset] | (uint32_t)buffer[offset + 1] << 8
+				| (uint32_t)buffer[offset + 2] << 16 | (uint32_t)buffer[offset + 3] << 24;
+	};
+	bool ok = size == SNAPSHOT_SIZE && buffer[0] == SNAPSHOT_VERSION
+			&& get_uint32(1) == parsed_data.present
+			&& buffer[5] == (2010 & 0xFF) && buffer[6] == (2010 >> 8) && buffer[11] == 20
+			&& buffer[13] == 2 && get_uint32(14) == 123456789 && get_uint32(30) == 1193
+			&& get_uint32(42 + 3 * 4) == 220100 && get_uint32(98) == 12785123;
+	std::cout << "Snapshot pack = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// Capacity tariff fields of a Belgian meter, used as they are for the demand
+bool check_demand_meter()
+{
+	Demand_Reset();
+	bool ok = parse(with_crc(inputbe).c_str()) && parsed_data.P_demand == 2351 && parsed_data.P_demand_max == 2589
+			&& parsed_data.P_demand_max_timestamp.year == 2020 && parsed_data.P_demand_max_timestamp.month == 5
+			&& parsed_data.P_demand_max_timestamp.day == 9 && parsed_data.P_demand_max_timestamp.minute == 45
+			&& parsed_data.P_demand_max_timestamp.dst == 2
+			&& parsed_data.E_in[1] == 15758 && parsed_data.P_in_total == 0;
+	Demand_Add(&parsed_data);
+	const struct demand_t* demand = Demand_Get();
+	// 9:09 into the quarter, no consumption for the rest
+	ok = ok && demand->average == 2351 && demand->peak == 2589 && demand->elapsed == 549
+			&& demand->predicted == 2351 * 549 / 900
+			&& demand->flags == (DEMAND_FLAG_METER_AVERAGE | DEMAND_FLAG_METER_PEAK);
+	std::cout << "Demand meter = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// Demand computed from the counters with telegrams every 10 s, 3 s after
+// the quarter starts: 3600 W (1 Wh/s) from 12:07:03, 7200 W from 12:35.
+// The first quarter is incomplete, the second sets the monthly peak, which
+// is kept in the flash log.
+bool check_demand()
+{
+	struct dsmr_data_t data = {};
+	data.present = DSMR_FIELD_MASK(DSMR_FIELD_TIMESTAMP) | DSMR_FIELD_MASK(DSMR_FIELD_E_IN1)
+			| DSMR_FIELD_MASK(DSMR_FIELD_E_IN2) | DSMR_FIELD_MASK(DSMR_FIELD_P_IN_TOTAL);
+	data.timestamp = { 2021, 3, 10, 12, 0, 0, 1 };
+	auto at = [&](uint32_t second) {
+		data.timestamp.minute = (uint8_t)(second / 60);
+		data.timestamp.second = (uint8_t)(second % 60);
+		uint32_t change = 35 * 60;
+		data.E_in[0] = 1000000 + (second < change ? second : change + 2 * (second - change));
+		data.P_in_total = second < change ? 3600 : 7200;
+		Demand_Add(&data);
+		return Demand_Get();
+	};
+
+	FlashLog_Start();
+	Demand_Start();
+	bool ok = true;
+	const struct demand_t* demand = nullptr;
+	for (uint32_t second = 7 * 60 + 3; second < 30 * 60; second += 10)
+	{
+		demand = at(second);
+		ok = ok && demand->average == 3600 && demand->predicted == 3600 && demand->flags == 0
+				&& demand->peak == UINT32_MAX;
+	}
+	demand = at(30 * 60 + 3);
+	ok = ok && demand->peak == 3600 && demand->elapsed == 3;
+	for (uint32_t second = 30 * 60 + 13; second <= 37 * 60 + 33; second += 10)
+		demand = at(second);
+	// 300 Wh, then 153 s at 2 Wh/s in 453 s
+	uint32_t average = 606 * 3600 / 453;
+	ok = ok && demand->elapsed == 453 && demand->average == average
+			&& demand->predicted == (average * 453 + 7200 * 447) / 900 && demand->peak == 3600;
+
+	// The parser takes any two digits, an out of range month is ignored
+	data.timestamp.month = 13;
+	demand = at(37 * 60 + 43);
+	ok = ok && demand->elapsed == 453 && !History_ValidTime(&data) && History_Minutes(&data.timestamp) == 0;
+	data.timestamp.month = 3;
+
+	// After reset
+	Demand_ProcessEvents();
+	FlashLog_Commit();
+	FlashLog_ProcessEvents(1, 1);
+	FlashLog_Start();
+	Demand_Start();
+	demand = at(37 * 60 + 43);
+	ok = ok && demand->peak == 3600 && demand->average == 7200;
+	demand = at(37 * 60 + 53);
+	ok = ok && demand->peak == 3600 && demand->average == 7200 && demand->elapsed == 473;
+	// Next month
+	data.timestamp.month = 4;
+	ok = ok && at(0)->peak == UINT32_MAX;
+	std::cout << "Demand = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// Aggregate over telegrams around midnight, with a missed telegram and a
+// gap longer than AGGREGATE_MAX_STEP. A field missing from a telegram is
+// left out.
+bool check_aggregate()
+{
+	parse(input50);
+	struct dsmr_data_t data = parsed_data;
+	struct aggregate_t aggregate;
+	Aggregate_Reset(&aggregate);
+	const struct { uint8_t hour, minute, second; uint32_t power; } telegrams[] = {
+		{ 23, 59, 58, 100 }, { 23, 59, 59, 300 }, { 0, 0, 1, 200 }, { 0, 0, 31, 400 }
+	};
+	for (const auto& telegram : telegrams)
+	{
+		data.timestamp.hour = telegram.hour;
+		data.timestamp.minute = telegram.minute;
+		data.timestamp.second = telegram.second;
+		data.P_in_total = telegram.power;
+		if (telegram.second == 31)
+			data.present &= ~DSMR_FIELD_MASK(DSMR_FIELD_V3);
+		Aggregate_Add(&aggregate, &data);
+	}
+	// 100 * 1 + 300 * 1 + 200 * 2 + 400 * 10 Ws over 14 s
+	const struct aggregate_value_t* power = &aggregate.value[DSMR_FIELD_P_IN_TOTAL - AGGREGATE_FIRST];
+	uint32_t present = parsed_data.present & AGGREGATE_FIELDS & ~DSMR_FIELD_MASK(DSMR_FIELD_V3);
+	bool ok = aggregate.count == 4 && aggregate.duration == 14 && aggregate.present == present
+			&& power->min == 100 && power->max == 400 && power->integral == 4800
+			&& Aggregate_Mean(&aggregate, DSMR_FIELD_P_IN_TOTAL) == 343
+			&& Aggregate_Mean(&aggregate, DSMR_FIELD_I1) == parsed_data.I[0]
+			&& Aggregate_Mean(&aggregate, DSMR_FIELD_V3) == UINT32_MAX;
+
+	uint8_t buffer[AGGREGATE_SIZE_MAX];
+	uint16_t size = Aggregate_Pack(&aggregate, buffer);
+	auto get_uint32 = [&](int offset) {
+		return (uint32_t)buffer[offset] | (uint32_t)buffer[offset + 1] << 8
+				| (uint32_t)buffer[offset + 2] << 16 | (uint32_t)buffer[offset + 3] << 24;
+	};
+	int fields = 0;
+	for (uint32_t mask = present; mask != 0; mask &= mask - 1)
+		fields++;
+	ok = ok && size == 17 + 16 * fields && buffer[0] == AGGREGATE_VERSION && get_uint32(1) == present
+			&& buffer[10] == 0 && buffer[11] == 31 && buffer[13] == 4 && buffer[15] == 14
+			&& get_uint32(17) == 100 && get_uint32(21) == 400 && get_uint32(25) == 343 && get_uint32(29) == 4800;
+	std::cout << "Aggregate = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// Instantaneous power payload against a 50 W deadband with a 300 s silence
+// period: compared with the value last sent, not the previous one, so a
+// slow drift is still sent. A field appearing is always sent.
+bool check_deadband()
+{
+	struct deadband_t last;
+	Deadband_Reset(&last);
+	uint32_t power[3] = { 1000, 0, UINT32_MAX };
+	auto exceeded = [&](uint32_t now) {
+		return Deadband_Exceeded(&last, (const uint8_t*)power, sizeof(power), now, 50, 300) != 0;
+	};
+	bool ok = exceeded(0);
+	Deadband_Sent(&last, (const uint8_t*)power, sizeof(power), 0);
+	power[0] = 1050;
+	ok = ok && !exceeded(10);
+	power[0] = 950;
+	ok = ok && !exceeded(20);
+	power[0] = 1051;
+	ok = ok && exceeded(30);
+	power[0] = 1040;
+	ok = ok && !exceeded(299) && exceeded(300);
+	Deadband_Sent(&last, (const uint8_t*)power, sizeof(power), 300);
+	power[0] = 1080;
+	ok = ok && !exceeded(310);
+	power[0] = 1091;
+	ok = ok && exceeded(320);
+	power[0] = 1040;
+	power[2] = 16100;
+	ok = ok && exceeded(330);
+	// Clock set back, or unknown
+	power[2] = UINT32_MAX;
+	ok = ok && exceeded(100) && exceeded(0);
+	// Trailing bytes are not compared, nothing sent after reset
+	ok = ok && !Deadband_Exceeded(&last, (const uint8_t*)power, sizeof(power) + 3, 310, 50, 0);
+	Deadband_Reset(&last);
+	ok = ok && exceeded(310);
+	std::cout << "Deadband = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// SipHash-2-4 reference vectors (key 00..0f, message 00..n-1) and the
+// beacon layout, negative power for delivery
+bool check_beacon()
+{
+	uint8_t key[BEACON_KEY_SIZE];
+	uint8_t message[15];
+	for (int i = 0; i < BEACON_KEY_SIZE; ++i)
+		key[i] = (uint8_t)i;
+	for (int i = 0; i < 15; ++i)
+		message[i] = (uint8_t)i;
+	bool ok = Beacon_SipHash(key, message, 0) == 0x726fdb47dd0e0e31ull
+			&& Beacon_SipHash(key, message, 8) == 0x93f5f5799a932462ull
+			&& Beacon_SipHash(key, message, 15) == 0xa129ca6149be45e5ull;
+
+	const uint8_t address[6] = { 0x3C, 0x2B, 0x1A, 0x50, 0xA0, 0x00 };
+	Beacon_Key(key, 123456, address);
+	uint8_t buffer[BEACON_AD_SIZE];
+	uint16_t size = Beacon_Pack(key, 0x12345678, -1500, 2, buffer);
+	uint32_t mac = (uint32_t)Beacon_SipHash(key, buffer + 4, 10);
+	ok = ok && size == BEACON_AD_SIZE && buffer[0] == BEACON_AD_SIZE - 1 && buffer[1] == 0xFF
+			&& buffer[2] == 0xFF && buffer[3] == 0xFF && buffer[4] == BEACON_VERSION
+			&& buffer[5] == 0x78 && buffer[8] == 0x12
+			&& buffer[9] == (uint8_t)-1500 && buffer[12] == 0xFF && buffer[13] == 2
+			&& buffer[14] == (uint8_t)mac && buffer[17] == (uint8_t)(mac >> 24);
+	// Another passcode gives another MAC
+	Beacon_Key(key, 123457, address);
+	ok = ok && (uint32_t)Beacon_SipHash(key, buffer + 4, 10) != mac;
+	std::cout << "Beacon = " << (ok ? "ok" : "failed") << std::endl;
+	return ok;
+}
+
+// History of telegrams each minute with varying power: samples match the
+// telegrams aggregated independently, a day fits, older samples are
+// dropped a block at a time and seeking finds the sample of a time.
+// Minute telegrams from 2021-10-30 12:00, over the end of summer time, and
+// the samples expected from them
+struct history_meter_t {
+	struct dsmr_data_t data = {};
+	std::vector<history_sample_t> expected;
+	uint32_t seed = 1;
+	int minute = 0;
+	int64_t sum = 0;
+
+	history_meter_t()
+	{
+		data.present = DSMR_FIELD_MASK(DSMR_FIELD_TIMESTAMP) | DSMR_FIELD_MASK(DSMR_FIELD_E_IN1)
+			| DSMR_FIELD_MASK(DSMR_FIELD_E_IN2) | DSMR_FIELD_MASK(DSMR_FIELD_E_OUT1) | DSMR_FIELD_MASK(DSMR_FIELD_E_OUT2)
+			| DSMR_FIELD_MASK(DSMR_FIELD_P_IN_TOTAL) | DSMR_FIELD_MASK(DSMR_FIELD_P_OUT_TOTAL)
+			| DSMR_FIELD_MASK(DSMR_FIELD_GAS_IN);
+		data.E_in[0] = 4567890;
+		data.E_in[1] = 3456789;
+		data.E_out[0] = 123456;
+		data.E_out[1] = 234567;
+		data.gas_in = 2345678;
+	}
+
+	// Next telegram to History_Add, up to the end of November
+	void next()
+	{
+		int m = minute + 12 * 60;   // since the 30th, summer time
+		bool summer = m < 24 * 60 + 3 * 60;  // local 03:00 becomes 02:00, one hour repeats
+		data.timestamp = { 2021, 10, 30, 12, 0, 0, 2 };
+		if (!summer)
+		{
+			data.timestamp.dst = 1;
+			m -= 60;
+		}
+		data.timestamp.day = 30 + m / 1440;
+		data.timestamp.hour = m / 60 % 24;
+		data.timestamp.minute = m % 60;
+		if (data.timestamp.day > 31)
+		{
+			data.timestamp.month = 11;
+			data.timestamp.day -= 31;
+		}
+		seed = seed * 1103515245u + 12345u;
+		int32_t power = (int32_t)((seed >> 16) % 3000) - 500;
+		data.P_in_total = power > 0 ? power : 0;
+		data.P_out_total = power < 0 ? -power : 0;
+		data.E_in[minute / 480 % 2] += data.P_in_total / 60;
+		data.E_out[0] += data.P_out_total / 60;
+		if (minute % 5 == 0)
+			data.gas_in += (seed >> 8) % 50;
+
+		uint32_t time = History_Minutes(&data.timestamp) / HISTORY_INTERVAL * HISTORY_INTERVAL;
+		if (expected.empty() || expected.back().value[HISTORY_FIELD_TIME] != time)
+		{
+			expected.push_back(history_sample_t());
+			expected.back().value[HISTORY_FIELD_TIME] = time;
+			expected.back().value[HISTORY_FIELD_P_MIN] = INT32_MAX;
+			expected.back().value[HISTORY_FIELD_P_MAX] = (uint32_t)INT32_MIN;
+			sum = 0;
+		}
+		history_sample_t& e = expected.back();
+		e.value[HISTORY_FIELD_E_IN1] = data.E_in[0];
+		e.value[HISTORY_FIELD_E_IN2] = data.E_in[1];
+		e.value[HISTORY_FIELD_E_OUT1] = data.E_out[0];
+		e.value[HISTORY_FIELD_E_OUT2] = data.E_out[1];
+		e.value[HISTORY_FIELD_GAS_IN] = data.gas_in;
+		e.value[HISTORY_FIELD_P_MIN] = std::min((int32_t)e.value[HISTORY_FIELD_P_MIN], power);
+		e.value[HISTORY_FIELD_P_MAX] = std::max((int32_t)e.value[HISTORY_FIELD_P_MAX], power);
+		sum += power;
+		e.value[HISTORY_FIELD_P_AVG] = (uint32_t)(int32_t)(sum / (minute % 5 + 1));
+		History_Add(&data);
+		minute++;
+	}
+
+	// Index of the expected sample, or expected.size()
+	size_t find(const history_sample_t& sample) const
+	{
+		for (size_t i = 0; i < expected.size(); ++i)
+			if (memcmp(&expected[i], &sample, sizeof(sample)) == 0)
+				return i;
+		return expected.size();
+	}
+};
+
+// Reads all samples from the cursor, returns the count or -1 when they are
+// not consecutive expected samples
+int history_read(const history_meter_t& meter, history_cursor_t* cursor, size_t* first)
+{
+	struct history_sample_t sample;
+	int read = 0;
+	while (History_Next(cursor, &sample))
+	{
+		if (read == 0)
+			*first = meter.find(sample);
+		if (*first + read >= meter.expected.size()
+			|| memcmp(&sample, &meter.expected[*first + read], sizeof(sample)) != 0)
+			return -1;
+		read++;
+	}
+	return read;
+}
+
+bool check_history()
+{
+	History_Reset();
+	history_meter_t meter;
+	uint16_t used_day = 0;
+	for (int minute = 0; minute < 3 * 24 * 60; ++minute)
+	{
+		meter.next();
+		if (minute == 24 * 60 + 5)
+			used_day = History_Used();
+	}
+	std::vector<history_sample_t>& expected = meter.expected;
+	expected.pop_back(); // still being aggregated
+
+	// Stored samples are the newest expected ones, in order
+	struct history_cursor_t cursor;
+	struct history_sample_t sample;
+	History_Seek(&cursor, 0);
+	size_t first = expected.size();
+	int read = history_read(meter, &cursor, &first);
+	bool ok = History_Count() > 24 * 60 / HISTORY_INTERVAL && first > 0 && used_day <= HISTORY_BLOCKS * HISTORY_BLOCK_SIZE
+		&& read == (int)History_Count() && first + read == expected.size();
+
+	// Seek to a time in the middle, and past the end
+	const history_sample_t& middle = expected[(first + expected.size()) / 2];
+	History_Seek(&cursor, middle.value[HISTORY_FIELD_TIME] - 1);
+	ok = ok && History_Next(&cursor, &sample) && memcmp(&sample, &middle, sizeof(sample)) == 0;
+	History_Seek(&cursor, expected.back().value[HISTORY_FIELD_TIME] + 1);
+	ok = ok && !History_Next(&cursor, &sample);
+
+	// Extremes and missing values survive the encoding
+	history_sample_t extreme, decoded = history_sample_t();
+	uint8_t buffer[HISTORY_SAMPLE_MAX];
+	for (int field = 0; field < HISTORY_FIELD_COUNT; ++field)
+		extreme.value[field] = field % 2 ? HISTORY_NONE : HISTORY_POWER_NONE;
+	uint16_t length = History_Encode(&expected.back(), &extreme, buffer);
+	decoded = expected.back();
+	ok = ok && length <= HISTORY_SAMPLE_MAX && History_Decode(&decoded, buffer, length) == length
+		&& memcmp(&decoded, &extreme, sizeof(decoded)) == 0 && History_Decode(&decoded, buffer, length - 1) == 0;
+
+	printf("History %u of %u samples, %u bytes per day, %.1f bytes per sample = %s\n",
+		(unsigned)History_Count(), (unsigned)expected.size(), (unsigned)used_day,
+		(double)History_Used() / History_Count(), ok ? "ok" : "failed");
+	return ok;
+}
+
+// Flash log on the emulated flash: wear over the rows, kept records and
+// recovery from power loss during every part of a row write
+bool check_flashlog()
+{
+	const uint8 keep = FLASHLOG_TYPE_KEEP | (FLASHLOG_KEEP_TYPES - 1);
+	const uint8 other = 0x40;
+	uint8 record[130];          // one per row, with the kept record
+	uint32 value = 0;           // in the newest record
+	uint32 kept = 0;
+
+	memset(record, 0xA5, sizeof(record));
+	auto append = [&](uint8 type, uint32 v) {
+		memcpy(record, &v, sizeof(v));
+		return FlashLog_Append(type, record, type == keep ? 16 : sizeof(record)) != 0;
+	};
+	auto commit = [&]() {
+		FlashLog_Commit();
+		uint32 deferred = FlashLog_Deferred();
+		FlashLog_ProcessEvents(0, 1);   // meter busy
+		FlashLog_ProcessEvents(1, 0);   // BLE link busy, counted once
+		FlashLog_ProcessEvents(1, 0);
+		bool waited = FlashLog_Free() == 0 && FlashLog_Deferred() == deferred + 1;
+		FlashLog_ProcessEvents(1, 1);
+		return waited && FlashLog_Free() != 0;
+	};
+	// Newest record and kept record are the expected ones
+	auto check = [&]() {
+		struct flashlog_cursor_t cursor;
+		const uint8* data;
+		const uint8* newest = nullptr;
+		uint8 type;
+		uint16 length;
+		FlashLog_Rewind(&cursor);
+		while ((data = FlashLog_Next(&cursor, &type, &length)) != nullptr)
+			if (type == other)
+				newest = data;
+		data = FlashLog_Find(keep, &length);
+		return newest != nullptr && memcmp(newest, &value, sizeof(value)) == 0
+			&& data != nullptr && length == 16 && memcmp(data, &kept, sizeof(kept)) == 0;
+	};
+
+	FlashLog_Start();
+	bool ok = FlashLog_Rows() == 0 && FlashLog_Find(keep, nullptr) == nullptr;
+	ok = ok && append(keep, kept) && commit();
+
+	// Three times around the log, updating the kept record sometimes
+	for (uint32 i = 1; ok && i <= 3 * FLASHLOG_ROWS; ++i)
+	{
+		value = i;
+		ok = append(other, value) && !append(other, value) && commit();
+		if (i % 100 == 0)
+		{
+			kept = i;
+			ok = ok && append(keep, kept) && commit();
+		}
+	}
+	ok = ok && FlashLog_Rows() == FLASHLOG_ROWS && check();
+
+	// Every row written as often, within one
+	struct flashlog_cursor_t cursor;
+	const uint8* data;
+	uint8 type;
+	uint16 length;
+	uint32 wear_min = UINT32_MAX, wear_max = 0;
+	FlashLog_Rewind(&cursor);
+	while ((data = FlashLog_Next(&cursor, &type, &length)) != nullptr)
+	{
+		wear_min = std::min(wear_min, Sim_FlashRowWrites(data));
+		wear_max = std::max(wear_max, Sim_FlashRowWrites(data));
+	}
+	ok = ok && wear_max - wear_min <= 1;
+
+	// Power lost during a row write, within the record, more than once
+	// around the log so the kept record is moved: the log continues from
+	// the previous row
+	int recovered = 0;
+	for (uint32 i = 0; ok && i < FLASHLOG_ROWS + 8; ++i)
+	{
+		Sim_FlashPowerLoss(1, i * 37 % (FLASHLOG_HEADER + sizeof(record)));
+		ok = append(other, value + 1) && commit();
+		Sim_FlashPowerLoss(0, 0);
+		FlashLog_Start();
+		ok = ok && FlashLog_Rows() == FLASHLOG_ROWS - 1 && check();
+		value++;
+		ok = ok && append(other, value) && commit() && FlashLog_Rows() == FLASHLOG_ROWS && check();
+		recovered += ok;
+	}
+
+	printf("Flash log %u rows, wear %u to %u writes, recovered %d power losses = %s\n",
+		(unsigned)FlashLog_Rows(), (unsigned)wear_min, (unsigned)wear_max, recovered, ok ? "ok" : "failed");
+	return ok;
+}
+
+// Weeks of samples through the flash log, read back after a reset
+bool check_history_flash()
+{
+	History_Reset();
+	FlashLog_Start();
+	history_meter_t meter;
+	uint32 flash_writes = Sim_GetPower()->flash_writes;
+	const int minutes = 21 * 24 * 60;
+	for (int minute = 0; minute < minutes; ++minute)
+	{
+		meter.next();
+		History_ProcessEvents();
+		FlashLog_ProcessEvents(1, 1);
+	}
+	flash_writes = Sim_GetPower()->flash_writes - flash_writes;
+
+	// All samples up to the newest, from flash into RAM
+	struct history_cursor_t cursor;
+	struct history_sample_t sample;
+	size_t first = meter.expected.size();
+	size_t last = meter.expected.size() - 1;    // still being aggregated
+	History_Seek(&cursor, 0);
+	int read = history_read(meter, &cursor, &first);
+	double days = read * HISTORY_INTERVAL / (24.0 * 60);
+	bool ok = days >= 14 && first + read == last;
+
+	// Seek into flash
+	const history_sample_t& middle = meter.expected[first + read / 2];
+	History_Seek(&cursor, middle.value[HISTORY_FIELD_TIME]);
+	ok = ok && History_Next(&cursor, &sample) && memcmp(&sample, &middle, sizeof(sample)) == 0;
+
+	// After a reset, samples not yet written to flash are lost
+	History_Reset();
+	FlashLog_Start();
+	History_Seek(&cursor, 0);
+	size_t first_reset = meter.expected.size();
+	int read_reset = history_read(meter, &cursor, &first_reset);
+	size_t lost = last - (first_reset + read_reset);
+	ok = ok && read_reset > 0 && lost * 13 <= FLASHLOG_PAYLOAD;
+
+	printf("History in flash %.1f days, %u row writes, %u samples lost on reset = %s\n",
+		days, (unsigned)flash_writes, (unsigned)lost, ok ? "ok" : "failed");
+	return ok;
+}
+
+// Binary search requires the OBIS table to be sorted
+bool check_obis_table()
+{
+	bool sorted = true;
+	for (size_t i = 1; i < obis_table_size; ++i)
+		sorted &= obis_table[i - 1].key < obis_table[i].key;
+	for (size_t i = 0; i < obis_table_size; ++i)
+		sorted &= Obis_Lookup(obis_table[i].key) == &obis_table[i];
+	std::cout << "OBIS table sorted = " << (sorted ? "yes" : "no") << std::endl;
+	return sorted;
+}
+
+// Telegrams through a small ring as in meter.c, the consumer drains every
+// drain_every bytes, except while stalled (e.g. flash write).
+bool check_ring(const char* input, size_t drain_every, size_t stall_at, size_t stall_length, int expect_received)
+{
+	volatile uint8_t buffer[64];
+	struct ring_t ring;
+	Ring_Init(&ring, buffer, sizeof(buffer));
+	Meter_Parser_Reset(&parser);
+	int received = 0;
+	parsed_got_data = false;
+
+	auto drain = [&]() {
+		const uint8_t* data;
+		size_t length;
+		while ((length = Ring_Peek(&ring, &data)) != 0)
+		{
+			Meter_Parser_ParseBuffer(&parser, (const char*)data, length);
+			Ring_Consume(&ring, length);
+			received += parsed_got_data;
+			parsed_got_data = false;
+		}
+		if (Ring_Resync(&ring))
+			Meter_Parser_Reset(&parser);
+	};
+
+	// Two telegrams back to back
+	std::string stream = std::string(input) + input;
+	bool receiving = false;
+	for (size_t i = 0; i < stream.size(); ++i)
+	{
+		if (receiving || stream[i] == '/')
+			receiving = Ring_Put(&ring, stream[i]);
+		bool stalled = i >= stall_at && i < stall_at + stall_length;
+		if (!stalled && i % drain_every == 0)
+			drain();
+	}
+	drain();
+
+	const struct ring_stats_t* stats = &ring.stats;
+	bool ok = received == expect_received && stats->high_water <= sizeof(buffer)
+		&& (stats->overruns ? stats->received < stream.size() : stats->received == stream.size())
+		&& (stall_length > sizeof(buffer) ? stats->overruns == 1 : stats->overruns == 0);
+	printf("Ring received %d, high water %u, overruns %u, dropped %u = %s\n", received,
+		stats->high_water, (unsigned)stats->overruns, (unsigned)stats->dropped, ok ? "ok" : "failed");
+	return ok;
+}
+
+// Meter UART receive against the UART mock at 115200 baud. The telegram
+// must be complete in the ring without polling (end is not delayed by the
+// FIFO level), with far fewer interrupts than bytes.
+bool check_uartrx(const char* input)
+{
+	volatile uint8_t buffer[2048];
+	struct ring_t ring;
+	Ring_Init(&ring, buffer, sizeof(buffer));
+	Sim_Reset();
+	UartRx_Init(&ring);
+	UartRx_Start();
+	Meter_Parser_Reset(&parser);
+	parsed_got_data = parsed_got_error = false;
+
+	auto drain = [&]() {
+		const uint8_t* data;
+		size_t length;
+		while ((length = Ring_Peek(&ring, &data)) != 0)
+		{
+			Meter_Parser_ParseBuffer(&parser, (const char*)data, length);
+			Ring_Consume(&ring, length);
+		}
+	};
+
+	// Idle line, telegram, main loop runs only afterwards
+	size_t length = strlen(input);
+	Sim_Advance(Sim_Now() + SIM_MS(1));
+	uint32_t start_expected = CySysWdtGetCount(CY_SYS_WDT_COUNTER2);
+	UartMock_Replay(input, length, 115200);
+	drain();
+	bool complete = parsed_got_data && Ring_Empty(&ring);
+	uint32_t start = UartRx_StartTick();
+
+	// Truncated telegram, tail below FIFO level is only found by polling
+	parsed_got_data = false;
+	size_t cut = length - 20;
+	if ((cut - 1) % (UARTRX_LEVEL_BODY + 1) == 0)
+		cut--; // ensure bytes remain below the trigger level
+	UartMock_Replay(input, cut, 115200);
+	drain();
+	size_t before_poll = ring.stats.received;
+	UartRx_Poll();
+	size_t polled = ring.stats.received - before_poll;
+	UartRx_Stop();
+
+	const struct uart_mock_stats_t* stats = UartMock_GetStats();
+	bool ok = complete && !parsed_got_error && stats->overflows == 0
+		&& stats->interrupts * 4 < stats->bytes
+		&& UartRx_Started() && ring.stats.received == length + cut
+		&& polled > 0 && polled < UART_Meter_FIFO_SIZE
+		&& start - start_expected < 5;  // '/' signalled after first byte time (87 us)
+	printf("UART rx bytes %u, interrupts %u, polled %u = %s\n", (unsigned)stats->bytes,
+		(unsigned)stats->interrupts, (unsigned)polled, ok ? "ok" : "failed");
+	return ok;
+}
+
+// Interrupts blocked for a number of bytes in the telegram body (e.g. BLE
+// stack critical section). Up to the margin of the body trigger level no
+// byte is lost, beyond it the FIFO overflows: the ring marks a gap, the
+// consumer resynchronizes and the next telegram is received again.
+bool check_uartrx_latency(const char* input, size_t blocked_bytes, bool expect_lost)
+{
+	volatile uint8_t buffer[2048];
+	struct ring_t ring;
+	Ring_Init(&ring, buffer, sizeof(buffer));
+	Sim_Reset();
+	UartRx_Init(&ring);
+	UartRx_Start();
+	Meter_Parser_Reset(&parser);
+
+	int received = 0;
+	int resyncs = 0;
+	auto drain = [&]() {
+		const uint8_t* data;
+		size_t length;
+		parsed_got_data = parsed_got_error = false;
+		while ((length = Ring_Peek(&ring, &data)) != 0)
+		{
+			Meter_Parser_ParseBuffer(&parser, (const char*)data, length);
+			Ring_Consume(&ring, length);
+		}
+		if (Ring_Resync(&ring))
+		{
+			resyncs++;
+			Meter_Parser_Reset(&parser);
+		}
+		received += parsed_got_data && !parsed_got_error;
+	};
+
+	// Blocked at each position within a FIFO batch, then an intact telegram
+	size_t length = strlen(input);
+	const size_t tries = UARTRX_LEVEL_BODY + 1;
+	for (size_t i = 0; i < tries; ++i)
+	{
+		size_t blocked_at = 100 + i;
+		UartMock_Replay(input, blocked_at, 115200);
+		uint8 saved = CyEnterCriticalSection();
+		UartMock_Replay(input + blocked_at, blocked_bytes, 115200);
+		CyExitCriticalSection(saved);
+		UartMock_Replay(input + blocked_at + blocked_bytes, length - blocked_at - blocked_bytes, 115200);
+		drain();
+	}
+	UartMock_Replay(input, length, 115200);
+	drain();
+	UartRx_Stop();
+
+	const struct uart_mock_stats_t* stats = UartMock_GetStats();
+	bool ok = expect_lost
+		? received == 1 && resyncs == (int)tries && stats->overflows != 0 && ring.stats.errors == tries
+		: received == (int)tries + 1 && resyncs == 0 && stats->overflows == 0 && ring.stats.errors == 0;
+	printf("UART rx blocked %u bytes, received %d, overflows %u, errors %u, resyncs %d = %s\n",
+		(unsigned)blocked_bytes, received, (unsigned)stats->overflows, (unsigned)ring.stats.errors, resyncs,
+		ok ? "ok" : "failed");
+	return ok;
+}
+
+// Event log reads keep the entries until acknowledged: a retried read
+// returns the same entries, an old acknowledgement removes nothing.
+bool check_eventlog_read()
+{
+	uint8 value[2 + 3 * EVENTLOG_ENTRY_SIZE + 4];
+	auto sequence = [&]() { return (uint16_t)(value[0] | (value[1] << 8)); };
+	// Earlier tests leave entries, and a lost count stored with the next
+	for (int i = 0; i < 2; ++i)
+	{
+		EventLog_Add(EVENTLOG_START, 0);
+		EventLog_Read(value, sizeof(value));
+		EventLog_Acknowledge((uint16_t)(sequence() + EventLog_Count()));
+	}
+
+	for (uint32 i = 0; i < 5; ++i)
+		EventLog_Add(EVENTLOG_METER_BURST, i);
+	uint16_t length = EventLog_Read(value, sizeof(value));
+	uint16_t first = sequence();
+	uint8 again[sizeof(value)];
+	bool ok = length == 2 + 3 * EVENTLOG_ENTRY_SIZE && EventLog_Count() == 5
+		&& EventLog_Read(again, sizeof(again)) == length && memcmp(value, again, length) == 0
+		&& value[2] == EVENTLOG_METER_BURST && value[2 + 5] == 0;
+
+	EventLog_Acknowledge((uint16_t)(first + 3));
+	length = EventLog_Read(value, sizeof(value));
+	ok = ok && EventLog_Count() == 2 && sequence() == (uint16_t)(first + 3)
+		&& length == 2 + 2 * EVENTLOG_ENTRY_SIZE && value[2 + 5] == 3;
+
+	EventLog_Acknowledge((uint16_t)(first + 3));   // retried
+	EventLog_Acknowledge(first);                    // stale
+	EventLog_Acknowledge((uint16_t)(first + 6));    // beyond the log
+	ok = ok && EventLog_Count() == 2;
+	EventLog_Acknowledge((uint16_t)(first + 5));
+	ok = ok && EventLog_Count() == 0 && EventLog_Read(value, 1) == 0;
+	printf("Event log read, acknowledged = %s\n", ok ? "ok" : "failed");
+	return ok;
+}
+
+// Virtual clock simulation of a meter sending telegrams with the given
+// period, only while the request line is active. After jump_at readings
+// the meter phase shifts by half a period (e.g. meter reboot).
+bool check_schedule(uint32_t period, uint32_t offset, int jump_at, uint32_t interval = SCHEDULE_MS(30000))
+{
+	const uint32_t duration = SCHEDULE_MS(80);
+	const int readings_total = 40;
+	struct meter_schedule_t s;
+	uint32_t now = 0xFFFF0000u; // wrap-around during the test
+	Meter_Schedule_Init(&s, now);
+	Meter_Schedule_SetInterval(&s, interval, now);
+
+	uint32_t grid = now + offset; // next telegram without jitter
+	uint32_t seed = 1;
+	uint32_t last_reading = 0, max_window = 0, min_gap = UINT32_MAX, max_gap = 0;
+	int readings = 0, since_lock = -1;
+	bool ok = true;
+	for (int steps = 0; readings < readings_total && steps < 10000; ++steps)
+	{
+		seed = seed * 1103515245u + 12345u;
+		uint32_t start = grid + SCHEDULE_MS(10) - (seed >> 16) % SCHEDULE_MS(20);
+		uint32_t next = Meter_Schedule_Next(&s);
+		if (s.receiving && (int32_t)(next - start) >= 0 && (int32_t)(start - s.open) >= 0)
+		{
+			now = start + duration;
+			Meter_Schedule_Received(&s, start, now, interval);
+			grid += period;
+			if (s.receiving)
+				continue; // learning period
+			if (++since_lock > 2)
+			{
+				max_window = std::max(max_window, s.window_last);
+				min_gap = std::min(min_gap, start - last_reading);
+				max_gap = std::max(max_gap, start - last_reading);
+			}
+			last_reading = start;
+			++readings;
+			if (readings == jump_at)
+			{
+				grid += period / 2;
+				since_lock = -1;
+			}
+		}
+		else
+		{
+			now = next;
+			Meter_Schedule_Timeout(&s, now, 0);
+		}
+		while ((int32_t)(grid + SCHEDULE_MS(20) - now) < 0)
+			grid += period;
+	}
+
+	ok &= readings == readings_total;
+	ok &= max_window < SCHEDULE_MS(200);
+	ok &= min_gap + period / 2 >= interval && max_gap <= interval + period / 2 + SCHEDULE_MS(20);
+	ok &= jump_at < 0 ? s.misses_total == 0 : s.misses_total > 0;
+	printf("Schedule period %u ms, interval %u s: readings %d, window %u ms, gap %u-%u ms, misses %u = %s\n",
+		(unsigned)((uint64_t)period * 1000 / SCHEDULE_TICKS_PER_SECOND),
+		(unsigned)(interval / SCHEDULE_TICKS_PER_SECOND), readings,
+		(unsigned)((uint64_t)max_window * 1000 / SCHEDULE_TICKS_PER_SECOND),
+		(unsigned)((uint64_t)min_gap * 1000 / SCHEDULE_TICKS_PER_SECOND),
+		(unsigned)((uint64_t)max_gap * 1000 / SCHEDULE_TICKS_PER_SECOND),
+		(unsigned)s.misses_total, ok ? "ok" : "failed");
+	return ok;
 }
 
 int main()
 {
 	printf("test\n");
 
-	Meter_Parser_SetReceivedHandler(&parser_packet_received_handler);
-	Meter_Parser_SetErrorHandler(&parser_error_handler);
+	Meter_Parser_Init(&parser, &parser_packet_received_handler, &parser_error_handler, NULL);
 
-	parse(input30);
-	parse(input40);
-	parse(input50);
+	int failed = 0;
+	failed += !check_obis_table();
+	failed += !parse(input30);
+	failed += !parse(input40);
+	failed += !parse(input50);
+	failed += !parse(corrupt(input40).c_str(), false);
+	failed += !parse(corrupt(input50).c_str(), false);
+	failed += !parse(input40, true, 7);
+	failed += !parse(input50, true, 64);
+	failed += !parse(corrupt(input50).c_str(), false, 13);
+	failed += !parse_interleaved(input40, input50);
+	failed += !check_snapshot();
+	failed += !check_changed();
+	failed += !check_snapshot_pack();
+	failed += !check_aggregate();
+	failed += !check_deadband();
+	failed += !check_beacon();
+	failed += !check_history();
+	failed += !check_flashlog();
+	failed += !check_history_flash();
+	failed += !check_demand_meter();
+	failed += !check_demand();
+	failed += !check_ring(input50, 16, 0, 0, 2);
+	failed += !check_ring(input50, 16, 200, 300, 1);  // overrun in first telegram
+	failed += !check_uartrx(input50);
+	failed += !check_uartrx_latency(input50, UART_Meter_FIFO_SIZE - UARTRX_LEVEL_BODY, false);
+	failed += !check_uartrx_latency(input50, 12, true);
+	failed += !check_eventlog_read();
+	failed += !check_schedule(SCHEDULE_MS(1000), SCHEDULE_MS(300), -1);
+	failed += !check_schedule(SCHEDULE_MS(10000), SCHEDULE_MS(7300), -1);
+	failed += !check_schedule(SCHEDULE_MS(1000) + 3, SCHEDULE_MS(900), 10); // drift
+	failed += !check_schedule(SCHEDULE_MS(10000), SCHEDULE_MS(2500), 10);
+	failed += !check_schedule(SCHEDULE_MS(1000), SCHEDULE_MS(600), -1, SCHEDULE_MS(1000));
+	failed += !check_schedule(SCHEDULE_MS(10000), SCHEDULE_MS(600), -1, SCHEDULE_MS(900000));
+
+	printf("%d failed\n", failed);
+	return failed != 0;
 }
@@ -0,0 +1,699 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// BLE component stand-in. Centrals connect one at a time while advertising
+// and act at connection events: security, MTU exchange, CCCD writes, a
+// characteristic write and periodic reads. Notifications take a stack buffer until sent at a
+// connection event. Events raise the BLE interrupt and are delivered from
+// CyBle_ProcessEvents, as the stack does.
+
+#include "sim.h"
+
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+
+CYBLE_CONN_HANDLE_T cyBle_connHandle;
+CYBLE_GAP_AUTH_INFO_T cyBle_authInfo;
+volatile uint8 cyBle_pendingFlashWrite = 0;
+
+// As configured in the BLE component: flags and the Power Meter service
+// UUID, the device name in the scan response
+static const CYBLE_GAPP_DISC_DATA_T adv_data_default = {
+	{ 0x02, 0x01, 0x06,
+	  0x11, 0x07, 0xAC, 0xB8, 0x84, 0x6E, 0x3B, 0xCB, 0x46, 0xBD, 0xCA, 0x47, 0x8D, 0x55, 0x00, 0x00, 0x88, 0xAF },
+	21
+};
+static const CYBLE_GAPP_SCAN_RSP_DATA_T scan_rsp_default = {
+	{ 0x0B, 0x09, 'S', 'm', 'a', 'r', 't', 'M', 'e', 't', 'e', 'r' },
+	12
+};
+static CYBLE_GAPP_DISC_DATA_T adv_data = adv_data_default;
+static CYBLE_GAPP_SCAN_RSP_DATA_T scan_rsp = scan_rsp_default;
+CYBLE_GAPP_DISC_MODE_INFO_T cyBle_discoveryModeInfo = { 0, &adv_data, &scan_rsp, 0 };
+
+namespace {
+	CYBLE_CALLBACK_T callback = nullptr;
+	CYBLE_STATE_T state = CYBLE_STATE_STOPPED;
+	CYBLE_LP_MODE_T lp_mode = CYBLE_BLESS_ACTIVE;
+	CYBLE_BLESS_CLK_CFG_PARAMS_T clock_config;
+	std::map<CYBLE_GATT_DB_ATTR_HANDLE_T, std::vector<uint8>> attributes;
+	ble_sim_stats_t stats;
+
+	struct event_t {
+		uint32 code;
+		union {
+			uint8 u8;
+			uint16 u16;
+			CYBLE_GAP_AUTH_INFO_T auth;
+			CYBLE_GATT_XCHG_MTU_PARAM_T mtu;
+			CYBLE_GATTS_WRITE_REQ_PARAM_T write;
+			CYBLE_GATTS_CHAR_VAL_READ_REQ_T read;
+			CYBLE_GAP_CONN_PARAM_UPDATED_IN_CONTROLLER_T connection;
+		} param;
+		uint8 value[CYBLE_GATT_DEFAULT_MTU - 3]; // written value
+	};
+	std::deque<event_t> events;
+	bool interrupt = false;
+
+	// Central actions, at connection events
+	enum action_type_t {
+		ACTION_SECURED,
+		ACTION_MTU,
+		ACTION_CCCD,
+		ACTION_WRITE,
+		ACTION_READ,
+		ACTION_PARAMETERS,      // response to update request
+		ACTION_UPDATE,          // update complete in controller
+		ACTION_DISCONNECT
+	};
+	struct action_t {
+		action_type_t type;
+		uint16 value;
+		CYBLE_GAP_CONN_UPDATE_PARAM_T parameters;
+	};
+	std::multimap<uint64, action_t> actions;
+
+	std::vector<sim_central_t> centrals;
+	size_t central = 0;         // next or connected
+	uint64 advertising_since = 0;
+
+	// Connection
+	uint64 anchor = 0;          // time of a connection event
+	uint16 interval = 0;        // 1.25 ms
+	uint16 latency = 0;
+	bool authenticating = false;
+	bool busy = false;
+
+	struct tx_t {
+		uint64 queued;
+		uint64 telegram;        // meter telegram start of the data
+		CYBLE_GATT_DB_ATTR_HANDLE_T handle;
+		std::vector<uint8> value;
+	};
+	std::deque<tx_t> tx;
+	uint64 last_tx_event = 0;
+	sim_notification_sink_t notification_sink = nullptr;
+	void* notification_context = nullptr;
+	sim_scan_response_sink_t scan_response_sink = nullptr;
+	void* scan_response_context = nullptr;
+	uint32 passkey = 0;
+
+	void advertise_scan_response()
+	{
+		if (scan_response_sink != nullptr)
+			scan_response_sink(cyBle_discoveryModeInfo.scanRspData->scanRspData,
+				cyBle_discoveryModeInfo.scanRspData->scanRspDataLen, scan_response_context);
+	}
+
+	void push(const event_t& event)
+	{
+		events.push_back(event);
+		interrupt = true;
+	}
+
+	void push(uint32 code)
+	{
+		event_t event;
+		memset(&event, 0, sizeof(event));
+		event.code = code;
+		push(event);
+	}
+
+	uint64 interval_time()
+	{
+		return (uint64)interval * SIM_US(1250);
+	}
+
+	// First connection event at or after t
+	uint64 event_at(uint64 t)
+	{
+		const uint64 period = interval_time();
+		if (t <= anchor)
+			return anchor;
+		return anchor + (t - anchor + period - 1) / period * period;
+	}
+
+	// Central transmissions are only heard at events the peripheral listens
+	// to (slave latency), n events from now
+	void schedule(uint64 events_from_now, action_t action)
+	{
+		const uint64 listen = interval_time() * (latency + 1);
+		actions.emplace(event_at(Sim_Now()) + events_from_now * listen, action);
+	}
+
+	void schedule(uint64 events_from_now, action_type_t type, uint16 value = 0)
+	{
+		action_t action;
+		memset(&action, 0, sizeof(action));
+		action.type = type;
+		action.value = value;
+		schedule(events_from_now, action);
+	}
+
+	// Time between connection events the peripheral listens to
+	void trace_connection()
+	{
+		Sim_Trace(SIM_SIGNAL_CONNECTION, state == CYBLE_STATE_CONNECTED
+			? (uint32)(interval_time() * (latency + 1) / SIM_US(1)) : 0);
+	}
+
+	uint64 connect_time()
+	{
+		if (state != CYBLE_STATE_ADVERTISING || central >= centrals.size())
+			return SIM_NEVER;
+		// First advertising event after the central starts scanning
+		uint64 t = centrals[central].connect;
+		return (t > advertising_since ? t : advertising_since) + SIM_MS(20);
+	}
+
+	void connect()
+	{
+		const sim_central_t& c = centrals[central];
+		state = CYBLE_STATE_CONNECTED;
+		anchor = last_tx_event = Sim_Now();
+		interval = c.interval;
+		latency = 0;
+		authenticating = busy = false;
+		cyBle_connHandle.bdHandle = (uint8)central;
+		stats.connections++;
+		Sim_Trace(SIM_SIGNAL_ADVERTISING, 0);
+		trace_connection();
+		event_t event;
+		memset(&event, 0, sizeof(event));
+		event.code = CYBLE_EVT_GAP_DEVICE_CONNECTED;
+		event.param.connection.connIntv = interval;
+		event.param.connection.connLatency = latency;
+		event.param.connection.supervisionTO = 400;    // 4 s
+		push(event);
+		push(CYBLE_EVT_GATT_CONNECT_IND);
+		if (c.mtu != 0)
+			schedule(1, ACTION_MTU, c.mtu);
+		if (c.duration != SIM_NEVER)
+			actions.emplace(Sim_Now() + c.duration, action_t{ ACTION_DISCONNECT, 0, {} });
+	}
+
+	void disconnect()
+	{
+		state = CYBLE_STATE_DISCONNECTED;
+		actions.clear();
+		tx.clear();
+		busy = false;
+		central++;
+		trace_connection();
+		push(CYBLE_EVT_GAP_DEVICE_DISCONNECTED);
+		push(CYBLE_EVT_GATT_DISCONNECT_IND);
+	}
+
+	void perform(const action_t& action)
+	{
+		const sim_central_t& c = centrals[central];
+		event_t event;
+		memset(&event, 0, sizeof(event));
+		switch (action.type)
+		{
+		case ACTION_SECURED:
+			if (c.bonded)
+			{
+				event.code = CYBLE_EVT_GAP_ENCRYPT_CHANGE;
+				event.param.u8 = 1;
+			}
+			else
+			{
+				event.code = CYBLE_EVT_GAP_AUTH_COMPLETE;
+				event.param.auth = cyBle_authInfo;
+			}
+			push(event);
+			// Subscribe one characteristic per connection event, then read
+			for (size_t i = 0; i < c.subscribe.size(); ++i)
+				schedule(i + 1, ACTION_CCCD, c.subscribe[i]);
+			if (c.write != 0)
+				schedule(c.subscribe.size() + 1, ACTION_WRITE, c.write);
+			if (c.read != 0)
+				actions.emplace(Sim_Now() + c.read_period, action_t{ ACTION_READ, c.read, {} });
+			break;
+		case ACTION_MTU:
+			event.code = CYBLE_EVT_GATTS_XCNHG_MTU_REQ;
+			event.param.mtu.connHandle = cyBle_connHandle;
+			event.param.mtu.mtu = action.value;
+			push(event);
+			break;
+		case ACTION_CCCD:
+			event.code = CYBLE_EVT_GATTS_WRITE_REQ;
+			event.param.write.connHandle = cyBle_connHandle;
+			event.param.write.handleValPair.attrHandle = action.value;
+			event.param.write.handleValPair.value.len = 2;
+			event.value[0] = 1;     // notifications
+			stats.writes++;
+			Sim_Trace(SIM_SIGNAL_PACKETS, 1);
+			push(event);
+			break;
+		case ACTION_WRITE:
+			event.code = CYBLE_EVT_GATTS_WRITE_REQ;
+			event.param.write.connHandle = cyBle_connHandle;
+			event.param.write.handleValPair.attrHandle = action.value;
+			event.param.write.handleValPair.value.len = (uint16)c.write_value.size();
+			assert(c.write_value.size() <= sizeof(event.value));
+			memcpy(event.value, c.write_value.data(), c.write_value.size());
+			stats.writes++;
+			Sim_Trace(SIM_SIGNAL_PACKETS, 1);
+			push(event);
+			break;
+		case ACTION_READ:
+			event.code = CYBLE_EVT_GATTS_READ_CHAR_VAL_ACCESS_REQ;
+			event.param.read.connHandle = cyBle_connHandle;
+			event.param.read.attrHandle = action.value;
+			push(event);
+			Sim_Trace(SIM_SIGNAL_PACKETS, 1);
+			actions.emplace(Sim_Now() + c.read_period, action);
+			break;
+		case ACTION_PARAMETERS:
+		{
+			// Centrals check the Core spec rule (as BlueZ does): timeout
+			// (10 ms) > (1 + latency) * interval max (1.25 ms) * 2
+			const CYBLE_GAP_CONN_UPDATE_PARAM_T& p = action.parameters;
+			bool reject = c.reject_parameters
+				|| (uint32)p.supervisionTO * 8 <= (1u + p.connLatency) * p.connIntvMax * 2;
+			event.code = CYBLE_EVT_L2CAP_CONN_PARAM_UPDATE_RSP;
+			event.param.u16 = reject ? 1 : 0;
+			push(event);
+			if (!reject)
+			{
+				action_t update = action;
+				update.type = ACTION_UPDATE;
+				schedule(6, update); // instant of the update
+			}
+			break;
+		}
+		case ACTION_UPDATE:
+			anchor = Sim_Now();
+			interval = action.parameters.connIntvMin;
+			latency = action.parameters.connLatency;
+			stats.parameter_updates++;
+			trace_connection();
+			event.code = CYBLE_EVT_GAP_CONNECTION_UPDATE_COMPLETE;
+			event.param.connection.connIntv = interval;
+			event.param.connection.connLatency = latency;
+			event.param.connection.supervisionTO = action.parameters.supervisionTO;
+			push(event);
+			break;
+		case ACTION_DISCONNECT:
+			disconnect();
+			break;
+		}
+	}
+
+	uint64 tx_time()
+	{
+		if (tx.empty())
+			return SIM_NEVER;
+		uint64 t = tx.front().queued;
+		return event_at(t > last_tx_event ? t : last_tx_event + 1);
+	}
+
+	// Send queued notifications at a connection event
+	void transmit()
+	{
+		const uint64 now = Sim_Now();
+		last_tx_event = now;
+		stats.events++;
+		int packets = 0;
+		for (; packets < SIM_BLE_TX_PER_EVENT && !tx.empty(); ++packets)
+		{
+			uint64 delay = now - tx.front().telegram;
+			if (stats.delivered == 0 || delay < stats.latency_min)
+				stats.latency_min = delay;
+			if (delay > stats.latency_max)
+				stats.latency_max = delay;
+			stats.latency_total += delay;
+			stats.delivered++;
+			if (notification_sink != nullptr)
+				notification_sink(tx.front().handle, tx.front().value.data(),
+					(uint16)tx.front().value.size(), notification_context);
+			tx.pop_front();
+		}
+		Sim_Trace(SIM_SIGNAL_PACKETS, (uint32)packets);
+		if (busy && tx.size() < SIM_BLE_TX_BUFFERS)
+		{
+			busy = false;
+			event_t event;
+			memset(&event, 0, sizeof(event));
+			event.code = CYBLE_EVT_STACK_BUSY_STATUS;
+			event.param.u8 = CYBLE_STACK_STATE_FREE;
+			push(event);
+		}
+	}
+
+	uint64 ble_next()
+	{
+		uint64 t = connect_time();
+		if (state == CYBLE_STATE_CONNECTED)
+		{
+			if (!actions.empty() && actions.begin()->first < t)
+				t = actions.begin()->first;
+			uint64 tx_at = tx_time();
+			if (tx_at < t)
+				t = tx_at;
+		}
+		return t;
+	}
+
+	void ble_process()
+	{
+		const uint64 now = Sim_Now();
+		if (connect_time() <= now)
+			connect();
+		while (state == CYBLE_STATE_CONNECTED && !actions.empty() && actions.begin()->first <= now)
+		{
+			action_t action = actions.begin()->second;
+			actions.erase(actions.begin());
+			perform(action);
+		}
+		if (state == CYBLE_STATE_CONNECTED && tx_time() <= now)
+			transmit();
+	}
+
+	int ble_pending()
+	{
+		return interrupt;
+	}
+
+	void ble_interrupt()
+	{
+		interrupt = false;
+	}
+
+	void ble_reset()
+	{
+		callback = nullptr;
+		state = CYBLE_STATE_STOPPED;
+		lp_mode = CYBLE_BLESS_ACTIVE;
+		memset(&clock_config, 0, sizeof(clock_config));
+		attributes.clear();
+		stats = ble_sim_stats_t();
+		events.clear();
+		interrupt = false;
+		actions.clear();
+		centrals.clear();
+		central = 0;
+		advertising_since = 0;
+		anchor = last_tx_event = 0;
+		interval = latency = 0;
+		authenticating = busy = false;
+		tx.clear();
+		notification_sink = nullptr;
+		notification_context = nullptr;
+		scan_response_sink = nullptr;
+		scan_response_context = nullptr;
+		passkey = 0;
+		adv_data = adv_data_default;
+		scan_rsp = scan_rsp_default;
+		memset(&cyBle_connHandle, 0, sizeof(cyBle_connHandle));
+		memset(&cyBle_authInfo, 0, sizeof(cyBle_authInfo));
+		cyBle_pendingFlashWrite = 0;
+	}
+}
+
+const sim_device_t ble_device = { ble_next, ble_process, ble_pending, ble_interrupt, ble_reset };
+
+void BleSim_AddCentral(const sim_central_t& central)
+{
+	centrals.push_back(central);
+}
+
+const ble_sim_stats_t* BleSim_GetStats()
+{
+	return &stats;
+}
+
+void BleSim_SetNotificationSink(sim_notification_sink_t sink, void* context)
+{
+	notification_sink = sink;
+	notification_context = context;
+}
+
+void BleSim_SetScanResponseSink(sim_scan_response_sink_t sink, void* context)
+{
+	scan_response_sink = sink;
+	scan_response_context = context;
+}
+
+uint32 BleSim_GetPasskey()
+{
+	return passkey;
+}
+
+extern "C" {
+
+CYBLE_API_RESULT_T CyBle_Start(CYBLE_CALLBACK_T callbackFunc)
+{
+	callback = callbackFunc;
+	state = CYBLE_STATE_INITIALIZING;
+	Sim_Trace(SIM_SIGNAL_BLESS, lp_mode);
+	push(CYBLE_EVT_STACK_ON);
+	return CYBLE_ERROR_OK;
+}
+
+void CyBle_ProcessEvents(void)
+{
+	Sim_Active(SIM_LOOP_ACTIVE);
+	if (state == CYBLE_STATE_INITIALIZING)
+		state = CYBLE_STATE_DISCONNECTED;
+	while (!events.empty())
+	{
+		event_t event = events.front();
+		events.pop_front();
+		if (event.code == CYBLE_EVT_GATTS_WRITE_REQ)
+			event.param.write.handleValPair.value.val = event.value;
+		callback(event.code, &event.param);
+		if (event.code == CYBLE_EVT_GATTS_READ_CHAR_VAL_ACCESS_REQ)
+		{
+			// Response from the database, after the application updated it
+			stats.reads++;
+		}
+	}
+}
+
+CYBLE_STATE_T CyBle_GetState(void) { return state; }
+
+CYBLE_LP_MODE_T CyBle_EnterLPM(CYBLE_LP_MODE_T pwrMode)
+{
+	lp_mode = pwrMode;
+	Sim_Trace(SIM_SIGNAL_BLESS, lp_mode);
+	return lp_mode;
+}
+
+void CyBle_ExitLPM(void)
+{
+	lp_mode = CYBLE_BLESS_ACTIVE;
+	Sim_Trace(SIM_SIGNAL_BLESS, lp_mode);
+}
+
+CYBLE_BLESS_STATE_T CyBle_GetBleSsState(void)
+{
+	return lp_mode == CYBLE_BLESS_DEEPSLEEP ? CYBLE_BLESS_STATE_DEEPSLEEP : CYBLE_BLESS_STATE_ACTIVE;
+}
+
+uint8 CyBle_GattGetBusyStatus(void)
+{
+	return busy ? CYBLE_STACK_STATE_BUSY : CYBLE_STACK_STATE_FREE;
+}
+
+CYBLE_API_RESULT_T CyBle_GetBleClockCfgParam(CYBLE_BLESS_CLK_CFG_PARAMS_T* bleSsClockConfig)
+{
+	*bleSsClockConfig = clock_config;
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_SetBleClockCfgParam(const CYBLE_BLESS_CLK_CFG_PARAMS_T* bleSsClockConfig)
+{
+	clock_config = *bleSsClockConfig;
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GetDeviceAddress(CYBLE_GAP_BD_ADDR_T* bdAddr)
+{
+	static const uint8 address[6] = { 0x3C, 0x2B, 0x1A, 0x50, 0xA0, 0x00 };
+	memcpy(bdAddr->bdAddr, address, sizeof(address));
+	bdAddr->type = 0;
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_StoreBondingData(uint8 isForceWrite)
+{
+	(void)isForceWrite;
+	cyBle_pendingFlashWrite = 0;
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_StoreAppData(uint8* srcBuff, const uint8 destAddr[], uint32 buffLen, uint8 isForceWrite)
+{
+	if (state == CYBLE_STATE_CONNECTED)
+	{
+		if (!isForceWrite)
+			return CYBLE_ERROR_FLASH_WRITE_NOT_PERMITTED;
+		// The CPU is blocked, a connection event the peripheral listens to
+		// during the write is missed
+		stats.flash_writes++;
+		const uint64 listen = interval_time() * (latency + 1);
+		const uint64 now = Sim_Now();
+		uint64 next = now <= anchor ? anchor : anchor + (now - anchor + listen - 1) / listen * listen;
+		if (next < now + SIM_FLASH_WRITE)
+			stats.missed_events++;
+	}
+	Sim_FlashWrite(destAddr, srcBuff, buffLen);
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GappStartAdvertisement(uint8 advertisingIntervalType)
+{
+	(void)advertisingIntervalType;
+	if (state != CYBLE_STATE_DISCONNECTED)
+		return CYBLE_ERROR_INVALID_OPERATION;
+	state = CYBLE_STATE_ADVERTISING;
+	advertising_since = Sim_Now();
+	Sim_Trace(SIM_SIGNAL_ADVERTISING, 1);
+	push(CYBLE_EVT_GAPP_ADVERTISEMENT_START_STOP);
+	advertise_scan_response();
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GapUpdateAdvData(CYBLE_GAPP_DISC_DATA_T* advDiscData, CYBLE_GAPP_SCAN_RSP_DATA_T* advScanRespData)
+{
+	if (state != CYBLE_STATE_ADVERTISING)
+		return CYBLE_ERROR_INVALID_OPERATION;
+	if (advDiscData->advDataLen > CYBLE_GAP_MAX_ADV_DATA_LEN
+		|| advScanRespData->scanRspDataLen > CYBLE_GAP_MAX_SCAN_RSP_DATA_LEN)
+		return CYBLE_ERROR_INVALID_PARAMETER;
+	// The component advertises its own buffers
+	if (advDiscData != cyBle_discoveryModeInfo.advData)
+		*cyBle_discoveryModeInfo.advData = *advDiscData;
+	if (advScanRespData != cyBle_discoveryModeInfo.scanRspData)
+		*cyBle_discoveryModeInfo.scanRspData = *advScanRespData;
+	stats.advertising_updates++;
+	advertise_scan_response();
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GapDisconnect(uint8 bdHandle)
+{
+	(void)bdHandle;
+	if (state != CYBLE_STATE_CONNECTED)
+		return CYBLE_ERROR_INVALID_OPERATION;
+	schedule(1, ACTION_DISCONNECT);
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GapAuthReq(uint8 bdHandle, CYBLE_GAP_AUTH_INFO_T* authInfo)
+{
+	(void)bdHandle;
+	(void)authInfo;
+	if (state != CYBLE_STATE_CONNECTED || authenticating)
+		return CYBLE_ERROR_INVALID_OPERATION;
+	// Pairing takes a few more round trips than encryption with a bond
+	authenticating = true;
+	schedule(centrals[central].bonded ? 2 : 4, ACTION_SECURED);
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GapFixAuthPassKey(uint8 isFixed, uint32 fixedPassKey)
+{
+	(void)isFixed;
+	passkey = fixedPassKey;
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GapSetDataLength(uint8 bdHandle, uint16 connMaxTxOctets, uint16 connMaxTxTime)
+{
+	(void)bdHandle;
+	(void)connMaxTxOctets;
+	(void)connMaxTxTime;
+	return state == CYBLE_STATE_CONNECTED ? CYBLE_ERROR_OK : CYBLE_ERROR_INVALID_OPERATION;
+}
+
+CYBLE_API_RESULT_T CyBle_GapGetBondedDevicesList(CYBLE_GAP_BONDED_DEV_ADDR_LIST_T* bondedDevList)
+{
+	bondedDevList->count = 0;
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GapRemoveBondedDevice(CYBLE_GAP_BD_ADDR_T* bdAddr)
+{
+	(void)bdAddr;
+	return CYBLE_ERROR_NO_DEVICE_ENTITY;
+}
+
+CYBLE_API_RESULT_T CyBle_L2capLeConnectionParamUpdateRequest(uint8 bdHandle, CYBLE_GAP_CONN_UPDATE_PARAM_T* connParam)
+{
+	(void)bdHandle;
+	if (state != CYBLE_STATE_CONNECTED)
+		return CYBLE_ERROR_INVALID_OPERATION;
+	action_t action;
+	memset(&action, 0, sizeof(action));
+	action.type = ACTION_PARAMETERS;
+	action.parameters = *connParam;
+	schedule(1, action);
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_GATT_ERR_CODE_T CyBle_GattsWriteAttributeValue(CYBLE_GATT_HANDLE_VALUE_PAIR_T* handleValuePair,
+	uint16 offset, CYBLE_CONN_HANDLE_T* connHandle, uint8 flags)
+{
+	(void)connHandle;
+	(void)flags;
+	std::vector<uint8>& value = attributes[handleValuePair->attrHandle];
+	value.resize(offset + handleValuePair->value.len);
+	memcpy(value.data() + offset, handleValuePair->value.val, handleValuePair->value.len);
+	stats.attribute_writes++;
+	return CYBLE_GATT_ERR_NONE;
+}
+
+CYBLE_API_RESULT_T CyBle_GattsNotification(CYBLE_CONN_HANDLE_T connHandle, CYBLE_GATTS_HANDLE_VALUE_NTF_T* ntfParam)
+{
+	(void)connHandle;
+	if (state != CYBLE_STATE_CONNECTED)
+	{
+		stats.rejected++;
+		return CYBLE_ERROR_INVALID_OPERATION;
+	}
+	if (tx.size() >= SIM_BLE_TX_BUFFERS)
+	{
+		stats.rejected++;
+		return CYBLE_ERROR_INSUFFICIENT_RESOURCES;
+	}
+	const uint8* value = ntfParam->value.val;
+	tx.push_back(tx_t{ Sim_Now(), MeterSim_LastSent(), ntfParam->attrHandle,
+		std::vector<uint8>(value, value + ntfParam->value.len) });
+	stats.notifications++;
+	if (tx.size() == SIM_BLE_TX_BUFFERS)
+	{
+		// Last buffer taken, reported as busy
+		busy = true;
+		stats.busy++;
+		event_t event;
+		memset(&event, 0, sizeof(event));
+		event.code = CYBLE_EVT_STACK_BUSY_STATUS;
+		event.param.u8 = CYBLE_STACK_STATE_BUSY;
+		push(event);
+	}
+	return CYBLE_ERROR_OK;
+}
+
+CYBLE_API_RESULT_T CyBle_GattsWriteRsp(CYBLE_CONN_HANDLE_T connHandle)
+{
+	(void)connHandle;
+	return state == CYBLE_STATE_CONNECTED ? CYBLE_ERROR_OK : CYBLE_ERROR_INVALID_OPERATION;
+}
+
+CYBLE_API_RESULT_T CyBle_GattsErrorRsp(CYBLE_CONN_HANDLE_T connHandle, CYBLE_GATTS_ERR_PARAM_T* errRspParam)
+{
+	(void)connHandle;
+	(void)errRspParam;
+	if (state != CYBLE_STATE_CONNECTED)
+		return CYBLE_ERROR_INVALID_OPERATION;
+	stats.write_errors++;
+	return CYBLE_ERROR_OK;
+}
+
+}
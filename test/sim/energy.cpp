@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "energy.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+const energy_model_t energy_model_default = {
+	850,        // system
+	260,        // active_per_mhz
+	60,         // sleep_per_mhz
+	1.5,        // deepsleep
+	24,         // hfclk_mhz
+	325,        // imo, 24 MHz
+	1400,       // eco
+	16500,      // radio_tx
+	18700,      // radio_rx
+	2000,       // ble_wakeup_us, typical deep sleep wake-up of the BLESS
+	80,         // event_tx_us
+	150,        // event_rx_us, including window widening
+	328,        // packet_tx_us
+	80,         // packet_rx_us
+	376,        // adv_tx_us, 31 bytes advertising data
+	150,        // adv_rx_us
+	30,         // adv_fast_ms
+	30,         // adv_fast_s
+	1000,       // adv_slow_ms
+	5000,       // request
+	1000,       // pullup, 5.6 kOhm
+	100,        // uart
+	500,        // led
+};
+
+namespace {
+	struct parameter_t {
+		const char* name;
+		size_t offset;
+	};
+#define ENERGY_PARAMETER(name) { #name, offsetof(energy_model_t, name) }
+	const parameter_t parameters[] = {
+		ENERGY_PARAMETER(system), ENERGY_PARAMETER(active_per_mhz), ENERGY_PARAMETER(sleep_per_mhz),
+		ENERGY_PARAMETER(deepsleep), ENERGY_PARAMETER(hfclk_mhz), ENERGY_PARAMETER(imo), ENERGY_PARAMETER(eco),
+		ENERGY_PARAMETER(radio_tx), ENERGY_PARAMETER(radio_rx), ENERGY_PARAMETER(ble_wakeup_us),
+		ENERGY_PARAMETER(event_tx_us), ENERGY_PARAMETER(event_rx_us), ENERGY_PARAMETER(packet_tx_us),
+		ENERGY_PARAMETER(packet_rx_us), ENERGY_PARAMETER(adv_tx_us), ENERGY_PARAMETER(adv_rx_us),
+		ENERGY_PARAMETER(adv_fast_ms), ENERGY_PARAMETER(adv_fast_s), ENERGY_PARAMETER(adv_slow_ms),
+		ENERGY_PARAMETER(request), ENERGY_PARAMETER(pullup), ENERGY_PARAMETER(uart), ENERGY_PARAMETER(led),
+	};
+#undef ENERGY_PARAMETER
+
+	const char* const part_names[ENERGY_PART_COUNT] = {
+		"CPU", "IMO", "ECO", "Radio", "Meter", "UART", "LEDs"
+	};
+
+	double seconds(uint64 ns)
+	{
+		return ns / 1e9;
+	}
+
+	bool bless_deepsleep(const energy_t* energy)
+	{
+		uint32 bless = energy->signals[SIM_SIGNAL_BLESS];
+		return bless == 0 || bless == CYBLE_BLESS_DEEPSLEEP || bless == CYBLE_BLESS_HIBERNATE;
+	}
+
+	// Charge (uC) of the radio
+	double radio(const energy_model_t* m, double tx_us, double rx_us)
+	{
+		return (tx_us * m->radio_tx + rx_us * m->radio_rx) / 1e6;
+	}
+
+	// Charge (uC) of the ECO started for a radio event, when the BLESS sleeps
+	double wakeup(const energy_t* energy)
+	{
+		const energy_model_t* m = energy->model;
+		return bless_deepsleep(energy) ? m->ble_wakeup_us * m->eco / 1e6 : 0;
+	}
+
+	// Constant currents of the current state over [from, to)
+	void integrate_static(energy_t* energy, uint64 from, uint64 to)
+	{
+		const energy_model_t* m = energy->model;
+		const uint32* s = energy->signals;
+		const double t = seconds(to - from);
+		const uint32 cpu = s[SIM_SIGNAL_CPU];
+		const uint32 divider = s[SIM_SIGNAL_SYSCLK_DIV] ? s[SIM_SIGNAL_SYSCLK_DIV] : 1;
+		const double mhz = m->hfclk_mhz / divider;
+
+		if (cpu == SIM_CPU_DEEPSLEEP)
+			energy->charge[ENERGY_CPU] += m->deepsleep * t;
+		else
+		{
+			double per_mhz = cpu == SIM_CPU_ACTIVE ? m->active_per_mhz : m->sleep_per_mhz;
+			energy->charge[ENERGY_CPU] += (m->system + per_mhz * mhz - m->imo) * t;
+			if (s[SIM_SIGNAL_IMO])
+				energy->charge[ENERGY_IMO] += m->imo * t;
+			if (!bless_deepsleep(energy) || s[SIM_SIGNAL_HFCLK] == CY_SYS_CLK_HFCLK_ECO)
+				energy->charge[ENERGY_ECO] += m->eco * t;
+		}
+		if (s[SIM_SIGNAL_GPIO + SIM_GPIO_METER_REQUEST])
+			energy->charge[ENERGY_METER] += (m->request + m->pullup) * t;
+		if (s[SIM_SIGNAL_UART])
+			energy->charge[ENERGY_UART] += m->uart * t;
+		for (sim_gpio_t led : { SIM_GPIO_LED_METER, SIM_GPIO_LED_ADVERTISING, SIM_GPIO_LED_DISCONNECT })
+			if (s[SIM_SIGNAL_GPIO + led] == 0)
+				energy->charge[ENERGY_LED] += m->led * t;
+	}
+
+	// Periodic radio events over [from, to), as a rate
+	void integrate_radio(energy_t* energy, uint64 from, uint64 to)
+	{
+		const energy_model_t* m = energy->model;
+		const double t = seconds(to - from);
+		if (energy->signals[SIM_SIGNAL_CONNECTION] != 0)
+		{
+			double events = t * 1e6 / energy->signals[SIM_SIGNAL_CONNECTION];
+			energy->connection_events += events;
+			energy->charge[ENERGY_RADIO] += events * radio(m, m->event_tx_us, m->event_rx_us);
+			energy->charge[ENERGY_ECO] += events * wakeup(energy);
+		}
+		if (energy->signals[SIM_SIGNAL_ADVERTISING] != 0)
+		{
+			// Fast advertising first, split at the change to slow
+			const uint64 slow = energy->advertising_since + (uint64)(m->adv_fast_s * 1e9);
+			if (from < slow && slow < to)
+			{
+				integrate_radio(energy, from, slow);
+				integrate_radio(energy, slow, to);
+				return;
+			}
+			double interval = from < slow ? m->adv_fast_ms : m->adv_slow_ms;
+			double events = t * 1e3 / interval;
+			energy->advertising_events += events;
+			energy->charge[ENERGY_RADIO] += events * radio(m, 3 * m->adv_tx_us, 3 * m->adv_rx_us);
+			energy->charge[ENERGY_ECO] += events * wakeup(energy);
+		}
+	}
+
+	void integrate(energy_t* energy, uint64 to)
+	{
+		if (to <= energy->last)
+			return;
+		integrate_static(energy, energy->last, to);
+		integrate_radio(energy, energy->last, to);
+		energy->last = to;
+	}
+}
+
+bool Energy_SetParameter(energy_model_t* model, const char* assignment)
+{
+	const char* eq = strchr(assignment, '=');
+	if (eq == nullptr)
+		return false;
+	for (const parameter_t& parameter : parameters)
+		if (strlen(parameter.name) == (size_t)(eq - assignment)
+			&& strncmp(assignment, parameter.name, eq - assignment) == 0)
+		{
+			*(double*)((char*)model + parameter.offset) = atof(eq + 1);
+			return true;
+		}
+	return false;
+}
+
+void Energy_Init(energy_t* energy, const energy_model_t* model)
+{
+	memset(energy, 0, sizeof(*energy));
+	energy->model = model;
+}
+
+void Energy_Trace(const sim_trace_t& trace, void* context)
+{
+	energy_t* energy = (energy_t*)context;
+	if (!energy->started)
+	{
+		energy->started = true;
+		energy->start = energy->last = trace.time;
+	}
+	integrate(energy, trace.time);
+	if (trace.signal >= SIM_SIGNAL_COUNT)
+		return;
+	if (trace.signal == SIM_SIGNAL_PACKETS)
+	{
+		// Data packets of a connection event, beyond the empty exchange
+		const energy_model_t* m = energy->model;
+		energy->charge[ENERGY_RADIO] += trace.value * radio(m, m->packet_tx_us, m->packet_rx_us);
+		energy->packets += trace.value;
+		return;
+	}
+	if (trace.signal == SIM_SIGNAL_ADVERTISING && trace.value != 0 && energy->signals[trace.signal] == 0)
+		energy->advertising_since = trace.time;
+	energy->signals[trace.signal] = trace.value;
+}
+
+void Energy_Finish(energy_t* energy, uint64 end)
+{
+	integrate(energy, end);
+}
+
+double Energy_Seconds(const energy_t* energy)
+{
+	return seconds(energy->last - energy->start);
+}
+
+double Energy_AverageCurrent(const energy_t* energy)
+{
+	double total = 0;
+	for (double charge : energy->charge)
+		total += charge;
+	double t = Energy_Seconds(energy);
+	return t > 0 ? total / t : 0;
+}
+
+void Energy_Print(FILE* file, const energy_t* energy, double battery_mah)
+{
+	const double t = Energy_Seconds(energy);
+	const double average = Energy_AverageCurrent(energy);
+	fprintf(file, "Average current %.1f uA over %.0f s\n", average, t);
+	for (int part = 0; part < ENERGY_PART_COUNT; ++part)
+	{
+		double current = t > 0 ? energy->charge[part] / t : 0;
+		fprintf(file, "  %-6s %9.1f uA %5.1f%%\n", part_names[part], current,
+			average > 0 ? 100 * current / average : 0);
+	}
+	fprintf(file, "Radio events connection %.0f, advertising %.0f, data packets %u\n",
+		energy->connection_events, energy->advertising_events, (unsigned)energy->packets);
+	if (battery_mah > 0 && average > 0)
+		fprintf(file, "Battery %.0f mAh lasts %.0f days\n", battery_mah, battery_mah * 1000 / average / 24);
+}
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Energy model of the board, integrating the charge of a trace of the
+// simulated hardware (sim_trace_t). Currents are taken from "clock and
+// power modes.txt", radio figures from the PSoC 4 BLE datasheet. Radio
+// activity is charged per connection or advertising event, the simulation
+// does not run empty events.
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include "sim.h"
+
+#include <cstdio>
+
+// Currents in uA, times in us
+struct energy_model_t {
+	double system;              // active and sleep, plus per MHz below
+	double active_per_mhz;
+	double sleep_per_mhz;
+	double deepsleep;
+	double hfclk_mhz;           // IMO and ECO
+	double imo;                 // included in the system figures
+	double eco;
+	double radio_tx;            // 0 dBm
+	double radio_rx;
+	double ble_wakeup_us;       // ECO start before a radio event, BLESS in deep sleep
+	double event_tx_us;         // empty packet exchange of a connection event
+	double event_rx_us;
+	double packet_tx_us;        // data packet, 27 bytes payload
+	double packet_rx_us;        // acknowledgement
+	double adv_tx_us;           // advertising, per channel (3)
+	double adv_rx_us;
+	double adv_fast_ms;         // advertising intervals of the BLE component
+	double adv_fast_s;          // fast advertising duration
+	double adv_slow_ms;
+	double request;             // meter request line
+	double pullup;              // meter data line, sinking while requested
+	double uart;
+	double led;                 // each, on when low
+};
+extern const energy_model_t energy_model_default;
+// Set a field of the model from "name=value", false when unknown
+bool Energy_SetParameter(energy_model_t* model, const char* assignment);
+
+enum energy_part_t {
+	ENERGY_CPU,
+	ENERGY_IMO,
+	ENERGY_ECO,
+	ENERGY_RADIO,
+	ENERGY_METER,               // request line and data line pull-up
+	ENERGY_UART,
+	ENERGY_LED,
+	ENERGY_PART_COUNT
+};
+
+struct energy_t {
+	const energy_model_t* model;
+	bool started;
+	uint64 start;
+	uint64 last;                // integrated up to
+	uint32 signals[SIM_SIGNAL_COUNT];
+	uint64 advertising_since;
+	double charge[ENERGY_PART_COUNT]; // uC
+	double connection_events;
+	double advertising_events;
+	uint32 packets;
+};
+
+void Energy_Init(energy_t* energy, const energy_model_t* model);
+// Trace sink, context is the energy_t
+void Energy_Trace(const sim_trace_t& trace, void* energy);
+// Integrate up to time end, the end of the trace
+void Energy_Finish(energy_t* energy, uint64 end);
+double Energy_Seconds(const energy_t* energy);
+double Energy_AverageCurrent(const energy_t* energy); // uA
+// Breakdown, and battery life when battery_mah is not 0
+void Energy_Print(FILE* file, const energy_t* energy, double battery_mah);
+
+#endif // ENERGY_H
@@ -0,0 +1,498 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Virtual clock, interrupts, power modes, WDT and GPIO of the simulation.
+
+#include "sim.h"
+
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+	uint64 now = 0;
+	uint64 end = SIM_NEVER;
+	bool running = false;
+	jmp_buf run_exit;
+	uint8 interrupts_enabled = 1;
+	uint32 interrupts_run = 0;
+
+	sim_power_t power;
+	uint64* account = &power.active;
+
+	uint32 signals[SIM_SIGNAL_COUNT];
+	sim_trace_sink_t trace_sink = nullptr;
+	void* trace_context = nullptr;
+
+	sim_debug_uart_t debug_uart = nullptr;
+	void* debug_uart_context = nullptr;
+
+	// Flash keeps its contents and wear over Sim_Reset
+	std::map<uintptr_t, uint32> flash_row_writes;
+	uint32 flash_loss_in = 0;       // writes until power loss, 0 when none
+	size_t flash_loss_programmed = 0;
+	bool flash_off = false;
+
+	void signals_reset()
+	{
+		memset(signals, 0, sizeof(signals));
+		signals[SIM_SIGNAL_GPIO + SIM_GPIO_BTN_USER] = 1;
+		signals[SIM_SIGNAL_CPU] = SIM_CPU_ACTIVE;
+		signals[SIM_SIGNAL_SYSCLK_DIV] = 1;
+		signals[SIM_SIGNAL_HFCLK] = CY_SYS_CLK_HFCLK_IMO;
+		signals[SIM_SIGNAL_IMO] = 1;
+		trace_sink = nullptr;
+		trace_context = nullptr;
+	}
+
+	// WDT counters run from the 32768 Hz LFCLK
+	const uint64 lfclk = 32768;
+
+	uint64 ticks(uint64 ns)
+	{
+		return ns / SIM_SECONDS(1) * lfclk + ns % SIM_SECONDS(1) * lfclk / SIM_SECONDS(1);
+	}
+
+	uint64 tick_time(uint64 tick)
+	{
+		return tick / lfclk * SIM_SECONDS(1) + (tick % lfclk * SIM_SECONDS(1) + lfclk - 1) / lfclk;
+	}
+
+	// WDT0 free running 16 bit counter with match interrupt
+	struct {
+		bool enabled;
+		uint32 mode;
+		cyisraddress callback;
+		uint64 enable_tick;
+		uint64 match_tick;      // next match, absolute
+		bool pending;
+	} wdt0;
+
+	uint32 wdt0_count()
+	{
+		return wdt0.enabled ? (uint32)((ticks(now) - wdt0.enable_tick) & 0xFFFF) : 0;
+	}
+
+	uint64 wdt_next()
+	{
+		return wdt0.enabled && wdt0.mode == CY_SYS_WDT_MODE_INT && wdt0.match_tick != SIM_NEVER
+			? tick_time(wdt0.match_tick) : SIM_NEVER;
+	}
+
+	void wdt_process()
+	{
+		while (wdt_next() <= now)
+		{
+			wdt0.pending = true;
+			wdt0.match_tick += 0x10000;
+		}
+	}
+
+	int wdt_pending()
+	{
+		return wdt0.pending && wdt0.callback != nullptr;
+	}
+
+	void wdt_interrupt()
+	{
+		wdt0.pending = false;
+		wdt0.callback();
+	}
+
+	void wdt_reset()
+	{
+		memset(&wdt0, 0, sizeof(wdt0));
+		wdt0.match_tick = SIM_NEVER;
+	}
+
+	const sim_device_t wdt_device = { wdt_next, wdt_process, wdt_pending, wdt_interrupt, wdt_reset };
+
+	const sim_device_t* const devices[] = { &wdt_device, &uart_device, &ble_device };
+
+	uint64 next_event()
+	{
+		uint64 t = SIM_NEVER;
+		for (const sim_device_t* device : devices)
+		{
+			uint64 next = device->next();
+			if (next < t)
+				t = next;
+		}
+		return t;
+	}
+
+	bool interrupt_pending()
+	{
+		for (const sim_device_t* device : devices)
+			if (device->pending())
+				return true;
+		return false;
+	}
+
+	void run_interrupts()
+	{
+		// Interrupts retrigger while their source remains
+		for (int guard = 0; interrupts_enabled; ++guard)
+		{
+			const sim_device_t* pending = nullptr;
+			for (const sim_device_t* device : devices)
+				if (device->pending())
+				{
+					pending = device;
+					break;
+				}
+			if (pending == nullptr)
+				return;
+			if (guard == 100000)
+			{
+				fprintf(stderr, "Interrupt source not cleared at %llu ns\n", (unsigned long long)now);
+				abort();
+			}
+			pending->interrupt();
+			interrupts_run++;
+		}
+	}
+
+	// Move the clock to t (at most the end of the run), process due events
+	void step(uint64 t)
+	{
+		if (t > end)
+			t = end;
+		if (t == SIM_NEVER)
+		{
+			fprintf(stderr, "Waiting forever at %llu ns\n", (unsigned long long)now);
+			abort();
+		}
+		if (t > now)
+		{
+			*account += t - now;
+			now = t;
+		}
+		for (bool due = true; due; )
+		{
+			due = false;
+			for (const sim_device_t* device : devices)
+				if (device->next() <= now)
+				{
+					device->process();
+					due = true;
+				}
+		}
+		run_interrupts();
+		if (running && now >= end)
+			longjmp(run_exit, 1);
+	}
+
+	// CPU sleeps until an interrupt is pending (also when masked)
+	void sleep(uint64* mode, sim_cpu_t cpu)
+	{
+		account = mode;
+		Sim_Trace(SIM_SIGNAL_CPU, cpu);
+		uint32 run = interrupts_run;
+		while (!interrupt_pending() && run == interrupts_run)
+			step(next_event());
+		account = &power.active;
+		Sim_Trace(SIM_SIGNAL_CPU, SIM_CPU_ACTIVE);
+		power.wakeups++;
+	}
+
+	struct gpio_t {
+		sim_gpio_state_t state;
+		uint64 since;           // high accounted up to
+	};
+	gpio_t gpio[SIM_GPIO_COUNT];
+
+	void gpio_write(sim_gpio_t id, uint8 level)
+	{
+		gpio_t& pin = gpio[id];
+		if (pin.state.level != 0)
+			pin.state.high += now - pin.since;
+		pin.since = now;
+		if (level != pin.state.level)
+		{
+			if (pin.state.level == 0)
+				pin.state.rising++;
+			pin.state.changed = now;
+			pin.state.level = level;
+			Sim_Trace((sim_signal_t)(SIM_SIGNAL_GPIO + id), level);
+		}
+	}
+
+	void gpio_reset()
+	{
+		memset(gpio, 0, sizeof(gpio));
+		// LEDs are on (low) after reset, button has a pull-up
+		gpio[SIM_GPIO_BTN_USER].state.level = 1;
+	}
+}
+
+void Sim_Reset()
+{
+	now = 0;
+	end = SIM_NEVER;
+	running = false;
+	interrupts_enabled = 1;
+	power = sim_power_t();
+	account = &power.active;
+	signals_reset();
+	gpio_reset();
+	debug_uart = nullptr;
+	debug_uart_context = nullptr;
+	for (const sim_device_t* device : devices)
+		device->reset();
+}
+
+uint64 Sim_Now()
+{
+	return now;
+}
+
+void Sim_Advance(uint64 until)
+{
+	for (;;)
+	{
+		uint64 t = next_event();
+		if (t >= until)
+		{
+			step(until);
+			return;
+		}
+		step(t);
+	}
+}
+
+void Sim_RunFirmware(int (*main)(void), uint64 run_end)
+{
+	end = run_end;
+	running = true;
+	if (setjmp(run_exit) == 0)
+		main();
+	running = false;
+	end = SIM_NEVER;
+	account = &power.active;
+}
+
+const sim_power_t* Sim_GetPower()
+{
+	return &power;
+}
+
+void Sim_Active(uint64 duration)
+{
+	Sim_Advance(now + duration);
+}
+
+void Sim_FlashWrite(const void* destination, const void* source, size_t length)
+{
+	// Firmware flash is const data, writable only while programming
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t first = (uintptr_t)destination & ~(page - 1);
+	size_t size = ((uintptr_t)destination + length - first + page - 1) & ~(page - 1);
+	if (mprotect((void*)first, size, PROT_READ | PROT_WRITE) != 0)
+	{
+		perror("mprotect");
+		abort();
+	}
+	// Rows are erased (zero) and programmed, power loss stops in between
+	const uintptr_t row_first = (uintptr_t)destination & ~(uintptr_t)(CY_FLASH_SIZEOF_ROW - 1);
+	for (uintptr_t row = row_first; row < (uintptr_t)destination + length; row += CY_FLASH_SIZEOF_ROW)
+		flash_row_writes[row]++;
+	if (flash_loss_in != 0 && --flash_loss_in == 0)
+	{
+		memset((void*)destination, 0, length);
+		memcpy((void*)destination, source, flash_loss_programmed < length ? flash_loss_programmed : length);
+		flash_off = true;
+	}
+	else if (!flash_off)
+		memcpy((void*)destination, source, length);
+	mprotect((void*)first, size, PROT_READ);
+	power.flash_writes++;
+	Sim_Active(SIM_FLASH_WRITE);
+}
+
+uint32 Sim_FlashRowWrites(const void* address)
+{
+	auto row = flash_row_writes.find((uintptr_t)address & ~(uintptr_t)(CY_FLASH_SIZEOF_ROW - 1));
+	return row != flash_row_writes.end() ? row->second : 0;
+}
+
+void Sim_FlashPowerLoss(uint32 write, size_t programmed)
+{
+	flash_loss_in = write;
+	flash_loss_programmed = programmed;
+	flash_off = false;
+}
+
+void Sim_SetTraceSink(sim_trace_sink_t sink, void* context)
+{
+	trace_sink = sink;
+	trace_context = context;
+	if (sink == nullptr)
+		return;
+	for (int signal = 0; signal < SIM_SIGNAL_COUNT; ++signal)
+		if (signal != SIM_SIGNAL_PACKETS)
+			sink(sim_trace_t{ now, (sim_signal_t)signal, signals[signal] }, context);
+}
+
+void Sim_Trace(sim_signal_t signal, uint32 value)
+{
+	// Events are traced each time, levels on change
+	if (signal != SIM_SIGNAL_PACKETS && signals[signal] == value)
+		return;
+	signals[signal] = value;
+	if (trace_sink != nullptr)
+		trace_sink(sim_trace_t{ now, signal, value }, trace_context);
+}
+
+void Sim_SetDebugUart(sim_debug_uart_t receive, void* context)
+{
+	debug_uart = receive;
+	debug_uart_context = context;
+}
+
+sim_gpio_state_t Sim_GetGpio(sim_gpio_t id)
+{
+	sim_gpio_state_t state = gpio[id].state;
+	if (state.level != 0)
+		state.high += now - gpio[id].since;
+	return state;
+}
+
+void Sim_SetGpio(sim_gpio_t id, uint8 level)
+{
+	gpio_write(id, level);
+}
+
+extern "C" {
+
+/* CyLib */
+
+uint8 CyEnterCriticalSection(void)
+{
+	uint8 saved = interrupts_enabled;
+	interrupts_enabled = 0;
+	return saved;
+}
+
+void CyExitCriticalSection(uint8 savedIntrStatus)
+{
+	interrupts_enabled = savedIntrStatus;
+	run_interrupts();
+}
+
+void CyDelay(uint32 milliseconds)
+{
+	Sim_Active(SIM_MS(milliseconds));
+}
+
+void CyGetUniqueId(uint32* uniqueId)
+{
+	uniqueId[0] = 0x0B1A2C10u;
+	uniqueId[1] = 0x00152F03u;
+}
+
+void CySysClkWriteHfclkDirect(uint32 clkSelect) { Sim_Trace(SIM_SIGNAL_HFCLK, clkSelect); }
+void CySysClkWriteSysclkDiv(uint32 divider) { Sim_Trace(SIM_SIGNAL_SYSCLK_DIV, 1u << divider); }
+void CySysClkImoStart(void) { Sim_Trace(SIM_SIGNAL_IMO, 1); }
+void CySysClkImoStop(void) { Sim_Trace(SIM_SIGNAL_IMO, 0); }
+
+void CySysPmSleep(void)
+{
+	sleep(&power.sleep, SIM_CPU_SLEEP);
+}
+
+void CySysPmDeepSleep(void)
+{
+	sleep(&power.deepsleep, SIM_CPU_DEEPSLEEP);
+}
+
+/* WDT */
+
+void CySysWdtSetMode(uint32 counterNum, uint32 mode)
+{
+	if (counterNum == CY_SYS_WDT_COUNTER0)
+		wdt0.mode = mode;
+}
+
+void CySysWdtSetClearOnMatch(uint32 counterNum, uint32 enable)
+{
+	// Counter 0 only runs free (clear on match is not simulated)
+	(void)counterNum;
+	if (enable)
+		abort();
+}
+
+void CySysWdtSetMatch(uint32 counterNum, uint32 match)
+{
+	if (counterNum != CY_SYS_WDT_COUNTER0)
+		return;
+	uint32 delta = (match - wdt0_count()) & 0xFFFF;
+	wdt0.match_tick = ticks(now) + (delta != 0 ? delta : 0x10000);
+}
+
+void CySysWdtEnable(uint32 counterMask)
+{
+	if ((counterMask & CY_SYS_WDT_COUNTER0_MASK) && !wdt0.enabled)
+	{
+		wdt0.enabled = true;
+		wdt0.enable_tick = ticks(now);
+	}
+}
+
+void CySysWdtSetIsrCallback(uint32 counterNum, cyisraddress function)
+{
+	if (counterNum == CY_SYS_WDT_COUNTER0)
+		wdt0.callback = function;
+}
+
+uint32 CySysWdtGetCount(uint32 counterNum)
+{
+	switch (counterNum)
+	{
+	case CY_SYS_WDT_COUNTER0:
+		return wdt0_count();
+	case CY_SYS_WDT_COUNTER2:
+		return (uint32)ticks(now);
+	default:
+		return 0;
+	}
+}
+
+/* Pins */
+
+void LED_Meter_Write(uint8 value) { gpio_write(SIM_GPIO_LED_METER, value); }
+void LED_Advertising_Write(uint8 value) { gpio_write(SIM_GPIO_LED_ADVERTISING, value); }
+uint8 LED_Advertising_Read(void) { return gpio[SIM_GPIO_LED_ADVERTISING].state.level; }
+void LED_Disconnect_Write(uint8 value) { gpio_write(SIM_GPIO_LED_DISCONNECT, value); }
+uint8 LED_Disconnect_Read(void) { return gpio[SIM_GPIO_LED_DISCONNECT].state.level; }
+uint8 BTN_User_Read(void) { return gpio[SIM_GPIO_BTN_USER].state.level; }
+void Meter_Request_OUT_Write(uint8 value) { gpio_write(SIM_GPIO_METER_REQUEST, value); }
+void Meter_Invert_VALUE_Write(uint8 value) { gpio_write(SIM_GPIO_METER_INVERT, value); }
+
+/* Debug UART, transmits immediately */
+
+void UART_Debug_Start(void) {}
+
+void UART_Debug_UartPutString(const char* string)
+{
+	while (*string != 0)
+		UART_Debug_SpiUartWriteTxData((uint8)*string++);
+}
+
+void UART_Debug_SpiUartWriteTxData(uint32 txDataByte)
+{
+	if (debug_uart != nullptr)
+		debug_uart((uint8)txDataByte, debug_uart_context);
+	else
+		putchar((int)txDataByte);
+}
+
+uint32 UART_Debug_SpiUartGetTxBufferSize(void) { return 0; }
+void UART_Debug_Sleep(void) {}
+void UART_Debug_Wakeup(void) {}
+
+}
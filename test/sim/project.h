@@ -0,0 +1,407 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Host replacement of the PSoC Creator generated API, for the parts used
+// by the firmware. Implemented on a virtual clock in hal.cpp (system, WDT,
+// GPIO, power), uart_mock.cpp (meter UART) and ble_sim.cpp (BLE stack).
+// Control of the simulation is in sim.h.
+
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* cytypes.h */
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t int8;
+typedef int16_t int16;
+typedef int32_t int32;
+typedef uint64_t uint64;
+
+#define LO8(x) ((uint8)((x) & 0xFFu))
+#define HI8(x) ((uint8)((uint16)(x) >> 8))
+#define CY_ALIGN(align) __attribute__((aligned(align)))
+#define CY_FLASH_SIZEOF_ROW 256u    // CY8C4248, 256 KB flash
+
+#define CY_ISR_PROTO(FuncName) void FuncName(void)
+#define CY_ISR(FuncName) void FuncName(void)
+typedef void (*cyisraddress)(void);
+
+#define CYASSERT(x) assert(x)
+
+/* CyLib.h */
+
+uint8 CyEnterCriticalSection(void);
+void CyExitCriticalSection(uint8 savedIntrStatus);
+#define CyGlobalIntEnable CyExitCriticalSection(1u)
+void CyDelay(uint32 milliseconds);
+void CyGetUniqueId(uint32* uniqueId);
+
+#define CY_SYS_CLK_HFCLK_IMO 0u
+#define CY_SYS_CLK_HFCLK_ECO 2u
+#define CY_SYS_CLK_SYSCLK_DIV1 0u
+#define CY_SYS_CLK_SYSCLK_DIV4 2u
+void CySysClkWriteHfclkDirect(uint32 clkSelect);
+void CySysClkWriteSysclkDiv(uint32 divider);
+void CySysClkImoStart(void);
+void CySysClkImoStop(void);
+
+void CySysPmSleep(void);
+void CySysPmDeepSleep(void);
+
+/* cyLfclk.h, WDT counter 0 and 1 are 16 bits, counter 2 is 32 bits */
+
+#define CY_SYS_WDT_COUNTER0 0u
+#define CY_SYS_WDT_COUNTER1 1u
+#define CY_SYS_WDT_COUNTER2 2u
+#define CY_SYS_WDT_COUNTER0_MASK 0x01u
+#define CY_SYS_WDT_MODE_NONE 0u
+#define CY_SYS_WDT_MODE_INT 1u
+void CySysWdtSetMode(uint32 counterNum, uint32 mode);
+void CySysWdtSetClearOnMatch(uint32 counterNum, uint32 enable);
+void CySysWdtSetMatch(uint32 counterNum, uint32 match);
+void CySysWdtEnable(uint32 counterMask);
+void CySysWdtSetIsrCallback(uint32 counterNum, cyisraddress function);
+uint32 CySysWdtGetCount(uint32 counterNum);
+
+/* Pins */
+
+void LED_Meter_Write(uint8 value);
+void LED_Advertising_Write(uint8 value);
+uint8 LED_Advertising_Read(void);
+void LED_Disconnect_Write(uint8 value);
+uint8 LED_Disconnect_Read(void);
+uint8 BTN_User_Read(void);
+void Meter_Request_OUT_Write(uint8 value);
+void Meter_Invert_VALUE_Write(uint8 value);
+
+/* Debug UART */
+
+void UART_Debug_Start(void);
+void UART_Debug_UartPutString(const char* string);
+uint32 UART_Debug_SpiUartGetTxBufferSize(void);
+void UART_Debug_SpiUartWriteTxData(uint32 txDataByte);
+#define UART_Debug_TX_BUFFER_SIZE 8u
+#define UART_Debug_GET_TX_FIFO_SR_VALID 0u
+void UART_Debug_Sleep(void);
+void UART_Debug_Wakeup(void);
+
+/* Meter UART (SCB), 8 byte RX FIFO */
+
+#define UART_Meter_FIFO_SIZE 8u
+#define UART_Meter_INTR_RX_TRIGGER 0x0001u
+#define UART_Meter_INTR_RX_NOT_EMPTY 0x0004u
+#define UART_Meter_INTR_RX_OVERFLOW 0x0020u
+#define UART_Meter_INTR_RX_FRAME_ERROR 0x0100u
+
+void UART_Meter_Start(void);
+void UART_Meter_Stop(void);
+void UART_Meter_SetCustomInterruptHandler(cyisraddress func);
+void UART_Meter_SetRxFifoLevel(uint32 level);
+void UART_Meter_SetRxInterruptMode(uint32 interruptMask);
+uint32 UART_Meter_GetRxInterruptSource(void);
+void UART_Meter_ClearRxInterruptSource(uint32 interruptMask);
+void UART_Meter_ClearPendingInt(void);
+uint32 UART_Meter_SpiUartReadRxData(void);
+uint32 UART_Meter_SpiUartGetRxBufferSize(void);
+
+/* BLE component */
+
+typedef enum {
+    CYBLE_ERROR_OK = 0x0000u,
+    CYBLE_ERROR_INVALID_PARAMETER = 0x0001u,
+    CYBLE_ERROR_INVALID_OPERATION = 0x0002u,
+    CYBLE_ERROR_INSUFFICIENT_RESOURCES = 0x0004u,
+    CYBLE_ERROR_NO_DEVICE_ENTITY = 0x0005u,
+    CYBLE_ERROR_FLASH_WRITE_NOT_PERMITTED = 0x0018u
+} CYBLE_API_RESULT_T;
+
+typedef enum {
+    CYBLE_STATE_STOPPED,
+    CYBLE_STATE_INITIALIZING,
+    CYBLE_STATE_CONNECTED,
+    CYBLE_STATE_ADVERTISING,
+    CYBLE_STATE_DISCONNECTED
+} CYBLE_STATE_T;
+
+typedef enum {
+    CYBLE_BLESS_STATE_ACTIVE = 1,
+    CYBLE_BLESS_STATE_EVENT_CLOSE,
+    CYBLE_BLESS_STATE_SLEEP,
+    CYBLE_BLESS_STATE_ECO_ON,
+    CYBLE_BLESS_STATE_ECO_STABLE,
+    CYBLE_BLESS_STATE_DEEPSLEEP,
+    CYBLE_BLESS_STATE_HIBERNATE
+} CYBLE_BLESS_STATE_T;
+
+typedef enum {
+    CYBLE_BLESS_ACTIVE = 1,
+    CYBLE_BLESS_SLEEP,
+    CYBLE_BLESS_DEEPSLEEP,
+    CYBLE_BLESS_HIBERNATE,
+    CYBLE_BLESS_INVALID = 0xFF
+} CYBLE_LP_MODE_T;
+
+typedef enum {
+    CYBLE_EVT_HOST_INVALID = 0x00,
+    CYBLE_EVT_STACK_ON = 0x01,
+    CYBLE_EVT_TIMEOUT,
+    CYBLE_EVT_HARDWARE_ERROR,
+    CYBLE_EVT_HCI_STATUS,
+    CYBLE_EVT_STACK_BUSY_STATUS,
+    CYBLE_EVT_PENDING_FLASH_WRITE,
+    CYBLE_EVT_GAP_AUTH_REQ = 0x20,
+    CYBLE_EVT_GAP_PASSKEY_ENTRY_REQUEST,
+    CYBLE_EVT_GAP_PASSKEY_DISPLAY_REQUEST,
+    CYBLE_EVT_GAP_AUTH_COMPLETE,
+    CYBLE_EVT_GAP_AUTH_FAILED,
+    CYBLE_EVT_GAPP_ADVERTISEMENT_START_STOP,
+    CYBLE_EVT_GAP_DEVICE_CONNECTED,
+    CYBLE_EVT_GAP_DEVICE_DISCONNECTED,
+    CYBLE_EVT_GAP_ENCRYPT_CHANGE,
+    CYBLE_EVT_GAP_CONNECTION_UPDATE_COMPLETE,
+    CYBLE_EVT_GAP_KEYINFO_EXCHNGE_CMPLT,
+    CYBLE_EVT_GAP_DATA_LENGTH_CHANGE,
+    CYBLE_EVT_GAP_ENHANCE_CONN_COMPLETE,
+    CYBLE_EVT_GAP_SMP_NEGOTIATED_AUTH_INFO,
+    CYBLE_EVT_GATT_CONNECT_IND = 0x40,
+    CYBLE_EVT_GATT_DISCONNECT_IND,
+    CYBLE_EVT_GATTS_XCNHG_MTU_REQ,
+    CYBLE_EVT_GATTS_WRITE_REQ,
+    CYBLE_EVT_GATTS_WRITE_CMD_REQ,
+    CYBLE_EVT_GATTS_PREP_WRITE_REQ,
+    CYBLE_EVT_GATTS_EXEC_WRITE_REQ,
+    CYBLE_EVT_GATTS_HANDLE_VALUE_CNF,
+    CYBLE_EVT_GATTS_DATA_SIGNED_CMD_REQ,
+    CYBLE_EVT_GATTS_INDICATION_ENABLED,
+    CYBLE_EVT_GATTS_INDICATION_DISABLED,
+    CYBLE_EVT_GATTS_READ_CHAR_VAL_ACCESS_REQ,
+    CYBLE_EVT_L2CAP_CONN_PARAM_UPDATE_REQ = 0x70,
+    CYBLE_EVT_L2CAP_CONN_PARAM_UPDATE_RSP,
+    CYBLE_EVT_L2CAP_COMMAND_REJ,
+    CYBLE_EVT_L2CAP_CBFC_CONN_IND,
+    CYBLE_EVT_L2CAP_CBFC_CONN_CNF,
+    CYBLE_EVT_L2CAP_CBFC_DISCONN_IND,
+    CYBLE_EVT_L2CAP_CBFC_DISCONN_CNF,
+    CYBLE_EVT_L2CAP_CBFC_DATA_READ,
+    CYBLE_EVT_L2CAP_CBFC_RX_CREDIT_IND,
+    CYBLE_EVT_L2CAP_CBFC_TX_CREDIT_IND,
+    CYBLE_EVT_L2CAP_CBFC_DATA_WRITE_IND
+} CYBLE_EVT_T;
+
+typedef void (*CYBLE_CALLBACK_T)(uint32 eventCode, void* eventParam);
+
+#define CYBLE_ADVERTISING_FAST 0x00u
+#define CYBLE_ADVERTISING_SLOW 0x01u
+#define CYBLE_STACK_STATE_FREE 0x00u
+#define CYBLE_STACK_STATE_BUSY 0x01u
+#define CYBLE_LL_SCA_000_TO_020_PPM 0x07u
+#define CYBLE_GATT_DEFAULT_MTU 23u
+#define CYBLE_GATT_MTU 247u // as configured in the component
+#define CYBLE_GATT_DB_LOCALLY_INITIATED 0x00u
+#define CYBLE_GATT_WRITE_REQ 0x12u
+
+typedef enum {
+    CYBLE_GATT_ERR_NONE = 0x00u,
+    CYBLE_GATT_ERR_INVALID_HANDLE = 0x01u,
+    CYBLE_GATT_ERR_READ_NOT_PERMITTED = 0x02u,
+    CYBLE_GATT_ERR_WRITE_NOT_PERMITTED = 0x03u,
+    CYBLE_GATT_ERR_INVALID_ATTRIBUTE_LEN = 0x0Du,
+    CYBLE_GATT_ERR_CCCD_IMPROPERLY_CONFIGURED = 0xFDu,
+    CYBLE_GATT_ERR_PROCEDURE_ALREADY_IN_PROGRESS = 0xFEu,
+    CYBLE_GATT_ERR_OUT_OF_RANGE = 0xFFu
+} CYBLE_GATT_ERR_CODE_T;
+
+typedef uint16 CYBLE_GATT_DB_ATTR_HANDLE_T;
+
+// Attribute handles generated for the GATT database
+#define CYBLE_POWER_METER_CONSUMPTION_CHAR_HANDLE 0x0010u
+#define CYBLE_POWER_METER_CONSUMPTION_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0011u
+#define CYBLE_POWER_METER_TARIFF_CHAR_HANDLE 0x0013u
+#define CYBLE_POWER_METER_TARIFF_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0014u
+#define CYBLE_POWER_METER_TIMESTAMP_CHAR_HANDLE 0x0016u
+#define CYBLE_POWER_METER_TIMESTAMP_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0017u
+#define CYBLE_POWER_METER_INSTANTANEOUS_POWER_CHAR_HANDLE 0x0019u
+#define CYBLE_POWER_METER_INSTANTANEOUS_POWER_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x001Au
+#define CYBLE_POWER_METER_INSTANTANEOUS_PHASEINFO_CHAR_HANDLE 0x001Cu
+#define CYBLE_POWER_METER_INSTANTANEOUS_PHASEINFO_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x001Du
+#define CYBLE_POWER_METER_SNAPSHOT_CHAR_HANDLE 0x001Fu
+#define CYBLE_POWER_METER_SNAPSHOT_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0020u
+#define CYBLE_POWER_METER_INTERVAL_CHAR_HANDLE 0x0022u
+#define CYBLE_POWER_METER_DIAGNOSTICS_CHAR_HANDLE 0x0024u
+#define CYBLE_POWER_METER_EVENT_LOG_CHAR_HANDLE 0x002Bu
+#define CYBLE_POWER_METER_HISTORY_CONTROL_CHAR_HANDLE 0x002Du
+#define CYBLE_POWER_METER_HISTORY_CONTROL_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x002Eu
+#define CYBLE_POWER_METER_HISTORY_DATA_CHAR_HANDLE 0x0030u
+#define CYBLE_POWER_METER_HISTORY_DATA_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0031u
+#define CYBLE_POWER_METER_AGGREGATE_CHAR_HANDLE 0x0033u
+#define CYBLE_POWER_METER_AGGREGATE_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0034u
+#define CYBLE_POWER_METER_DEMAND_CHAR_HANDLE 0x0036u
+#define CYBLE_POWER_METER_DEMAND_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0037u
+#define CYBLE_POWER_METER_DEADBAND_CHAR_HANDLE 0x0039u
+#define CYBLE_POWER_METER_BEACON_CHAR_HANDLE 0x003Bu
+#define CYBLE_GAS_METER_CONSUMPTION_CHAR_HANDLE 0x0025u
+#define CYBLE_GAS_METER_CONSUMPTION_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0026u
+#define CYBLE_GAS_METER_TIMESTAMP_CHAR_HANDLE 0x0028u
+#define CYBLE_GAS_METER_TIMESTAMP_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE 0x0029u
+
+typedef struct {
+    uint8 bdHandle;
+    uint8 attId;
+} CYBLE_CONN_HANDLE_T;
+
+typedef struct {
+    uint8* val;
+    uint16 len;
+    uint16 actualLen;
+} CYBLE_GATT_VALUE_T;
+
+typedef struct {
+    CYBLE_GATT_VALUE_T value;
+    CYBLE_GATT_DB_ATTR_HANDLE_T attrHandle;
+} CYBLE_GATT_HANDLE_VALUE_PAIR_T;
+
+typedef CYBLE_GATT_HANDLE_VALUE_PAIR_T CYBLE_GATTS_HANDLE_VALUE_NTF_T;
+
+typedef struct {
+    CYBLE_CONN_HANDLE_T connHandle;
+    CYBLE_GATT_HANDLE_VALUE_PAIR_T handleValPair;
+} CYBLE_GATTS_WRITE_REQ_PARAM_T;
+
+typedef struct {
+    CYBLE_CONN_HANDLE_T connHandle;
+    CYBLE_GATT_DB_ATTR_HANDLE_T attrHandle;
+    CYBLE_GATT_ERR_CODE_T gattErrorCode;
+} CYBLE_GATTS_CHAR_VAL_READ_REQ_T;
+
+typedef struct {
+    CYBLE_CONN_HANDLE_T connHandle;
+    uint16 mtu;
+} CYBLE_GATT_XCHG_MTU_PARAM_T;
+
+typedef struct {
+    CYBLE_GATT_DB_ATTR_HANDLE_T attrHandle;
+    uint8 opcode;
+    CYBLE_GATT_ERR_CODE_T errorCode;
+} CYBLE_GATTS_ERR_PARAM_T;
+
+typedef struct {
+    uint8 bdAddr[6];
+    uint8 type;
+} CYBLE_GAP_BD_ADDR_T;
+
+#define CYBLE_GAP_MAX_BONDED_DEVICE 4u
+typedef struct {
+    uint8 count;
+    CYBLE_GAP_BD_ADDR_T bdAddrList[CYBLE_GAP_MAX_BONDED_DEVICE];
+} CYBLE_GAP_BONDED_DEV_ADDR_LIST_T;
+
+typedef struct {
+    uint8 security;
+    uint8 bonding;
+    uint8 ekeySize;
+    uint8 authErr;
+    uint8 pairingProperties;
+} CYBLE_GAP_AUTH_INFO_T;
+
+typedef struct {
+    uint8 bleLlSca;
+    uint8 bleLlClockDiv;
+    uint16 ecoXtalStartUpTime;
+} CYBLE_BLESS_CLK_CFG_PARAMS_T;
+
+typedef struct {
+    uint16 connIntvMin;
+    uint16 connIntvMax;
+    uint16 connLatency;
+    uint16 supervisionTO;
+} CYBLE_GAP_CONN_UPDATE_PARAM_T;
+
+typedef struct {
+    uint8 status;
+    uint16 connIntv;
+    uint16 connLatency;
+    uint16 supervisionTO;
+} CYBLE_GAP_CONN_PARAM_UPDATED_IN_CONTROLLER_T;
+
+typedef struct {
+    uint8 status;
+    uint8 role;
+    uint8 peerBdAddrType;
+    uint8 peerBdAddr[6];
+    uint8 localResolvablePvtAddr[6];
+    uint8 peerResolvablePvtAddr[6];
+    uint16 connIntv;
+    uint16 connLatency;
+    uint16 supervisionTo;
+    uint8 masterClockAccuracy;
+} CYBLE_GAP_ENHANCE_CONN_COMPLETE_T;
+
+#define CYBLE_GAP_MAX_ADV_DATA_LEN 31u
+#define CYBLE_GAP_MAX_SCAN_RSP_DATA_LEN 31u
+
+typedef struct {
+    uint8 advData[CYBLE_GAP_MAX_ADV_DATA_LEN];
+    uint8 advDataLen;
+} CYBLE_GAPP_DISC_DATA_T;
+
+typedef struct {
+    uint8 scanRspData[CYBLE_GAP_MAX_SCAN_RSP_DATA_LEN];
+    uint8 scanRspDataLen;
+} CYBLE_GAPP_SCAN_RSP_DATA_T;
+
+typedef struct {
+    uint8 discMode;
+    CYBLE_GAPP_DISC_DATA_T* advData;
+    CYBLE_GAPP_SCAN_RSP_DATA_T* scanRspData;
+    uint16 advTo;
+} CYBLE_GAPP_DISC_MODE_INFO_T;
+
+extern CYBLE_CONN_HANDLE_T cyBle_connHandle;
+extern CYBLE_GAPP_DISC_MODE_INFO_T cyBle_discoveryModeInfo;
+extern CYBLE_GAP_AUTH_INFO_T cyBle_authInfo;
+extern volatile uint8 cyBle_pendingFlashWrite;
+
+CYBLE_API_RESULT_T CyBle_Start(CYBLE_CALLBACK_T callbackFunc);
+void CyBle_ProcessEvents(void);
+CYBLE_STATE_T CyBle_GetState(void);
+CYBLE_LP_MODE_T CyBle_EnterLPM(CYBLE_LP_MODE_T pwrMode);
+void CyBle_ExitLPM(void);
+CYBLE_BLESS_STATE_T CyBle_GetBleSsState(void);
+uint8 CyBle_GattGetBusyStatus(void);
+CYBLE_API_RESULT_T CyBle_GetBleClockCfgParam(CYBLE_BLESS_CLK_CFG_PARAMS_T* bleSsClockConfig);
+CYBLE_API_RESULT_T CyBle_SetBleClockCfgParam(const CYBLE_BLESS_CLK_CFG_PARAMS_T* bleSsClockConfig);
+CYBLE_API_RESULT_T CyBle_GetDeviceAddress(CYBLE_GAP_BD_ADDR_T* bdAddr);
+CYBLE_API_RESULT_T CyBle_StoreBondingData(uint8 isForceWrite);
+CYBLE_API_RESULT_T CyBle_StoreAppData(uint8* srcBuff, const uint8 destAddr[], uint32 buffLen, uint8 isForceWrite);
+
+CYBLE_API_RESULT_T CyBle_GappStartAdvertisement(uint8 advertisingIntervalType);
+CYBLE_API_RESULT_T CyBle_GapUpdateAdvData(CYBLE_GAPP_DISC_DATA_T* advDiscData, CYBLE_GAPP_SCAN_RSP_DATA_T* advScanRespData);
+CYBLE_API_RESULT_T CyBle_GapDisconnect(uint8 bdHandle);
+CYBLE_API_RESULT_T CyBle_GapAuthReq(uint8 bdHandle, CYBLE_GAP_AUTH_INFO_T* authInfo);
+CYBLE_API_RESULT_T CyBle_GapFixAuthPassKey(uint8 isFixed, uint32 fixedPassKey);
+CYBLE_API_RESULT_T CyBle_GapSetDataLength(uint8 bdHandle, uint16 connMaxTxOctets, uint16 connMaxTxTime);
+CYBLE_API_RESULT_T CyBle_GapGetBondedDevicesList(CYBLE_GAP_BONDED_DEV_ADDR_LIST_T* bondedDevList);
+CYBLE_API_RESULT_T CyBle_GapRemoveBondedDevice(CYBLE_GAP_BD_ADDR_T* bdAddr);
+CYBLE_API_RESULT_T CyBle_L2capLeConnectionParamUpdateRequest(uint8 bdHandle, CYBLE_GAP_CONN_UPDATE_PARAM_T* connParam);
+
+CYBLE_GATT_ERR_CODE_T CyBle_GattsWriteAttributeValue(CYBLE_GATT_HANDLE_VALUE_PAIR_T* handleValuePair,
+    uint16 offset, CYBLE_CONN_HANDLE_T* connHandle, uint8 flags);
+CYBLE_API_RESULT_T CyBle_GattsNotification(CYBLE_CONN_HANDLE_T connHandle, CYBLE_GATTS_HANDLE_VALUE_NTF_T* ntfParam);
+CYBLE_API_RESULT_T CyBle_GattsWriteRsp(CYBLE_CONN_HANDLE_T connHandle);
+CYBLE_API_RESULT_T CyBle_GattsErrorRsp(CYBLE_CONN_HANDLE_T connHandle, CYBLE_GATTS_ERR_PARAM_T* errRspParam);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROJECT_H
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Control of the simulated hardware behind project.h. Time is virtual (ns)
+// and only advances when the firmware waits: CyDelay, CPU sleep and the
+// active time charged per main loop iteration (CyBle_ProcessEvents).
+// Devices are event sources on the virtual clock, sleep skips to the next
+// event that raises an interrupt.
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "project.h"
+
+#include <vector>
+
+#define SIM_US(us) ((uint64)(us) * 1000ull)
+#define SIM_MS(ms) ((uint64)(ms) * 1000000ull)
+#define SIM_SECONDS(s) ((uint64)(s) * 1000000000ull)
+#define SIM_NEVER UINT64_MAX
+
+// Active CPU time charged per CyBle_ProcessEvents (one main loop iteration)
+#define SIM_LOOP_ACTIVE SIM_US(20)
+// CPU blocked during a flash row write
+#define SIM_FLASH_WRITE SIM_MS(20)
+
+/* Simulation */
+
+// Initial state of all devices, call before use
+void Sim_Reset();
+uint64 Sim_Now();
+// Process events up to until, running interrupts when enabled. Returns to
+// Sim_RunFirmware when the end of the run is reached.
+void Sim_Advance(uint64 until);
+// Run main (the firmware, built with main renamed) until virtual time end
+void Sim_RunFirmware(int (*main)(void), uint64 end);
+
+// Event source on the virtual clock
+struct sim_device_t {
+	uint64 (*next)();       // time of next event, SIM_NEVER when idle
+	void (*process)();      // handle events due at Sim_Now()
+	int (*pending)();       // interrupt pending
+	void (*interrupt)();    // run interrupt handler
+	void (*reset)();
+};
+extern const sim_device_t uart_device;
+extern const sim_device_t ble_device;
+
+/* Power */
+
+struct sim_power_t {
+	uint64 active;          // ns CPU active
+	uint64 sleep;           // ns CPU sleep (peripherals on)
+	uint64 deepsleep;       // ns system deep sleep
+	uint32 wakeups;         // sleep or deep sleep exits
+	uint32 flash_writes;
+};
+const sim_power_t* Sim_GetPower();
+// Charge CPU active time, advancing the clock
+void Sim_Active(uint64 duration);
+// Program flash (const data of the firmware), blocks the CPU
+void Sim_FlashWrite(const void* destination, const void* source, size_t length);
+// Writes to the flash row holding address, for wear
+uint32 Sim_FlashRowWrites(const void* address);
+// Power fails during the write-th flash write from now (1: the next one):
+// the row is left erased with only programmed bytes written, and later
+// writes are lost. 0 restores power.
+void Sim_FlashPowerLoss(uint32 write, size_t programmed);
+
+/* GPIO */
+
+enum sim_gpio_t {
+	SIM_GPIO_LED_METER,
+	SIM_GPIO_LED_ADVERTISING,
+	SIM_GPIO_LED_DISCONNECT,
+	SIM_GPIO_BTN_USER,
+	SIM_GPIO_METER_REQUEST,
+	SIM_GPIO_METER_INVERT,
+	SIM_GPIO_COUNT
+};
+struct sim_gpio_state_t {
+	uint8 level;
+	uint32 rising;          // transitions to non-zero
+	uint64 high;            // ns at non-zero level, up to Sim_Now()
+	uint64 changed;         // time of last transition
+};
+sim_gpio_state_t Sim_GetGpio(sim_gpio_t gpio);
+void Sim_SetGpio(sim_gpio_t gpio, uint8 level); // inputs (button)
+
+/* Debug UART */
+
+typedef void (*sim_debug_uart_t)(uint8 data, void* context);
+// Receiver of bytes sent on the debug UART, stdout when not set. Sim_Reset
+// removes it.
+void Sim_SetDebugUart(sim_debug_uart_t receive, void* context);
+
+/* Trace of the hardware state, input of the energy model */
+
+enum sim_signal_t {
+	SIM_SIGNAL_GPIO,        // + sim_gpio_t, pin level
+	SIM_SIGNAL_CPU = SIM_SIGNAL_GPIO + SIM_GPIO_COUNT, // sim_cpu_t
+	SIM_SIGNAL_SYSCLK_DIV,  // system clock divider (1, 2, 4, 8)
+	SIM_SIGNAL_HFCLK,       // CY_SYS_CLK_HFCLK_IMO or _ECO
+	SIM_SIGNAL_IMO,         // IMO running
+	SIM_SIGNAL_BLESS,       // CYBLE_LP_MODE_T of the BLE subsystem, 0 while stopped
+	SIM_SIGNAL_UART,        // meter UART started
+	SIM_SIGNAL_ADVERTISING, // advertising
+	SIM_SIGNAL_CONNECTION,  // us between connection events listened to, 0 when not connected
+	SIM_SIGNAL_PACKETS,     // data packets in a connection event (each event traced)
+	SIM_SIGNAL_COUNT
+};
+enum sim_cpu_t {
+	SIM_CPU_ACTIVE,
+	SIM_CPU_SLEEP,
+	SIM_CPU_DEEPSLEEP
+};
+struct sim_trace_t {
+	uint64 time;
+	sim_signal_t signal;
+	uint32 value;
+};
+typedef void (*sim_trace_sink_t)(const sim_trace_t& trace, void* context);
+// Receive changes of the signals, starting with their current values.
+// Sim_Reset removes the sink.
+void Sim_SetTraceSink(sim_trace_sink_t sink, void* context);
+// Signal changed, from the simulated devices
+void Sim_Trace(sim_signal_t signal, uint32 value);
+const char* Sim_SignalName(sim_signal_t signal);
+// SIM_SIGNAL_COUNT when unknown
+sim_signal_t Sim_SignalFromName(const char* name);
+
+/* Meter UART */
+
+struct uart_mock_stats_t {
+	uint32 bytes;           // bytes put on the line
+	uint32 interrupts;      // ISR invocations
+	uint32 overflows;       // bytes lost as FIFO was full
+};
+// Replay bytes at the given baud rate (8N1), running the ISR as hardware would
+void UartMock_Replay(const char* data, size_t length, uint32 baud);
+const uart_mock_stats_t* UartMock_GetStats();
+
+/* Meter, sends a telegram each period while the request line is high */
+
+struct meter_sim_stats_t {
+	uint32 slots;           // telegram periods
+	uint32 sent;            // telegrams sent (request line high)
+	uint32 delivered;       // telegrams received by the UART up to the CRC
+};
+// Telegram template, line ends are converted to CR LF. The timestamp
+// (0-0:1.0.0) and CRC are rewritten for each telegram sent.
+void MeterSim_AddTelegram(const char* text, size_t length);
+void MeterSim_SetTiming(uint64 period, uint64 offset, uint32 baud);
+const meter_sim_stats_t* MeterSim_GetStats();
+uint64 MeterSim_LastSent();     // start of the last telegram sent
+
+/* BLE, centrals connect one at a time while advertising */
+
+// Notifications queued in the stack, more is rejected (busy)
+#define SIM_BLE_TX_BUFFERS 4
+// Packets sent per connection event
+#define SIM_BLE_TX_PER_EVENT 4
+
+struct sim_central_t {
+	uint64 connect;         // connect at (or once advertising after)
+	uint64 duration;        // disconnect after, SIM_NEVER stays connected
+	uint16 interval;        // initial connection interval (1.25 ms)
+	uint16 mtu;             // ATT MTU requested, 0 skips the exchange
+	bool bonded;            // encryption instead of pairing
+	bool reject_parameters; // reject connection parameter updates
+	std::vector<CYBLE_GATT_DB_ATTR_HANDLE_T> subscribe; // CCCDs written once secured
+	CYBLE_GATT_DB_ATTR_HANDLE_T read;                   // characteristic read each read_period
+	uint64 read_period;
+	CYBLE_GATT_DB_ATTR_HANDLE_T write;                  // characteristic written once subscribed
+	std::vector<uint8> write_value;
+};
+struct ble_sim_stats_t {
+	uint32 connections;
+	uint32 attribute_writes;    // CyBle_GattsWriteAttributeValue
+	uint32 notifications;       // accepted by the stack
+	uint32 rejected;            // notifications refused (no buffer, not connected)
+	uint32 delivered;           // notifications received by centrals
+	uint32 busy;                // stack busy events
+	uint32 reads;               // characteristic reads by centrals
+	uint32 writes;              // writes by centrals
+	uint32 write_errors;        // writes answered with an error response
+	uint32 parameter_updates;   // connection parameters applied
+	uint32 events;              // connection events with data
+	uint32 advertising_updates; // advertising data changed while advertising
+	uint32 flash_writes;        // rows written while connected
+	uint32 missed_events;       // listened connection events during those
+	uint64 latency_total;       // meter telegram start to notification received
+	uint64 latency_min;
+	uint64 latency_max;
+};
+void BleSim_AddCentral(const sim_central_t& central);
+const ble_sim_stats_t* BleSim_GetStats();
+// Receiver of notifications, as delivered to the central. Sim_Reset removes it.
+typedef void (*sim_notification_sink_t)(CYBLE_GATT_DB_ATTR_HANDLE_T handle,
+	const uint8* value, uint16 length, void* context);
+void BleSim_SetNotificationSink(sim_notification_sink_t sink, void* context);
+// Receiver of the scan response, as advertised from the start of
+// advertising and after each update. Sim_Reset removes it.
+typedef void (*sim_scan_response_sink_t)(const uint8* data, uint8 length, void* context);
+void BleSim_SetScanResponseSink(sim_scan_response_sink_t sink, void* context);
+uint32 BleSim_GetPasskey();     // fixed by the firmware
+
+#endif // SIM_H
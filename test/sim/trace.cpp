@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Signal names of the trace file, shared by dsmr_sim and dsmr_energy.
+
+#include "sim.h"
+
+#include <cstring>
+
+namespace {
+	const char* const signal_names[SIM_SIGNAL_COUNT] = {
+		"led_meter", "led_advertising", "led_disconnect", "btn_user", "meter_request", "meter_invert",
+		"cpu", "sysclk_div", "hfclk", "imo", "bless", "uart", "advertising", "connection", "packets"
+	};
+}
+
+const char* Sim_SignalName(sim_signal_t signal)
+{
+	return signal < SIM_SIGNAL_COUNT ? signal_names[signal] : "unknown";
+}
+
+sim_signal_t Sim_SignalFromName(const char* name)
+{
+	for (int signal = 0; signal < SIM_SIGNAL_COUNT; ++signal)
+		if (strcmp(name, signal_names[signal]) == 0)
+			return (sim_signal_t)signal;
+	return SIM_SIGNAL_COUNT;
+}
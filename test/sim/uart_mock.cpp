@@ -0,0 +1,299 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Meter UART (SCB with 8 byte RX FIFO) and the meter on the other end of
+// the line. Bytes arrive one byte time (10 bits) apart.
+
+#include "sim.h"
+
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace {
+	bool started = false;
+	cyisraddress isr = nullptr;
+	uint32 fifo_level = 0;
+	uint32 interrupt_mode = 0;
+	uint32 interrupt_source = 0;
+	std::deque<uint8> fifo;
+	uart_mock_stats_t stats;
+
+	enum { BYTE_FIRST = 1, BYTE_LAST = 2 }; // telegram boundaries
+	struct line_byte_t {
+		uint64 time;
+		uint8 data;
+		uint8 flags;
+	};
+	std::deque<line_byte_t> line;
+	bool telegram_intact = false;
+
+	// Meter
+	std::vector<std::string> telegrams;
+	size_t telegram_next = 0;
+	uint64 period = SIM_SECONDS(1);
+	uint64 offset = 0;
+	uint32 baud = 115200;
+	uint64 next_slot = SIM_NEVER;
+	uint64 last_sent = 0;
+	meter_sim_stats_t meter_stats;
+
+	uint64 byte_time(uint32 rate)
+	{
+		return SIM_SECONDS(10) / rate; // start, 8 data, stop bit
+	}
+
+	// Telegram ends at end (after the CRC), 0 for other data
+	void queue(const char* data, size_t length, uint32 rate, size_t end)
+	{
+		uint64 t = line.empty() ? Sim_Now() : line.back().time;
+		for (size_t i = 0; i < length; ++i)
+		{
+			t += byte_time(rate);
+			uint8 flags = 0;
+			if (end != 0 && i == 0)
+				flags |= BYTE_FIRST;
+			if (end != 0 && i + 1 == end)
+				flags |= BYTE_LAST;
+			line.push_back(line_byte_t{ t, (uint8)data[i], flags });
+		}
+	}
+
+	void receive(const line_byte_t& byte)
+	{
+		stats.bytes++;
+		if (byte.flags & BYTE_FIRST)
+			telegram_intact = true;
+		if (!started)
+			telegram_intact = false;
+		else if (fifo.size() >= UART_Meter_FIFO_SIZE)
+		{
+			stats.overflows++;
+			interrupt_source |= UART_Meter_INTR_RX_OVERFLOW;
+			telegram_intact = false;
+		}
+		else
+			fifo.push_back(byte.data);
+		if ((byte.flags & BYTE_LAST) && telegram_intact)
+			meter_stats.delivered++;
+	}
+
+	uint16 crc16(const std::string& data, size_t length)
+	{
+		// CRC16/ARC as used by DSMR
+		uint16 crc = 0;
+		for (size_t i = 0; i < length; ++i)
+		{
+			crc ^= (uint8)data[i];
+			for (int bit = 0; bit < 8; ++bit)
+				crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+		}
+		return crc;
+	}
+
+	// Timestamp YYMMDDhhmmssX of virtual time t, starting June 1st 2021 (summer time)
+	std::string timestamp(uint64 t)
+	{
+		static const int days_in_month[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		uint64 seconds = t / SIM_SECONDS(1);
+		uint64 days = seconds / 86400;
+		int year = 2021, month = 6, day = 1;
+		while (days > 0)
+		{
+			int length = days_in_month[month - 1] + (month == 2 && year % 4 == 0);
+			if (days + day <= (uint64)length)
+			{
+				day += (int)days;
+				break;
+			}
+			days -= length - day + 1;
+			day = 1;
+			if (++month > 12)
+			{
+				month = 1;
+				year++;
+			}
+		}
+		char text[64]; // any int, 13 characters for valid dates
+		snprintf(text, sizeof(text), "%02d%02d%02d%02d%02d%02dS", year % 100, month, day,
+			(int)(seconds / 3600 % 24), (int)(seconds / 60 % 60), (int)(seconds % 60));
+		return text;
+	}
+
+	void send(uint64 t)
+	{
+		std::string telegram = telegrams[telegram_next++ % telegrams.size()];
+		size_t pos = telegram.find("0-0:1.0.0(");
+		if (pos != std::string::npos && pos + 23 <= telegram.size())
+			telegram.replace(pos + 10, 13, timestamp(t));
+		pos = telegram.rfind('!');
+		size_t end = pos != std::string::npos ? pos + 1 : telegram.size();
+		if (pos != std::string::npos && pos + 5 <= telegram.size()
+			&& telegram.find_first_not_of("0123456789ABCDEFabcdef", pos + 1) >= pos + 5)
+		{
+			char crc[5];
+			snprintf(crc, sizeof(crc), "%04X", crc16(telegram, pos + 1));
+			telegram.replace(pos + 1, 4, crc);
+			end = pos + 5;
+		}
+		queue(telegram.data(), telegram.size(), baud, end);
+		meter_stats.sent++;
+		last_sent = t;
+	}
+
+	void update_source()
+	{
+		// Level based, as the SCB
+		if (fifo.size() > fifo_level)
+			interrupt_source |= UART_Meter_INTR_RX_TRIGGER;
+		if (!fifo.empty())
+			interrupt_source |= UART_Meter_INTR_RX_NOT_EMPTY;
+	}
+
+	uint64 uart_next()
+	{
+		uint64 t = line.empty() ? SIM_NEVER : line.front().time;
+		return next_slot < t ? next_slot : t;
+	}
+
+	void uart_process()
+	{
+		const uint64 now = Sim_Now();
+		while (next_slot <= now)
+		{
+			// Meter sends at its own pace, while requested
+			meter_stats.slots++;
+			if (Sim_GetGpio(SIM_GPIO_METER_REQUEST).level != 0)
+				send(next_slot);
+			next_slot += period;
+		}
+		while (!line.empty() && line.front().time <= now)
+		{
+			receive(line.front());
+			line.pop_front();
+		}
+	}
+
+	int uart_pending()
+	{
+		update_source();
+		return isr != nullptr && (interrupt_source & interrupt_mode) != 0;
+	}
+
+	void uart_interrupt()
+	{
+		stats.interrupts++;
+		isr();
+	}
+
+	void uart_reset()
+	{
+		started = false;
+		isr = nullptr;
+		fifo_level = interrupt_mode = interrupt_source = 0;
+		fifo.clear();
+		stats = uart_mock_stats_t();
+		line.clear();
+		telegram_intact = false;
+		telegrams.clear();
+		telegram_next = 0;
+		period = SIM_SECONDS(1);
+		offset = 0;
+		baud = 115200;
+		next_slot = SIM_NEVER;
+		last_sent = 0;
+		meter_stats = meter_sim_stats_t();
+	}
+}
+
+const sim_device_t uart_device = { uart_next, uart_process, uart_pending, uart_interrupt, uart_reset };
+
+void UartMock_Replay(const char* data, size_t length, uint32 rate)
+{
+	queue(data, length, rate, 0);
+	if (!line.empty())
+		Sim_Advance(line.back().time);
+}
+
+const uart_mock_stats_t* UartMock_GetStats()
+{
+	return &stats;
+}
+
+void MeterSim_AddTelegram(const char* text, size_t length)
+{
+	std::string telegram;
+	for (size_t i = 0; i < length; ++i)
+	{
+		if (text[i] == '\n' && (i == 0 || text[i - 1] != '\r'))
+			telegram += '\r';
+		telegram += text[i];
+	}
+	telegrams.push_back(telegram);
+	if (next_slot == SIM_NEVER)
+		MeterSim_SetTiming(period, offset, baud);
+}
+
+void MeterSim_SetTiming(uint64 telegram_period, uint64 telegram_offset, uint32 rate)
+{
+	period = telegram_period;
+	offset = telegram_offset;
+	baud = rate;
+	// First slot at offset in the current period
+	const uint64 now = Sim_Now();
+	next_slot = now / period * period + offset % period;
+	if (next_slot < now)
+		next_slot += period;
+	if (telegrams.empty())
+		next_slot = SIM_NEVER;
+}
+
+const meter_sim_stats_t* MeterSim_GetStats()
+{
+	return &meter_stats;
+}
+
+uint64 MeterSim_LastSent()
+{
+	return last_sent;
+}
+
+extern "C" {
+
+void UART_Meter_Start(void)
+{
+	started = true;
+	Sim_Trace(SIM_SIGNAL_UART, 1);
+}
+
+void UART_Meter_Stop(void)
+{
+	started = false;
+	fifo.clear();
+	interrupt_source = 0;
+	Sim_Trace(SIM_SIGNAL_UART, 0);
+}
+
+void UART_Meter_SetCustomInterruptHandler(cyisraddress func) { isr = func; }
+void UART_Meter_SetRxFifoLevel(uint32 level) { fifo_level = level; }
+void UART_Meter_SetRxInterruptMode(uint32 interruptMask) { interrupt_mode = interruptMask; }
+uint32 UART_Meter_GetRxInterruptSource(void) { return interrupt_source & interrupt_mode; }
+void UART_Meter_ClearRxInterruptSource(uint32 interruptMask) { interrupt_source &= ~interruptMask; }
+void UART_Meter_ClearPendingInt(void) {}
+
+uint32 UART_Meter_SpiUartReadRxData(void)
+{
+	if (fifo.empty())
+		return 0;
+	uint8 c = fifo.front();
+	fifo.pop_front();
+	return c;
+}
+
+uint32 UART_Meter_SpiUartGetRxBufferSize(void)
+{
+	return (uint32)fifo.size();
+}
+
+}
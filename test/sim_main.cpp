@@ -0,0 +1,564 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+// Runs the complete firmware (main.c and all modules) on the simulated
+// hardware against a meter sending example telegrams, reporting readings,
+// request line time, power mode residency and the average current of the
+// energy model.
+//
+// dsmr_sim [-d seconds] [-p period_ms] [-o offset_ms] [-v] [-c central]...
+//          [-t trace_file] [-l debug_uart_file] [-m parameter=value]... [--battery mAh]
+//          [--min-readings n] [--max-request-ms ms] [--min-notifications n]
+//          [--max-notifications n] [--max-current-ua uA] [--min-history n]
+//          [--min-aggregated n] [--min-beacons n] [--min-flash-rows n] [telegram files...]
+//
+// The trace (time in ns, signal, value per line) can be evaluated again
+// with dsmr_energy, for example with other model parameters (energy.h).
+// The debug UART is decoded (event log) to standard output with -v, -l
+// writes it unchanged for dsmr_eventlog.
+//
+// Centrals connect in order, each given as comma separated options:
+//   at=s        connect at (when advertising), default 0
+//   for=s       disconnect after, default stays connected
+//   interval=ms initial connection interval, default 30
+//   mtu=n       ATT MTU exchange
+//   notify=a+b  subscribe characteristics (or all)
+//   read=a      read characteristic each every=s (default 30)
+//   sync        download all history records (bulk.h)
+//   burst=s     aggregate s seconds of telegrams per reading (interval write)
+//   deadband=i:d:s  deadband d and silence s of deadband index i (main.c)
+//   beacon      turn on the beacon in the scan response (beacon.h)
+//   bonded      encryption with existing bond instead of pairing
+//   reject      reject connection parameter updates
+// Characteristics: consumption, tariff, timestamp, power, phases, gas,
+// gastime, snapshot, aggregate, demand, interval, deadband, beacon,
+// diagnostics, eventlog, history, historycontrol. A central writes once, for
+// sync, burst, deadband or beacon, whichever is given last.
+
+extern "C" {
+#include "aggregate.h"
+#include "beacon.h"
+#include "bulk.h"
+#include "dsmr.h"
+#include "flashlog.h"
+#include "history.h"
+#include "meter.h"
+#include "notify.h"
+#include "power.h"
+int Firmware_Main(void);
+}
+#include "energy.h"
+#include "eventlog_decode.h"
+#include "sim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#ifndef DSMR_EXAMPLE_DIR
+#  define DSMR_EXAMPLE_DIR "../dsrm-example"
+#endif
+
+struct characteristic_t {
+	const char* name;
+	CYBLE_GATT_DB_ATTR_HANDLE_T value;
+	CYBLE_GATT_DB_ATTR_HANDLE_T cccd;
+};
+
+static const characteristic_t characteristics[] = {
+	{ "consumption", CYBLE_POWER_METER_CONSUMPTION_CHAR_HANDLE,
+		CYBLE_POWER_METER_CONSUMPTION_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "tariff", CYBLE_POWER_METER_TARIFF_CHAR_HANDLE,
+		CYBLE_POWER_METER_TARIFF_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "timestamp", CYBLE_POWER_METER_TIMESTAMP_CHAR_HANDLE,
+		CYBLE_POWER_METER_TIMESTAMP_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "power", CYBLE_POWER_METER_INSTANTANEOUS_POWER_CHAR_HANDLE,
+		CYBLE_POWER_METER_INSTANTANEOUS_POWER_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "phases", CYBLE_POWER_METER_INSTANTANEOUS_PHASEINFO_CHAR_HANDLE,
+		CYBLE_POWER_METER_INSTANTANEOUS_PHASEINFO_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "gas", CYBLE_GAS_METER_CONSUMPTION_CHAR_HANDLE,
+		CYBLE_GAS_METER_CONSUMPTION_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "gastime", CYBLE_GAS_METER_TIMESTAMP_CHAR_HANDLE,
+		CYBLE_GAS_METER_TIMESTAMP_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "snapshot", CYBLE_POWER_METER_SNAPSHOT_CHAR_HANDLE,
+		CYBLE_POWER_METER_SNAPSHOT_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "aggregate", CYBLE_POWER_METER_AGGREGATE_CHAR_HANDLE,
+		CYBLE_POWER_METER_AGGREGATE_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "demand", CYBLE_POWER_METER_DEMAND_CHAR_HANDLE,
+		CYBLE_POWER_METER_DEMAND_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "interval", CYBLE_POWER_METER_INTERVAL_CHAR_HANDLE, 0 },
+	{ "deadband", CYBLE_POWER_METER_DEADBAND_CHAR_HANDLE, 0 },
+	{ "beacon", CYBLE_POWER_METER_BEACON_CHAR_HANDLE, 0 },
+	{ "diagnostics", CYBLE_POWER_METER_DIAGNOSTICS_CHAR_HANDLE, 0 },
+	{ "eventlog", CYBLE_POWER_METER_EVENT_LOG_CHAR_HANDLE, 0 },
+	{ "history", CYBLE_POWER_METER_HISTORY_DATA_CHAR_HANDLE,
+		CYBLE_POWER_METER_HISTORY_DATA_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+	{ "historycontrol", CYBLE_POWER_METER_HISTORY_CONTROL_CHAR_HANDLE,
+		CYBLE_POWER_METER_HISTORY_CONTROL_CLIENT_CHARACTERISTIC_CONFIGURATION_DESC_HANDLE },
+};
+
+static const characteristic_t* find_characteristic(const std::string& name)
+{
+	for (const characteristic_t& c : characteristics)
+		if (name == c.name)
+			return &c;
+	fprintf(stderr, "Unknown characteristic %s\n", name.c_str());
+	exit(2);
+}
+
+static std::vector<std::string> split(const std::string& text, char separator)
+{
+	std::vector<std::string> parts;
+	std::istringstream s(text);
+	std::string part;
+	while (std::getline(s, part, separator))
+		parts.push_back(part);
+	return parts;
+}
+
+static sim_central_t parse_central(const std::string& spec)
+{
+	sim_central_t central = sim_central_t();
+	central.duration = SIM_NEVER;
+	central.interval = 24;
+	central.read_period = SIM_SECONDS(30);
+	for (const std::string& option : split(spec, ','))
+	{
+		size_t eq = option.find('=');
+		std::string key = option.substr(0, eq);
+		std::string value = eq != std::string::npos ? option.substr(eq + 1) : "";
+		if (key == "at")
+			central.connect = SIM_SECONDS(atol(value.c_str()));
+		else if (key == "for")
+			central.duration = SIM_SECONDS(atol(value.c_str()));
+		else if (key == "interval")
+			central.interval = (uint16)(atol(value.c_str()) * 4 / 5);
+		else if (key == "mtu")
+			central.mtu = (uint16)atol(value.c_str());
+		else if (key == "notify")
+		{
+			for (const std::string& name : split(value, '+'))
+				for (const characteristic_t& c : characteristics)
+					if (c.cccd != 0 && (name == "all" || name == c.name))
+						central.subscribe.push_back(c.cccd);
+			if (central.subscribe.empty())
+				find_characteristic(value);
+		}
+		else if (key == "read")
+			central.read = find_characteristic(value)->value;
+		else if (key == "every")
+			central.read_period = SIM_SECONDS(atol(value.c_str()));
+		else if (key == "sync")
+		{
+			for (const char* name : { "history", "historycontrol" })
+			{
+				CYBLE_GATT_DB_ATTR_HANDLE_T cccd = find_characteristic(name)->cccd;
+				if (std::find(central.subscribe.begin(), central.subscribe.end(), cccd) == central.subscribe.end())
+					central.subscribe.push_back(cccd);
+			}
+			central.write = CYBLE_POWER_METER_HISTORY_CONTROL_CHAR_HANDLE;
+			central.write_value = { BULK_OP_REPORT, BULK_OPERATOR_ALL };
+		}
+		else if (key == "burst")
+		{
+			// Default intervals, the minimum is ignored
+			uint16 burst = (uint16)atol(value.c_str());
+			central.write = CYBLE_POWER_METER_INTERVAL_CHAR_HANDLE;
+			central.write_value = { 30, 0, 300 & 0xFF, 300 >> 8, 0, 0, (uint8)burst, (uint8)(burst >> 8) };
+		}
+		else if (key == "deadband")
+		{
+			std::vector<std::string> parts = split(value, ':');
+			uint32 deadband = parts.size() > 1 ? (uint32)atol(parts[1].c_str()) : 0;
+			uint16 silence = parts.size() > 2 ? (uint16)atol(parts[2].c_str()) : 0;
+			central.write = CYBLE_POWER_METER_DEADBAND_CHAR_HANDLE;
+			central.write_value = { (uint8)atol(value.c_str()),
+				(uint8)deadband, (uint8)(deadband >> 8), (uint8)(deadband >> 16), (uint8)(deadband >> 24),
+				(uint8)silence, (uint8)(silence >> 8) };
+		}
+		else if (key == "beacon")
+		{
+			central.write = CYBLE_POWER_METER_BEACON_CHAR_HANDLE;
+			central.write_value = { 1 };
+		}
+		else if (key == "bonded")
+			central.bonded = true;
+		else if (key == "reject")
+			central.reject_parameters = true;
+		else
+		{
+			fprintf(stderr, "Unknown central option %s\n", option.c_str());
+			exit(2);
+		}
+	}
+	return central;
+}
+
+struct trace_sinks_t {
+	FILE* file;
+	energy_t* energy;
+};
+
+static void trace(const sim_trace_t& trace, void* context)
+{
+	trace_sinks_t* sinks = (trace_sinks_t*)context;
+	if (sinks->file != nullptr)
+		fprintf(sinks->file, "%llu %s %u\n", (unsigned long long)trace.time,
+			Sim_SignalName(trace.signal), (unsigned)trace.value);
+	Energy_Trace(trace, sinks->energy);
+}
+
+struct debug_uart_t {
+	FILE* file;
+	eventlog_decoder_t decoder;
+};
+
+static void debug_uart(uint8 data, void* context)
+{
+	debug_uart_t* uart = (debug_uart_t*)context;
+	if (uart->file != nullptr)
+		fputc(data, uart->file);
+	EventLogDecoder_Put(&uart->decoder, data);
+}
+
+// History download at the central: data notifications are one byte stream
+// per transfer, decoded once the control point reports the end
+struct history_sync_t {
+	std::vector<uint8> stream;
+	uint32 transfers;
+	uint32 records;
+	uint32 notifications;
+	uint32 bytes;
+	uint32 errors;              // failed transfers, bad stream or order
+};
+
+// Notifications received by the centrals
+struct notifications_t {
+	history_sync_t sync;
+	uint32 aggregates;          // aggregate notifications
+	uint32 aggregated;          // telegrams in them
+	uint32 aggregate_seconds;
+};
+
+static void notification(CYBLE_GATT_DB_ATTR_HANDLE_T handle, const uint8* value, uint16 length, void* context)
+{
+	notifications_t* received = (notifications_t*)context;
+	history_sync_t* sync = &received->sync;
+	if (handle == CYBLE_POWER_METER_AGGREGATE_CHAR_HANDLE && length >= 17 && value[0] == AGGREGATE_VERSION)
+	{
+		uint16 count = (uint16)(value[13] | (value[14] << 8));
+		uint16 seconds = (uint16)(value[15] | (value[16] << 8));
+		received->aggregates++;
+		received->aggregated += count;
+		received->aggregate_seconds += seconds;
+		// Standard output, shown with -v. Power is the first field.
+		if (length >= 17 + 16)
+			printf("Aggregate %u telegrams in %u s, power %u/%u/%u W\n", (unsigned)count, (unsigned)seconds,
+				(unsigned)(value[17] | (value[18] << 8) | (value[19] << 16) | ((uint32)value[20] << 24)),
+				(unsigned)(value[25] | (value[26] << 8) | (value[27] << 16) | ((uint32)value[28] << 24)),
+				(unsigned)(value[21] | (value[22] << 8) | (value[23] << 16) | ((uint32)value[24] << 24)));
+	}
+	else if (handle == CYBLE_POWER_METER_HISTORY_DATA_CHAR_HANDLE)
+	{
+		sync->stream.insert(sync->stream.end(), value, value + length);
+		sync->notifications++;
+		sync->bytes += length;
+	}
+	else if (handle == CYBLE_POWER_METER_HISTORY_CONTROL_CHAR_HANDLE && length == 4
+		&& value[0] == BULK_OP_RESPONSE && value[2] == BULK_OP_REPORT)
+	{
+		sync->transfers++;
+		if (value[3] != BULK_RESPONSE_SUCCESS)
+			sync->errors++;
+		history_sample_t sample = history_sample_t();
+		uint32 last = 0;
+		for (size_t pos = 0; pos < sync->stream.size(); )
+		{
+			uint16 used = History_Decode(&sample, sync->stream.data() + pos, (uint16)(sync->stream.size() - pos));
+			if (used == 0 || (pos != 0 && sample.value[HISTORY_FIELD_TIME] <= last))
+			{
+				sync->errors++;
+				break;
+			}
+			// Standard output, shown with -v
+			printf("History %u: in %u/%u, out %u/%u, power %d/%d/%d, gas %u\n",
+				(unsigned)sample.value[HISTORY_FIELD_TIME],
+				(unsigned)sample.value[HISTORY_FIELD_E_IN1], (unsigned)sample.value[HISTORY_FIELD_E_IN2],
+				(unsigned)sample.value[HISTORY_FIELD_E_OUT1], (unsigned)sample.value[HISTORY_FIELD_E_OUT2],
+				(int)sample.value[HISTORY_FIELD_P_MIN], (int)sample.value[HISTORY_FIELD_P_AVG],
+				(int)sample.value[HISTORY_FIELD_P_MAX], (unsigned)sample.value[HISTORY_FIELD_GAS_IN]);
+			last = sample.value[HISTORY_FIELD_TIME];
+			sync->records++;
+			pos += used;
+		}
+		sync->stream.clear();
+	}
+}
+
+// Listener scanning for the beacon, with the passcode: payloads must carry a
+// valid MAC and a sequence that does not go back
+struct beacon_listener_t {
+	uint32 beacons;             // new sequence, valid
+	uint32 errors;              // bad MAC or older sequence
+	uint32 sequence;
+	int32 power;
+};
+
+static void scan_response(const uint8* data, uint8 length, void* context)
+{
+	beacon_listener_t* listener = (beacon_listener_t*)context;
+	for (uint8 pos = 0; pos + 1 < length && data[pos] != 0; pos += data[pos] + 1)
+	{
+		const uint8* ad = data + pos;
+		if (ad[0] + 1 != BEACON_AD_SIZE || ad[1] != 0xFF || (ad[2] | (ad[3] << 8)) != BEACON_COMPANY
+			|| ad[4] != BEACON_VERSION || pos + BEACON_AD_SIZE > length)
+			continue;
+		const uint8* payload = ad + 4;
+		auto get_uint32 = [&](int offset) {
+			return (uint32)payload[offset] | (uint32)payload[offset + 1] << 8
+				| (uint32)payload[offset + 2] << 16 | (uint32)payload[offset + 3] << 24;
+		};
+		CYBLE_GAP_BD_ADDR_T address;
+		CyBle_GetDeviceAddress(&address);
+		uint8 key[BEACON_KEY_SIZE];
+		Beacon_Key(key, BleSim_GetPasskey(), address.bdAddr);
+		uint32 sequence = get_uint32(1);
+		if ((uint32)Beacon_SipHash(key, payload, 10) != get_uint32(10) || sequence < listener->sequence)
+			listener->errors++;
+		else if (sequence != listener->sequence)
+		{
+			listener->beacons++;
+			listener->sequence = sequence;
+			listener->power = (int32)get_uint32(5);
+		}
+	}
+}
+
+static double percent(uint64 part, uint64 total)
+{
+	return total ? 100.0 * part / total : 0.0;
+}
+
+int main(int argc, char** argv)
+{
+	uint64 duration = SIM_SECONDS(3600);
+	uint64 period = SIM_SECONDS(1);
+	uint64 offset = SIM_MS(250);
+	bool verbose = false;
+	long min_readings = 0;
+	double max_request_ms = 0;
+	long min_notifications = 0;
+	long max_notifications = -1;
+	double max_current = 0;
+	long min_history = 0;
+	long min_aggregated = 0;
+	long min_beacons = 0;
+	long min_flash_rows = 0;
+	double battery = 0;
+	const char* trace_file = nullptr;
+	const char* debug_file = nullptr;
+	energy_model_t model = energy_model_default;
+	std::vector<std::string> files;
+	std::vector<sim_central_t> centrals;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool value = i + 1 < argc;
+		if (arg == "-d" && value)
+			duration = SIM_SECONDS(atol(argv[++i]));
+		else if (arg == "-p" && value)
+			period = SIM_MS(atol(argv[++i]));
+		else if (arg == "-o" && value)
+			offset = SIM_MS(atol(argv[++i]));
+		else if (arg == "-v")
+			verbose = true;
+		else if (arg == "--min-readings" && value)
+			min_readings = atol(argv[++i]);
+		else if (arg == "--max-request-ms" && value)
+			max_request_ms = atof(argv[++i]);
+		else if (arg == "--min-notifications" && value)
+			min_notifications = atol(argv[++i]);
+		else if (arg == "--max-notifications" && value)
+			max_notifications = atol(argv[++i]);
+		else if (arg == "--max-current-ua" && value)
+			max_current = atof(argv[++i]);
+		else if (arg == "--min-history" && value)
+			min_history = atol(argv[++i]);
+		else if (arg == "--min-aggregated" && value)
+			min_aggregated = atol(argv[++i]);
+		else if (arg == "--min-beacons" && value)
+			min_beacons = atol(argv[++i]);
+		else if (arg == "--min-flash-rows" && value)
+			min_flash_rows = atol(argv[++i]);
+		else if (arg == "--battery" && value)
+			battery = atof(argv[++i]);
+		else if (arg == "-t" && value)
+			trace_file = argv[++i];
+		else if (arg == "-l" && value)
+			debug_file = argv[++i];
+		else if (arg == "-m" && value)
+		{
+			if (!Energy_SetParameter(&model, argv[++i]))
+			{
+				fprintf(stderr, "Unknown model parameter %s\n", argv[i]);
+				return 2;
+			}
+		}
+		else if (arg == "-c" && value)
+			centrals.push_back(parse_central(argv[++i]));
+		else if (arg[0] == '-')
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 2;
+		}
+		else
+			files.push_back(arg);
+	}
+	if (files.empty())
+		files.push_back(DSMR_EXAMPLE_DIR "/p1-example-5.0.txt");
+
+	Sim_Reset();
+	for (const std::string& filename : files)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file)
+		{
+			fprintf(stderr, "Cannot read %s\n", filename.c_str());
+			return 2;
+		}
+		std::ostringstream s;
+		s << file.rdbuf();
+		MeterSim_AddTelegram(s.str().data(), s.str().size());
+	}
+	MeterSim_SetTiming(period, offset, 115200);
+	for (const sim_central_t& central : centrals)
+		BleSim_AddCentral(central);
+
+	// Firmware debug output (stdout) only when verbose
+	FILE* report = stdout;
+	if (!verbose)
+	{
+		report = fdopen(dup(fileno(stdout)), "w");
+		if (report == nullptr || freopen("/dev/null", "w", stdout) == nullptr)
+			return 2;
+	}
+
+	energy_t energy;
+	Energy_Init(&energy, &model);
+	trace_sinks_t sinks = { nullptr, &energy };
+	if (trace_file != nullptr && (sinks.file = fopen(trace_file, "w")) == nullptr)
+	{
+		fprintf(stderr, "Cannot write %s\n", trace_file);
+		return 2;
+	}
+	Sim_SetTraceSink(trace, &sinks);
+	debug_uart_t uart;
+	EventLogDecoder_Init(&uart.decoder, stdout);
+	uart.file = nullptr;
+	if (debug_file != nullptr && (uart.file = fopen(debug_file, "wb")) == nullptr)
+	{
+		fprintf(stderr, "Cannot write %s\n", debug_file);
+		return 2;
+	}
+	Sim_SetDebugUart(debug_uart, &uart);
+	notifications_t received = notifications_t();
+	const history_sync_t& sync = received.sync;
+	BleSim_SetNotificationSink(notification, &received);
+	beacon_listener_t listener = beacon_listener_t();
+	BleSim_SetScanResponseSink(scan_response, &listener);
+
+	auto start = std::chrono::steady_clock::now();
+	Sim_RunFirmware(Firmware_Main, duration);
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const uint64 now = Sim_Now();
+	Energy_Finish(&energy, now);
+	if (sinks.file != nullptr)
+	{
+		fprintf(sinks.file, "%llu end 0\n", (unsigned long long)now);
+		fclose(sinks.file);
+	}
+	if (uart.file != nullptr)
+		fclose(uart.file);
+	fflush(stdout);
+	const sim_power_t* power = Sim_GetPower();
+	const meter_sim_stats_t* meter = MeterSim_GetStats();
+	const sim_gpio_state_t request = Sim_GetGpio(SIM_GPIO_METER_REQUEST);
+	const ble_sim_stats_t* ble = BleSim_GetStats();
+	const struct dsmr_data_t* latest = Meter_GetLatestDsmr();
+	double request_ms = request.rising ? request.high / 1e6 / request.rising : 0;
+
+	fprintf(report, "Simulated %.0f s in %.3f s (%.0fx)\n", now / 1e9, wall, now / 1e9 / wall);
+	fprintf(report, "Meter periods %u, sent %u, received %u\n",
+		(unsigned)meter->slots, (unsigned)meter->sent, (unsigned)meter->delivered);
+	fprintf(report, "Request %u times, %.1f ms per request, %.3f%% of time\n",
+		(unsigned)request.rising, request_ms, percent(request.high, now));
+	fprintf(report, "Residency active %.3f%%, sleep %.3f%%, deep sleep %.3f%%, wakeups %u, flash writes %u\n",
+		percent(power->active, now), percent(power->sleep, now), percent(power->deepsleep, now),
+		(unsigned)power->wakeups, (unsigned)power->flash_writes);
+	// Firmware's own counters, in LFCLK ticks
+	const struct power_stats_t* counted = Power_GetStats();
+	uint64 ticks = 0;
+	for (int i = 0; i < POWER_STATE_COUNT; ++i)
+		ticks += counted->state_ticks[i];
+	fprintf(report, "Counted active %.3f%%, sleep %.3f%%, deep sleep %.3f%%, wakeups timer %u, UART %u, other %u\n",
+		percent(counted->state_ticks[POWER_STATE_ACTIVE], ticks),
+		percent(counted->state_ticks[POWER_STATE_SLEEP] + counted->state_ticks[POWER_STATE_SLEEP_ECO], ticks),
+		percent(counted->state_ticks[POWER_STATE_DEEPSLEEP], ticks), (unsigned)counted->wakeups[POWER_WAKEUP_TIMER],
+		(unsigned)counted->wakeups[POWER_WAKEUP_UART], (unsigned)counted->wakeups[POWER_WAKEUP_OTHER]);
+	if (ble->connections != 0)
+	{
+		fprintf(report, "BLE connections %u, parameter updates %u, writes %u, reads %u\n",
+			(unsigned)ble->connections, (unsigned)ble->parameter_updates, (unsigned)ble->writes, (unsigned)ble->reads);
+		fprintf(report, "Flash rows written while connected %u, missed connection events %u\n",
+			(unsigned)ble->flash_writes, (unsigned)ble->missed_events);
+		fprintf(report, "Attribute writes %u (%.1f per telegram), notifications %u, rejected %u, busy %u\n",
+			(unsigned)ble->attribute_writes, meter->delivered ? (double)ble->attribute_writes / meter->delivered : 0.0,
+			(unsigned)ble->notifications, (unsigned)ble->rejected, (unsigned)ble->busy);
+		const struct notify_stats_t* notify = Notify_GetStats();
+		fprintf(report, "Notify queued %u, sent %u, coalesced %u, skipped %u, dropped %u\n",
+			(unsigned)notify->queued, (unsigned)notify->sent, (unsigned)notify->coalesced,
+			(unsigned)notify->skipped, (unsigned)notify->dropped);
+		fprintf(report, "Notifications received %u in %u connection events, latency %.1f/%.1f/%.1f ms (min/avg/max)\n",
+			(unsigned)ble->delivered, (unsigned)ble->events, ble->latency_min / 1e6,
+			ble->delivered ? ble->latency_total / 1e6 / ble->delivered : 0.0, ble->latency_max / 1e6);
+	}
+	fprintf(report, "History stored %u samples in %u bytes, flash log %u rows, commits deferred %u\n",
+		(unsigned)History_Count(), (unsigned)History_Used(), (unsigned)FlashLog_Rows(), (unsigned)FlashLog_Deferred());
+	if (sync.transfers != 0)
+		fprintf(report, "History transfers %u, records %u in %u notifications (%u bytes), errors %u\n",
+			(unsigned)sync.transfers, (unsigned)sync.records, (unsigned)sync.notifications,
+			(unsigned)sync.bytes, (unsigned)sync.errors);
+	if (received.aggregates != 0)
+		fprintf(report, "Aggregates %u, %.1f telegrams in %.1f s each\n", (unsigned)received.aggregates,
+			(double)received.aggregated / received.aggregates, (double)received.aggregate_seconds / received.aggregates);
+	if (listener.beacons != 0 || listener.errors != 0 || ble->advertising_updates != 0)
+		fprintf(report, "Beacons %u in %u advertising updates, rejected %u, latest power %d W\n",
+			(unsigned)listener.beacons, (unsigned)ble->advertising_updates, (unsigned)listener.errors,
+			(int)listener.power);
+	Energy_Print(report, &energy, battery);
+	fprintf(report, "Event log entries %u, lost %u\n", (unsigned)uart.decoder.entries, (unsigned)uart.decoder.lost);
+	if (latest != NULL)
+		fprintf(report, "Latest telegram %02u:%02u:%02u\n",
+			latest->timestamp.hour, latest->timestamp.minute, latest->timestamp.second);
+
+	bool ok = latest != NULL && meter->delivered >= (uint32)min_readings
+		&& (max_request_ms <= 0 || request_ms <= max_request_ms)
+		&& ble->delivered >= (uint32)min_notifications
+		&& (max_notifications < 0 || ble->delivered <= (uint32)max_notifications)
+		&& (max_current <= 0 || Energy_AverageCurrent(&energy) <= max_current)
+		&& sync.records >= (uint32)min_history && sync.errors == 0
+		&& received.aggregated >= (uint32)min_aggregated
+		&& listener.beacons >= (uint32)min_beacons && listener.errors == 0
+		&& FlashLog_Rows() >= (uint32)min_flash_rows && ble->missed_events == 0;
+	fprintf(report, "%s\n", ok ? "ok" : "failed");
+	fflush(report);
+	return ok ? 0 : 1;
+}
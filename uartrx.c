@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#include "uartrx.h"
+#include "ring.h"
+#include "power.h"
+
+#define UARTRX_LEVEL_ANY 0
+
+static enum UARTRX_STATE_T
+{
+    UARTRX_STATE_RECEIVE,
+    UARTRX_STATE_WAITFORSTART
+} uartrx_state = UARTRX_STATE_WAITFORSTART;
+
+static struct ring_t* uartrx_ring = NULL;
+static volatile uint32 uartrx_start_tick = 0;
+static volatile uint8 uartrx_started = 0;
+static volatile uint32 uartrx_interrupts = 0;
+
+CY_ISR_PROTO(ISR_UART_Meter_Interrupt);
+
+void UartRx_Init(struct ring_t* ring)
+{
+    uartrx_ring = ring;
+    UART_Meter_SetCustomInterruptHandler(ISR_UART_Meter_Interrupt);
+}
+
+void UartRx_Start()
+{
+    uartrx_state = UARTRX_STATE_WAITFORSTART;
+    uartrx_started = 0;
+    Ring_Flush(uartrx_ring);
+    UART_Meter_Start();
+    UART_Meter_SetRxFifoLevel(UARTRX_LEVEL_ANY);
+    UART_Meter_SetRxInterruptMode(UART_Meter_INTR_RX_TRIGGER
+        | UART_Meter_INTR_RX_OVERFLOW | UART_Meter_INTR_RX_FRAME_ERROR);
+}
+
+void UartRx_Stop()
+{
+    UART_Meter_Stop();
+}
+
+// Move bytes from FIFO to ring, called with interrupts disabled
+static void UartRx_Drain()
+{
+    while (UART_Meter_SpiUartGetRxBufferSize())
+    {
+        char data = UART_Meter_SpiUartReadRxData();
+        if (data == '/')
+        {
+            // Telegram start, for the scheduler
+            uartrx_start_tick = CySysWdtGetCount(CY_SYS_WDT_COUNTER2);
+            uartrx_started = 1;
+            UART_Meter_SetRxFifoLevel(UARTRX_LEVEL_BODY);
+        }
+        else if (data == '!')
+        {
+            // Only CRC and line end follow
+            UART_Meter_SetRxFifoLevel(UARTRX_LEVEL_ANY);
+        }
+        if (uartrx_state == UARTRX_STATE_RECEIVE || data == '/')
+        {
+            // On overrun, restart at the next telegram
+            uartrx_state = Ring_Put(uartrx_ring, data) ? UARTRX_STATE_RECEIVE : UARTRX_STATE_WAITFORSTART;
+        }
+    }
+}
+
+void UartRx_Poll()
+{
+    uint8 intStatus = CyEnterCriticalSection();
+    UartRx_Drain();
+    CyExitCriticalSection(intStatus);
+}
+
+uint8 UartRx_Started()
+{
+    return uartrx_started;
+}
+
+uint32 UartRx_StartTick()
+{
+    return uartrx_start_tick;
+}
+
+uint32 UartRx_GetInterrupts()
+{
+    return uartrx_interrupts;
+}
+
+CY_ISR(ISR_UART_Meter_Interrupt)
+{
+    /* Returns the status/identity of which enabled RX interrupt source caused interrupt event */
+    uint32 source = UART_Meter_GetRxInterruptSource();
+    uartrx_interrupts++;
+    Power_Wakeup(POWER_WAKEUP_UART);
+
+    // Bytes were lost (FIFO full) or corrupted: the telegram is incomplete.
+    // Handled as a ring overrun before draining, so the bytes after the
+    // gap are dropped and the consumer resynchronizes (Ring_Resync) at the
+    // next telegram start.
+    if ((UART_Meter_INTR_RX_OVERFLOW | UART_Meter_INTR_RX_FRAME_ERROR) & source) {
+        uartrx_state = UARTRX_STATE_WAITFORSTART;
+        Ring_Gap(uartrx_ring);
+        UART_Meter_ClearRxInterruptSource(UART_Meter_INTR_RX_OVERFLOW | UART_Meter_INTR_RX_FRAME_ERROR);
+    }
+    /* Checks for "RX FIFO above level" interrupt */
+    if(UART_Meter_INTR_RX_TRIGGER & source)
+    {
+        UartRx_Drain();
+        /* Clear UART "RX FIFO above level" interrupt, stays set while above level */
+        UART_Meter_ClearRxInterruptSource(UART_Meter_INTR_RX_TRIGGER);
+    }
+    UART_Meter_ClearPendingInt();
+}
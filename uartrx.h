@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-3.0-only */
+/* Copyright (C) 2021, Joris Dobbelsteen. */
+
+#ifndef UARTRX_H
+#define UARTRX_H
+
+#include <project.h>
+
+struct ring_t;
+
+// Meter UART receive interrupt. Batches bytes using the RX FIFO trigger
+// level: high while in the telegram body, any byte before the start ('/')
+// and after the end ('!'), so the telegram end is not delayed. Bytes below
+// the trigger level on an idle line are picked up by UartRx_Poll.
+
+void UartRx_Init(struct ring_t* ring);
+void UartRx_Start();        // flushes the ring, starts the UART
+void UartRx_Stop();
+void UartRx_Poll();         // call from main loop while receiving
+
+uint8 UartRx_Started();     // telegram start received since UartRx_Start
+uint32 UartRx_StartTick();  // WDT2 tick of last telegram start
+uint32 UartRx_GetInterrupts();
+
+// Interrupt when more than this number of bytes are in the FIFO within the
+// telegram body. Half the FIFO leaves room for four more bytes (347 us at
+// 115200 baud) of interrupt latency, e.g. BLE stack critical sections.
+#define UARTRX_LEVEL_BODY (UART_Meter_FIFO_SIZE / 2)
+
+#endif // UARTRX_H